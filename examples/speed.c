@@ -58,8 +58,35 @@ void speedTest (int pin, int maxCount)
 }
 
 
+void speedTestFast (struct wiringPiPinHandle *handle, int maxCount)
+{
+  int count, sum, perSec, i ;
+  unsigned int start, end ;
+
+  sum = 0 ;
+
+  for (i = 0 ; i < PASSES ; ++i)
+  {
+    start = millis () ;
+    for (count = 0 ; count < maxCount ; ++count)
+      digitalWriteFast (handle, 1) ;
+    end = millis () ;
+    printf (" %6d", end - start) ;
+    fflush (stdout) ;
+    sum += (end - start) ;
+  }
+
+  digitalWriteFast (handle, 0) ;
+  printf (". Av: %6dmS", sum / PASSES) ;
+  perSec = (int)(double)maxCount / (double)((double)sum / (double)PASSES) * 1000.0 ;
+  printf (": %7d/sec\n", perSec) ;
+}
+
+
 int main (void)
 {
+  struct wiringPiPinHandle handle ;
+
   printf ("Raspberry Pi wiringPi GPIO speed test program\n") ;
   printf ("=============================================\n") ;
 
@@ -84,6 +111,12 @@ int main (void)
   pinMode (11, OUTPUT) ;
   speedTest (11, FAST_COUNT) ;
 
+// Pre-resolved pin handle
+
+  printf ("\nPin handle method: (%8d iterations)\n", FAST_COUNT) ;
+  wiringPiPinHandle (11, &handle) ;
+  speedTestFast (&handle, FAST_COUNT) ;
+
 // Switch to SYS mode:
 
   system ("/usr/local/bin/gpio export 17 out") ;
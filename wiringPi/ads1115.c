@@ -141,6 +141,8 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
   int chan = pin - node->pinBase ;
   int16_t  result ;
   uint16_t config = CONFIG_DEFAULT ;
+  struct wiringPiI2CBatch batch ;
+  uint8_t  status [2], conv [2] ;
 
   chan &= 7 ;
 
@@ -179,19 +181,24 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
   config = __bswap_16 (config) ;
   wiringPiI2CWriteReg16 (node->fd, 1, config) ;
 
-// Wait for the conversion to complete
+// Wait for the conversion to complete. Each poll reads the config and the
+//	conversion registers in one transaction, so the result is already
+//	there when the ready bit shows up.
+
+  wiringPiI2CBatchInit    (&batch, node->fd) ;
+  wiringPiI2CBatchReadReg (&batch, -1, 1, status, 2) ;
+  wiringPiI2CBatchReadReg (&batch, -1, 0, conv,   2) ;
 
   for (;;)
   {
-    result =  wiringPiI2CReadReg16 (node->fd, 1) ;
-    result = __bswap_16 (result) ;
-    if ((result & CONFIG_OS_MASK) != 0)
+    if (wiringPiI2CBatchRun (&batch) < 0)
+      return 0 ;
+    if ((((status [0] << 8) | status [1]) & CONFIG_OS_MASK) != 0)
       break ;
     delayMicroseconds (100) ;
   }
 
-  result =  wiringPiI2CReadReg16 (node->fd, 0) ;
-  result = __bswap_16 (result) ;
+  result = (int16_t)((conv [0] << 8) | conv [1]) ;
 
 // Sometimes with a 0v input on a single-ended channel the internal 0v reference
 //	can be higher than the input, so you get a negative result...
@@ -62,6 +62,10 @@ uint32_t cPress, cTemp ;
 
 static int altitude ;
 
+// Big endian word n of the calibration block
+
+#define	CAL16(n)	((cal [(n) * 2] << 8) | cal [(n) * 2 + 1])
+
 /*
  * read16:
  *	Quick hack to read the 16-bit data with the correct endian
@@ -75,13 +79,31 @@ uint16_t read16 (int fd, int reg)
 }
 
 
+/*
+ * readBlock:
+ *	Read consecutive registers in one I2C transaction
+ *********************************************************************************
+ */
+
+static int readBlock (int fd, int reg, uint8_t *data, int len)
+{
+  struct wiringPiI2CBatch batch ;
+
+  wiringPiI2CBatchInit    (&batch, fd) ;
+  wiringPiI2CBatchReadReg (&batch, -1, reg, data, len) ;
+
+  return wiringPiI2CBatchRun (&batch) ;
+}
+
+
 /*
  * bmp180ReadTempPress:
- *	Does the hard work of reading the sensor
+ *	Does the hard work of reading the sensor. Returns -1 if the sensor
+ *	could not be read, and leaves cTemp and cPress alone.
  *********************************************************************************
  */
 
-static void bmp180ReadTempPress (int fd)
+static int bmp180ReadTempPress (int fd)
 {
   double fTemp, fPress ;
   double tu, a ;
@@ -96,8 +118,8 @@ static void bmp180ReadTempPress (int fd)
 
 // Read the raw data
 
-  data [0] = wiringPiI2CReadReg8 (fd, 0xF6) ;
-  data [1] = wiringPiI2CReadReg8 (fd, 0xF7) ;
+  if (readBlock (fd, 0xF6, data, 2) < 0)
+    return -1 ;
 
 // And calculate...
 
@@ -118,9 +140,8 @@ static void bmp180ReadTempPress (int fd)
 
 // Read the raw data
 
-  data [0] = wiringPiI2CReadReg8 (fd, 0xF6) ;
-  data [1] = wiringPiI2CReadReg8 (fd, 0xF7) ;
-  data [2] = wiringPiI2CReadReg8 (fd, 0xF8) ;
+  if (readBlock (fd, 0xF6, data, 3) < 0)
+    return -1 ;
 
 // And calculate...
 
@@ -135,6 +156,8 @@ static void bmp180ReadTempPress (int fd)
 #ifdef	DEBUG
   printf ("fPress: %f, cPress: %6d\n", fPress, cPress) ;
 #endif
+
+  return 0 ;
 }
 
 
@@ -155,6 +178,7 @@ static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
 
 /*
  * myAnalogRead:
+ *	-9998 if the sensor didn't answer
  *********************************************************************************
  */
 
@@ -162,7 +186,8 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 {
   int chan = pin - node->pinBase ;
 
-  bmp180ReadTempPress (node->fd) ;
+  if (bmp180ReadTempPress (node->fd) < 0)
+    return -9998 ;
 
   /**/ if (chan == 0)	// Read Temperature
     return cTemp ;
@@ -188,31 +213,32 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 int bmp180Setup (const int pinBase)
 {
   double c3, c4, b1 ;
+  uint8_t cal [22] ;
   int fd ;
   struct wiringPiNodeStruct *node ;
 
   if ((fd = wiringPiI2CSetup (I2C_ADDRESS)) < 0)
     return FALSE ;
 
-  node = wiringPiNewNode (pinBase, 4) ;
+// Read calibration data, all 11 words in one go, before claiming the pins
 
-  node->fd          = fd ;
-  node->analogRead  = myAnalogRead ;
-  node->analogWrite = myAnalogWrite ;
-
-// Read calibration data
-
-  AC1 = read16 (fd, 0xAA) ;
-  AC2 = read16 (fd, 0xAC) ;
-  AC3 = read16 (fd, 0xAE) ;
-  AC4 = read16 (fd, 0xB0) ;
-  AC5 = read16 (fd, 0xB2) ;
-  AC6 = read16 (fd, 0xB4) ;
-  VB1 = read16 (fd, 0xB6) ;
-  VB2 = read16 (fd, 0xB8) ;
-   MB = read16 (fd, 0xBA) ;
-   MC = read16 (fd, 0xBC) ;
-   MD = read16 (fd, 0xBE) ;
+  if (readBlock (fd, 0xAA, cal, sizeof (cal)) < 0)
+  {
+    close (fd) ;
+    return FALSE ;
+  }
+
+  AC1 = CAL16 ( 0) ;
+  AC2 = CAL16 ( 1) ;
+  AC3 = CAL16 ( 2) ;
+  AC4 = CAL16 ( 3) ;
+  AC5 = CAL16 ( 4) ;
+  AC6 = CAL16 ( 5) ;
+  VB1 = CAL16 ( 6) ;
+  VB2 = CAL16 ( 7) ;
+   MB = CAL16 ( 8) ;
+   MC = CAL16 ( 9) ;
+   MD = CAL16 (10) ;
 
 // Calculate coefficients
 
@@ -233,5 +259,11 @@ int bmp180Setup (const int pinBase)
   p1 = 1.0 - 7357.0 * pow (2.0, -20.0) ;
   p2 = 3038.0 * 100.0 * pow (2.0,  -36.0) ;
 
+  node = wiringPiNewNode (pinBase, 4) ;
+
+  node->fd          = fd ;
+  node->analogRead  = myAnalogRead ;
+  node->analogWrite = myAnalogWrite ;
+
   return TRUE ;
 }
@@ -24,9 +24,13 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <string.h>
@@ -39,6 +43,40 @@
 #include "../wiringPiD/drcNetCmd.h"
 
 
+// One per connection. Under protocol 2 writes collect in out [] and go
+//	in one send when a read needs an answer, a node transaction commits,
+//	or out [] fills. node->data0 is the index into links [].
+//	Once a pin is subscribed to, edges can arrive at any time, so the
+//	socket is then read by linkReader, which passes replies on through
+//	reply/replied and queues edges in events []. linkDispatch runs the
+//	callbacks from there, so a callback using the node never stands in
+//	the way of the reply it waits for.
+
+#define	MAX_LINKS	16
+#define	MAX_EVENTS	256
+
+struct drcNetLink
+{
+  int fd ;
+  int version ;
+  int pinBase ;
+  int used ;
+  pthread_mutex_t lock ;
+  struct drcNetComStruct out [DRCN_BATCH_MAX] ;
+
+  int reader, dead, replied ;
+  pthread_mutex_t replyLock ;		// Also covers events []
+  pthread_cond_t  replyCond ;
+  struct drcNetComStruct reply ;
+
+  unsigned int evHead, evTail ;
+  pthread_cond_t  evCond ;
+  struct drcNetEventStruct events [MAX_EVENTS] ;
+} ;
+
+static struct drcNetLink *links [MAX_LINKS] ;
+
+
 /*
  * remoteReadline:
  *	Read in a line of data from the remote server, ending with a newline
@@ -74,17 +112,22 @@ static int remoteReadline (int fd, char *buf, int max)
  *********************************************************************************
  */
 
-static char *getChallenge (int fd)
+static char *getChallenge (int fd, int *version)
 {
   static char buf [1024] ;
   int num ;
 
+  *version = 1 ;
+
   for (;;)
   {
     if ((num = remoteReadline (fd, buf, 1023)) < 0)
       return NULL ;
     buf [num] = 0 ;
 
+    if (strncmp (buf, "200 Protocol ", 13) == 0)
+      *version = atoi (&buf [13]) ;
+
     if (strncmp (buf, "Challenge ", 10) == 0)
       return &buf [10] ;
   }
@@ -100,13 +143,13 @@ static char *getChallenge (int fd)
  *********************************************************************************
  */
 
-static int authenticate (int fd, const char *pass)
+static int authenticate (int fd, const char *pass, int *version)
 {
   char *challenge ;
   char *encrypted ;
   char salted [1024] ;
 
-  if ((challenge = getChallenge (fd)) == NULL)
+  if ((challenge = getChallenge (fd, version)) == NULL)
     return -1 ;
 
   snprintf (salted, 1024, "$6$%s$", challenge) ;
@@ -138,7 +181,7 @@ static int authenticate (int fd, const char *pass)
  *********************************************************************************
  */
 
-int _drcSetupNet (const char *ipAddress, const char *port, const char *password)
+static int drcSetupLink (const char *ipAddress, const char *port, const char *password, int *version)
 {
   struct addrinfo hints;
   struct addrinfo *result, *rp ;
@@ -183,7 +226,7 @@ int _drcSetupNet (const char *ipAddress, const char *port, const char *password)
     if (connect (remoteFd, rp->ai_addr, rp->ai_addrlen) < 0)
       continue ;
 
-    if (authenticate (remoteFd, password) < 0)
+    if (authenticate (remoteFd, password, version) < 0)
     {
       close (remoteFd) ;
       errno = EACCES ;		// Permission denied
@@ -198,174 +241,413 @@ int _drcSetupNet (const char *ipAddress, const char *port, const char *password)
 }
 
 
+int _drcSetupNet (const char *ipAddress, const char *port, const char *password)
+{
+  int version ;
+
+  return drcSetupLink (ipAddress, port, password, &version) ;
+}
+
+
 /*
- * myPinMode:
- *	Change the pin mode on the remote DRC device
+ * linkSend: linkRecv:
+ *	Whole buffers only, the stream is useless after a short transfer.
  *********************************************************************************
  */
 
-static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+static int linkSend (int fd, const void *buf, size_t len)
 {
-  struct drcNetComStruct cmd ;
+  const uint8_t *p = (const uint8_t *)buf ;
+  ssize_t n ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_PIN_MODE ;
-  cmd.data = mode ;
+  while (len > 0)
+  {
+    if ((n = send (fd, p, len, MSG_NOSIGNAL)) < 0)
+    {
+      if (errno == EINTR)
+	continue ;
+      return -1 ;
+    }
+    p   += n ;
+    len -= n ;
+  }
+  return 0 ;
+}
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+static int linkRecv (int fd, void *buf, size_t len)
+{
+  return (recv (fd, buf, len, MSG_WAITALL) == (ssize_t)len) ? 0 : -1 ;
 }
 
 
 /*
- * myPullUpDnControl:
+ * linkReadFrame:
+ *	Read a reply or an edge, which is two records long.
  *********************************************************************************
  */
 
-static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
+static int linkReadFrame (struct drcNetLink *link, struct drcNetEventStruct *msg)
 {
-  struct drcNetComStruct cmd ;
+  const size_t len = sizeof (struct drcNetComStruct) ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_PULL_UP_DN ;
-  cmd.data = mode ;
+  if (linkRecv (link->fd, msg, len) < 0)
+    return -1 ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  if (msg->cmd == DRCN_EVENT)
+    return linkRecv (link->fd, (uint8_t *)msg + len, sizeof (*msg) - len) ;
+
+  return 0 ;
 }
 
 
 /*
- * myDigitalWrite:
+ * linkReply:
+ *	Get the answer to the read just sent: from linkReader if it owns the
+ *	socket, else straight from the socket. Nothing is subscribed before
+ *	linkReader starts, so there are no edges to meet on the way.
  *********************************************************************************
  */
 
-static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static int linkReply (struct drcNetLink *link, struct drcNetComStruct *reply)
 {
-  struct drcNetComStruct cmd ;
+  struct drcNetEventStruct msg ;
+  int result = 0 ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_DIGITAL_WRITE ;
-  cmd.data = value ;
+  if (!link->reader)
+  {
+    do
+      if (linkReadFrame (link, &msg) < 0)
+	return -1 ;
+    while (msg.cmd == DRCN_EVENT) ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+    memcpy (reply, &msg, sizeof (*reply)) ;
+    return 0 ;
+  }
+
+  pthread_mutex_lock (&link->replyLock) ;
+  while (!link->replied && !link->dead)
+    pthread_cond_wait (&link->replyCond, &link->replyLock) ;
+
+  if (link->replied)
+    *reply = link->reply ;
+  else
+    result = -1 ;
+
+  link->replied = FALSE ;
+  pthread_mutex_unlock (&link->replyLock) ;
+
+  return result ;
 }
 
 
 /*
- * myDigitalWrite8:
+ * linkReader: linkDispatch:
+ *	linkReader only reads the socket: replies go to linkReply, edges to
+ *	the queue. linkDispatch hands the queued edges to the interrupt
+ *	engine, with no lock held. Edges beyond MAX_EVENTS are dropped.
  *********************************************************************************
+ */
 
-static void myDigitalWrite8 (struct wiringPiNodeStruct *node, int pin, int value)
+static void *linkReader (void *arg)
 {
-  struct drcNetComStruct cmd ;
+  struct drcNetLink *link = (struct drcNetLink *)arg ;
+  struct drcNetEventStruct msg ;
+
+  while (linkReadFrame (link, &msg) == 0)
+  {
+    pthread_mutex_lock (&link->replyLock) ;
+    if (msg.cmd != DRCN_EVENT)
+    {
+      memcpy (&link->reply, &msg, sizeof (link->reply)) ;
+      link->replied = TRUE ;
+      pthread_cond_signal (&link->replyCond) ;
+    }
+    else if (link->evHead - link->evTail < MAX_EVENTS)
+    {
+      link->events [link->evHead++ % MAX_EVENTS] = msg ;
+      pthread_cond_signal (&link->evCond) ;
+    }
+    pthread_mutex_unlock (&link->replyLock) ;
+  }
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_DIGITAL_WRITE8 ;
-  cmd.data = value ;
+  pthread_mutex_lock   (&link->replyLock) ;
+  link->dead = TRUE ;
+  pthread_cond_broadcast (&link->replyCond) ;
+  pthread_cond_broadcast (&link->evCond) ;
+  pthread_mutex_unlock (&link->replyLock) ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  return NULL ;
 }
+
+static void *linkDispatch (void *arg)
+{
+  struct drcNetLink *link = (struct drcNetLink *)arg ;
+  struct drcNetEventStruct msg ;
+  struct wiringPiEventStruct event ;
+
+  for (;;)
+  {
+    pthread_mutex_lock (&link->replyLock) ;
+    while ((link->evTail == link->evHead) && !link->dead)
+      pthread_cond_wait (&link->evCond, &link->replyLock) ;
+
+    if (link->evTail == link->evHead)	// Dead, and nothing left
+    {
+      pthread_mutex_unlock (&link->replyLock) ;
+      return NULL ;
+    }
+    msg = link->events [link->evTail++ % MAX_EVENTS] ;
+    pthread_mutex_unlock (&link->replyLock) ;
+
+    event.pin       = link->pinBase + msg.pin ;
+    event.edge      = msg.edge ;
+    event.seq       = msg.seq ;
+    event.timestamp = msg.timestamp ;
+
+    wiringPiNodeEvent (&event) ;
+  }
+}
+
+
+/*
+ * linkFlush:
+ *	Send all the queued commands in one go. Called with the link locked.
+ *********************************************************************************
  */
 
+static int linkFlush (struct drcNetLink *link)
+{
+  int used = link->used ;
+
+  if (used == 0)
+    return 0 ;
+
+  link->used = 0 ;
+  return linkSend (link->fd, link->out, used * sizeof (struct drcNetComStruct)) ;
+}
+
 
 /*
- * myAnalogWrite:
+ * linkCommand:
+ *	Run one command against the remote node. Protocol 2 writes are only
+ *	queued, and sent at once unless the node is inside a transaction.
+ *	Reads, and everything under protocol 1, wait for their answer.
+ *	Returns the data from the answer.
  *********************************************************************************
  */
 
-static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static int linkCommand (struct wiringPiNodeStruct *node, int pin, uint32_t command, int data, int isRead)
 {
-  struct drcNetComStruct cmd ;
+  struct drcNetLink *link = links [node->data0] ;
+  struct drcNetComStruct *cmd ;
+  int result = data ;
+
+  pthread_mutex_lock (&link->lock) ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_ANALOG_WRITE ;
-  cmd.data = value ;
+  if ((link->used == DRCN_BATCH_MAX) && (linkFlush (link) < 0))
+    goto out ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  cmd       = &link->out [link->used++] ;
+  cmd->pin  = pin - node->pinBase ;
+  cmd->cmd  = command ;
+  cmd->data = data ;
+
+  if (link->version >= 2)
+  {
+    if (!isRead)
+    {
+      if (!wiringPiNodeDefer (node))
+	(void)linkFlush (link) ;
+      goto out ;
+    }
+  }
+  else if (command == DRCN_PULL_UP_DN)	// Never answered by protocol 1 servers
+    isRead = FALSE ;
+  else
+    isRead = TRUE ;
+
+  if (linkFlush (link) < 0)
+    goto out ;
+
+  if (isRead)
+  {
+    struct drcNetComStruct reply ;
+
+    if (linkReply (link, &reply) == 0)
+      result = reply.data ;
+  }
+
+out:
+  pthread_mutex_unlock (&link->lock) ;
+  return result ;
 }
 
 
 /*
- * myPwmWrite:
+ * myWatch:
+ *	Have the server send us the edges of pin, see wiringPiISR. linkReader
+ *	takes over the socket the first time, with linkDispatch beside it.
  *********************************************************************************
  */
 
-static void myPwmWrite (struct wiringPiNodeStruct *node, int pin, int value)
+static int myWatch (struct wiringPiNodeStruct *node, int pin, int mode)
 {
-  struct drcNetComStruct cmd ;
+  struct drcNetLink *link = links [node->data0] ;
+  pthread_t reader, dispatch ;
+  int started = TRUE ;
+
+  if (link->version < 2)
+    return -1 ;
+
+  pthread_mutex_lock (&link->lock) ;
+  if (!link->reader)
+  {
+    link->dead = FALSE ;
+    if (pthread_create (&dispatch, NULL, linkDispatch, link) != 0)
+      started = FALSE ;
+    else if (pthread_create (&reader, NULL, linkReader, link) != 0)
+    {
+      pthread_mutex_lock   (&link->replyLock) ;	// Let linkDispatch go
+      link->dead = TRUE ;
+      pthread_cond_broadcast (&link->evCond) ;
+      pthread_mutex_unlock (&link->replyLock) ;
+      pthread_detach (dispatch) ;
+      started = FALSE ;
+    }
+    else
+    {
+      pthread_detach (dispatch) ;
+      pthread_detach (reader) ;
+      link->reader = TRUE ;
+    }
+  }
+  pthread_mutex_unlock (&link->lock) ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_PWM_WRITE ;
-  cmd.data = value ;
+  if (!started)
+    return -1 ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+  return (linkCommand (node, pin, DRCN_SUBSCRIBE, mode, TRUE) == 0) ? 0 : -1 ;
 }
 
 
 /*
- * myAnalogRead:
+ * myFlush:
+ *	Commit hook, see wiringPiNodeBegin.
  *********************************************************************************
  */
 
-static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+static int myFlush (struct wiringPiNodeStruct *node)
 {
-  struct drcNetComStruct cmd ;
+  struct drcNetLink *link = links [node->data0] ;
+  int result ;
+
+  pthread_mutex_lock   (&link->lock) ;
+  result = linkFlush (link) ;
+  pthread_mutex_unlock (&link->lock) ;
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_ANALOG_READ ;
-  cmd.data = 0 ;
+  return result ;
+}
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
 
-  return cmd.data ;
+/*
+ * myPinMode:
+ *	Change the pin mode on the remote DRC device
+ *********************************************************************************
+ */
+
+static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
+{
+  (void)linkCommand (node, pin, DRCN_PIN_MODE, mode, FALSE) ;
 }
 
 
 /*
- * myDigitalRead:
+ * myPullUpDnControl:
  *********************************************************************************
  */
 
-static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+static void myPullUpDnControl (struct wiringPiNodeStruct *node, int pin, int mode)
 {
-  struct drcNetComStruct cmd ;
+  (void)linkCommand (node, pin, DRCN_PULL_UP_DN, mode, FALSE) ;
+}
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_DIGITAL_READ ;
-  cmd.data = 0 ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+/*
+ * myDigitalWrite:
+ *********************************************************************************
+ */
 
-  return cmd.data ;
+static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  (void)linkCommand (node, pin, DRCN_DIGITAL_WRITE, value, FALSE) ;
 }
 
 
 /*
- * myDigitalRead8:
+ * myDigitalWrite8:
  *********************************************************************************
+ */
 
-static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+static void myDigitalWrite8 (struct wiringPiNodeStruct *node, int pin, int value)
 {
-  struct drcNetComStruct cmd ;
+  (void)linkCommand (node, pin, DRCN_DIGITAL_WRITE8, value, FALSE) ;
+}
+
+
+/*
+ * myAnalogWrite:
+ *********************************************************************************
+ */
+
+static void myAnalogWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  (void)linkCommand (node, pin, DRCN_ANALOG_WRITE, value, FALSE) ;
+}
 
-  cmd.pin  = pin - node->pinBase ;
-  cmd.cmd  = DRCN_DIGITAL_READ8 ;
-  cmd.data = 0 ;
 
-  (void)send (node->fd, &cmd, sizeof (cmd), 0) ;
-  (void)recv (node->fd, &cmd, sizeof (cmd), 0) ;
+/*
+ * myPwmWrite:
+ *********************************************************************************
+ */
 
-  return cmd.data ;
+static void myPwmWrite (struct wiringPiNodeStruct *node, int pin, int value)
+{
+  (void)linkCommand (node, pin, DRCN_PWM_WRITE, value, FALSE) ;
+}
+
+
+/*
+ * myAnalogRead:
+ *********************************************************************************
+ */
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  return linkCommand (node, pin, DRCN_ANALOG_READ, 0, TRUE) ;
+}
+
+
+/*
+ * myDigitalRead:
+ *********************************************************************************
+ */
+
+static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
+{
+  return linkCommand (node, pin, DRCN_DIGITAL_READ, 0, TRUE) ;
 }
+
+
+/*
+ * myDigitalRead8:
+ *********************************************************************************
  */
 
+static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
+{
+  return linkCommand (node, pin, DRCN_DIGITAL_READ8, 0, TRUE) ;
+}
+
 
 /*
  * drcNet:
@@ -376,30 +658,74 @@ static unsigned int myDigitalRead8 (struct wiringPiNodeStruct *node, int pin)
 
 int drcSetupNet (const int pinBase, const int numPins, const char *ipAddress, const char *port, const char *password)
 {
-  int fd, len ;
+  int fd, len, version, slot ;
   struct wiringPiNodeStruct *node ;
+  struct drcNetLink *link ;
+  struct drcNetComStruct cmd ;
+
+  for (slot = 0 ; slot < MAX_LINKS ; ++slot)
+    if (links [slot] == NULL)
+      break ;
 
-  if ((fd = _drcSetupNet (ipAddress, port, password)) < 0)
+  if (slot == MAX_LINKS)
+    return FALSE ;
+
+  if ((fd = drcSetupLink (ipAddress, port, password, &version)) < 0)
     return FALSE ;
 
   len = sizeof (struct drcNetComStruct) ;
 
   if (setsockopt (fd, SOL_SOCKET, SO_RCVLOWAT, (void *)&len, sizeof (len)) < 0)
-    return FALSE ;
+    goto fail ;
+
+// Ask for protocol 2 if the server offered it. Small packets must then
+//	leave at once, the batching is ours.
+
+  if (version >= 2)
+  {
+    cmd.pin  = 0 ;
+    cmd.cmd  = DRCN_PROTOCOL ;
+    cmd.data = DRCN_VERSION ;
+
+    if ((linkSend (fd, &cmd, sizeof (cmd)) < 0) || (linkRecv (fd, &cmd, sizeof (cmd)) < 0))
+      goto fail ;
+
+    version = cmd.data ;
+    len     = 1 ;
+    (void)setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, (void *)&len, sizeof (len)) ;
+  }
+
+  if ((link = calloc (1, sizeof (*link))) == NULL)
+    goto fail ;
+
+  link->fd      = fd ;
+  link->version = version ;
+  link->pinBase = pinBase ;
+  pthread_mutex_init (&link->lock,      NULL) ;
+  pthread_mutex_init (&link->replyLock, NULL) ;
+  pthread_cond_init  (&link->replyCond, NULL) ;
+  pthread_cond_init  (&link->evCond,    NULL) ;
+  links [slot] = link ;
 
   node = wiringPiNewNode (pinBase, numPins) ;
 
   node->fd               = fd ;
+  node->data0            = slot ;
   node->pinMode          = myPinMode ;
   node->pullUpDnControl  = myPullUpDnControl ;
   node->analogRead       = myAnalogRead ;
-  node->analogRead       = myAnalogRead ;
   node->analogWrite      = myAnalogWrite ;
   node->digitalRead      = myDigitalRead ;
   node->digitalWrite     = myDigitalWrite ;
-//node->digitalRead8     = myDigitalRead8 ;
-//node->digitalWrite8    = myDigitalWrite8 ;
+  node->digitalRead8     = myDigitalRead8 ;
+  node->digitalWrite8    = myDigitalWrite8 ;
   node->pwmWrite         = myPwmWrite ;
+  node->flush            = myFlush ;
+  node->watch            = myWatch ;
 
   return TRUE ;
+
+fail:
+  close (fd) ;
+  return FALSE ;
 }
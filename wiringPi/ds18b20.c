@@ -30,9 +30,13 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <malloc.h>
+#include <limits.h>
 #include <ctype.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "wiringPi.h"
 
@@ -41,22 +45,60 @@
 #define	W1_PREFIX	"/sys/bus/w1/devices/28-"
 #define	W1_POSTFIX	"/w1_slave"
 
+#define	DS18B20_MAX		32
+#define	DS18B20_MAX_MASTERS	8
+#define	DS18B20_PERIOD_MS	1000
+#define	DS18B20_POLL_MS		10
+
 
 /*
- * myAnalogRead:
+ * Acquisition:
+ *	Sensors are read by a background thread into a cache, so analogRead
+ *	doesn't sit through the 750mS conversion. Where the bus master has
+ *	therm_bulk_read (Linux 5.10+) every sensor on it is started at once,
+ *	and the reads that follow just fetch the result. Otherwise each read
+ *	converts in turn, off the caller's thread at least.
  *********************************************************************************
  */
 
-static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+struct w1Master
 {
-  int  chan = pin - node->pinBase ;
-  int  fd = node->fd ;
-  char buffer [4096] ;
-  char *p ;
-  int  temp, sign ;
+  char path [PATH_MAX] ;
+  int  fd ;			// therm_bulk_read
+} ;
 
-  if (chan != 0)
-    return -9999 ;
+struct ds18b20
+{
+  char     dir [PATH_MAX] ;	// /sys/bus/w1/devices/28-...
+  int      fd ;			// w1_slave, kept open
+  int      master ;		// index into masters, -1 without bulk read
+  int      bits ;		// resolution, 9 to 12
+  int      temp ;		// *10, or an error code
+  uint64_t when ;		// nanos64 of the last reading, 0 for none
+} ;
+
+static struct w1Master masters [DS18B20_MAX_MASTERS] ;
+static struct ds18b20  sensors [DS18B20_MAX] ;
+static int numMasters, numSensors ;
+static int periodMs = DS18B20_PERIOD_MS ;
+static int threadStarted ;
+static int newSensor ;		// wakes the thread early, for a first reading
+
+static pthread_mutex_t ds18b20Lock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  ds18b20Cond = PTHREAD_COND_INITIALIZER ;
+
+
+/*
+ * readSensor:
+ *	Read the w1_slave file of a sensor and return the temperature * 10
+ *********************************************************************************
+ */
+
+static int readSensor (int fd)
+{
+  char buffer [256] ;
+  char *p ;
+  int  len, temp, sign ;
 
 // Rewind the file - we're keeping it open to keep things going
 //	smoothly
@@ -66,8 +108,9 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 // Read the file - we know it's only a couple of lines, so this ought to be
 //	more than enough
 
-  if (read (fd, buffer, 4096) <= 0)	// Read nothing, or it failed in some odd way
+  if ((len = read (fd, buffer, sizeof (buffer) - 1)) <= 0)	// Read nothing, or it failed in some odd way
     return -9998 ;
+  buffer [len] = 0 ;
 
 // Look for YES, then t=
 
@@ -109,38 +152,312 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 
 
 /*
- * ds18b20Setup:
- *	Create a new instance of a DS18B20 temperature sensor.
+ * bulkBusy:
+ *	therm_bulk_read reads -1 while any sensor on the bus is converting
  *********************************************************************************
  */
 
-int ds18b20Setup (const int pinBase, const char *deviceId)
+static int bulkBusy (int fd)
+{
+  char buffer [16] ;
+  int  len ;
+
+  lseek (fd, 0, SEEK_SET) ;
+  if ((len = read (fd, buffer, sizeof (buffer) - 1)) <= 0)
+    return FALSE ;
+  buffer [len] = 0 ;
+
+  return atoi (buffer) == -1 ;
+}
+
+
+/*
+ * acquireThread:
+ *	Start every bus converting, wait for the slowest resolution in use,
+ *	then read each sensor into the cache. Once a period.
+ *********************************************************************************
+ */
+
+static void *acquireThread (void *arg)
+{
+  struct timespec until ;
+  int i, count, buses, bits, temp, wait ;
+
+  (void)arg ;
+
+  for (;;)
+  {
+    clock_gettime (CLOCK_REALTIME, &until) ;
+    until.tv_sec  += periodMs / 1000 ;
+    until.tv_nsec += (periodMs % 1000) * 1000000L ;
+    if (until.tv_nsec >= 1000000000L)
+    {
+      until.tv_sec  += 1 ;
+      until.tv_nsec -= 1000000000L ;
+    }
+
+    pthread_mutex_lock (&ds18b20Lock) ;
+      newSensor = FALSE ;
+      count = numSensors ;
+      buses = numMasters ;
+      bits  = 9 ;
+      for (i = 0 ; i < count ; ++i)
+	if (sensors [i].bits > bits)
+	  bits = sensors [i].bits ;
+    pthread_mutex_unlock (&ds18b20Lock) ;
+
+    if (buses > 0)
+    {
+      for (i = 0 ; i < buses ; ++i)
+	pwrite (masters [i].fd, "trigger\n", 8, 0) ;
+
+// 750mS at 12 bits, halving with each bit less
+
+      delay (750 >> (12 - bits)) ;
+
+      for (i = 0 ; i < buses ; ++i)
+	for (wait = 0 ; (wait < 750) && bulkBusy (masters [i].fd) ; wait += DS18B20_POLL_MS)
+	  delay (DS18B20_POLL_MS) ;
+    }
+
+    for (i = 0 ; i < count ; ++i)
+    {
+      temp = readSensor (sensors [i].fd) ;
+
+      pthread_mutex_lock (&ds18b20Lock) ;
+	sensors [i].temp = temp ;
+	sensors [i].when = nanos64 () ;
+	pthread_cond_broadcast (&ds18b20Cond) ;
+      pthread_mutex_unlock (&ds18b20Lock) ;
+    }
+
+    pthread_mutex_lock (&ds18b20Lock) ;
+      while (!newSensor)
+	if (pthread_cond_timedwait (&ds18b20Cond, &ds18b20Lock, &until) != 0)
+	  break ;
+    pthread_mutex_unlock (&ds18b20Lock) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * findMaster:
+ *	The sensor's directory is a link into its bus master's; use the
+ *	master's therm_bulk_read if it has one. Returns -1 if not.
+ *********************************************************************************
+ */
+
+static int findMaster (const char *dir)
+{
+  char path [PATH_MAX], *slash ;
+  int  i, fd ;
+
+  if (realpath (dir, path) == NULL)
+    return -1 ;
+
+  if ((slash = strrchr (path, '/')) == NULL)
+    return -1 ;
+  *slash = 0 ;
+
+  if (strlen (path) + sizeof ("/therm_bulk_read") > sizeof (path))
+    return -1 ;
+  strcat (path, "/therm_bulk_read") ;
+
+  for (i = 0 ; i < numMasters ; ++i)
+    if (strcmp (masters [i].path, path) == 0)
+      return i ;
+
+  if (numMasters == DS18B20_MAX_MASTERS)
+    return -1 ;
+
+  if ((fd = open (path, O_RDWR)) < 0)
+    return -1 ;
+
+  strcpy (masters [numMasters].path, path) ;
+  masters [numMasters].fd = fd ;
+
+  return numMasters++ ;
+}
+
+
+/*
+ * myAnalogRead:
+ *	The cached reading. Only the first read after setup has to wait.
+ *********************************************************************************
+ */
+
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct ds18b20 *sensor = &sensors [node->data0] ;
+  int  chan = pin - node->pinBase ;
+  int  temp ;
+
+  if (chan != 0)
+    return -9999 ;
+
+  pthread_mutex_lock (&ds18b20Lock) ;
+    while (sensor->when == 0)
+      pthread_cond_wait (&ds18b20Cond, &ds18b20Lock) ;
+    temp = sensor->temp ;
+  pthread_mutex_unlock (&ds18b20Lock) ;
+
+  return temp ;
+}
+
+
+/*
+ * ds18b20Cached:
+ *	The last reading of the sensor at pinBase and when it was taken
+ *	(nanos64 time), without waiting. FALSE if there isn't one yet.
+ *********************************************************************************
+ */
+
+int ds18b20Cached (const int pinBase, int *temp, uint64_t *when)
 {
-  int fd ;
   struct wiringPiNodeStruct *node ;
-  char *fileName ;
+  struct ds18b20 *sensor ;
+
+  if (((node = wiringPiFindNode (pinBase)) == NULL) || (node->analogRead != myAnalogRead))
+    return FALSE ;
+
+  sensor = &sensors [node->data0] ;
+
+  pthread_mutex_lock (&ds18b20Lock) ;
+    *temp = sensor->temp ;
+    *when = sensor->when ;
+  pthread_mutex_unlock (&ds18b20Lock) ;
+
+  return *when != 0 ;
+}
 
-// Allocate space for the filename
 
-  if ((fileName = malloc (strlen (W1_PREFIX) + strlen (W1_POSTFIX) + strlen (deviceId) + 1)) == NULL)
+/*
+ * ds18b20Resolution:
+ *	Set the resolution of the sensor at pinBase: 9 bits (0.5C, 94mS) to
+ *	12 bits (0.0625C, 750mS).
+ *********************************************************************************
+ */
+
+int ds18b20Resolution (const int pinBase, const int bits)
+{
+  struct wiringPiNodeStruct *node ;
+  struct ds18b20 *sensor ;
+  char path [PATH_MAX + 16], value [4] ;
+  int  fd, len, ok ;
+
+  if ((bits < 9) || (bits > 12))
+    return FALSE ;
+
+  if (((node = wiringPiFindNode (pinBase)) == NULL) || (node->analogRead != myAnalogRead))
+    return FALSE ;
+
+  sensor = &sensors [node->data0] ;
+  len    = sprintf (value, "%d\n", bits) ;
+
+// Newer kernels have a resolution file, older ones take it through w1_slave
+
+  sprintf (path, "%s/resolution", sensor->dir) ;
+  if ((fd = open (path, O_WRONLY)) >= 0)
+  {
+    ok = write (fd, value, len) == len ;
+    close (fd) ;
+  }
+  else
+    ok = pwrite (sensor->fd, value, len, 0) == len ;
+
+  if (!ok)
     return FALSE ;
 
-  sprintf (fileName, "%s%s%s", W1_PREFIX, deviceId, W1_POSTFIX) ;
+  pthread_mutex_lock (&ds18b20Lock) ;
+    sensor->bits = bits ;
+  pthread_mutex_unlock (&ds18b20Lock) ;
 
-  fd = open (fileName, O_RDONLY) ;
+  return TRUE ;
+}
 
-  free (fileName) ;
 
-  if (fd < 0)
+/*
+ * ds18b20Period:
+ *	How often the sensors are read, in mS. Reading faster than they
+ *	convert just means reading back to back.
+ *********************************************************************************
+ */
+
+void ds18b20Period (const int mS)
+{
+  periodMs = mS ;
+}
+
+
+/*
+ * ds18b20Setup:
+ *	Create a new instance of a DS18B20 temperature sensor.
+ *********************************************************************************
+ */
+
+int ds18b20Setup (const int pinBase, const char *deviceId)
+{
+  int fd, rfd, bits ;
+  struct wiringPiNodeStruct *node ;
+  struct ds18b20 *sensor ;
+  pthread_t thread ;
+  char path [PATH_MAX + 16], value [8] ;
+
+  if (numSensors == DS18B20_MAX)
     return FALSE ;
 
+  if ((strlen (W1_PREFIX) + strlen (deviceId) + strlen (W1_POSTFIX)) >= PATH_MAX)
+    return FALSE ;
+
+  sensor = &sensors [numSensors] ;
+  sprintf (sensor->dir, "%s%s", W1_PREFIX, deviceId) ;
+  sprintf (path, "%s%s", sensor->dir, W1_POSTFIX) ;
+
 // We'll keep the file open, to make access a little faster
 //	although it's very slow reading these things anyway )-:
 
-  node = wiringPiNewNode (pinBase, 1) ;
+  if ((fd = open (path, O_RDWR)) < 0)
+    if ((fd = open (path, O_RDONLY)) < 0)
+      return FALSE ;
 
-  node->fd         = fd ;
-  node->analogRead = myAnalogRead ;
+// Start at whatever resolution the sensor is set to, 12 bits if we can't tell
 
-  return TRUE ;
+  bits = 12 ;
+  sprintf (path, "%s/resolution", sensor->dir) ;
+  if ((rfd = open (path, O_RDONLY)) >= 0)
+  {
+    memset (value, 0, sizeof (value)) ;
+    if (read (rfd, value, sizeof (value) - 1) > 0)
+      bits = atoi (value) ;
+    close (rfd) ;
+    if ((bits < 9) || (bits > 12))
+      bits = 12 ;
+  }
+
+  pthread_mutex_lock (&ds18b20Lock) ;
+    sensor->fd     = fd ;
+    sensor->master = findMaster (sensor->dir) ;
+    sensor->bits   = bits ;
+    sensor->temp   = -9997 ;
+    sensor->when   = 0 ;
+
+    node = wiringPiNewNode (pinBase, 1) ;
+
+    node->fd         = fd ;
+    node->data0      = numSensors++ ;
+    node->analogRead = myAnalogRead ;
+
+    newSensor = TRUE ;
+    pthread_cond_broadcast (&ds18b20Cond) ;
+
+    if (!threadStarted && (pthread_create (&thread, NULL, acquireThread, NULL) == 0))
+    {
+      pthread_detach (thread) ;
+      threadStarted = TRUE ;
+    }
+  pthread_mutex_unlock (&ds18b20Lock) ;
+
+  return threadStarted ;
 }
@@ -23,11 +23,16 @@
  ***********************************************************************
  */
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern int ds18b20Setup (const int pinBase, const char *serialNum) ;
+extern int  ds18b20Setup      (const int pinBase, const char *serialNum) ;
+extern int  ds18b20Resolution (const int pinBase, const int bits) ;
+extern void ds18b20Period     (const int mS) ;
+extern int  ds18b20Cached     (const int pinBase, int *temp, uint64_t *when) ;
 
 #ifdef __cplusplus
 }
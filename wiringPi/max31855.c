@@ -30,15 +30,15 @@
 
 #include "max31855.h"
 
-static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+/*
+ * decode:
+ *	Turn one 32-bit reading into the value of a channel
+ *********************************************************************************
+ */
+
+static int decode (uint32_t spiData, int chan)
 {
-  uint32_t spiData ;
   int temp ;
-  int chan = pin - node->pinBase ;
-
-  wiringPiSPIDataRW (node->fd, (unsigned char *)&spiData, 4) ;
-
-  spiData = __bswap_32(spiData) ;
 
   switch (chan)
   {
@@ -75,6 +75,39 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
   }
 }
 
+static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
+{
+  uint32_t spiData ;
+
+  wiringPiSPIDataRW (node->fd, (unsigned char *)&spiData, 4) ;
+
+  return decode (__bswap_32 (spiData), pin - node->pinBase) ;
+}
+
+
+/*
+ * max31855ReadAll:
+ *	All four channels come from the same 32-bit reading, so a scan is a
+ *	single transfer.
+ *********************************************************************************
+ */
+
+int max31855ReadAll (int spiChannel, int *values)
+{
+  uint32_t spiData ;
+  int chan ;
+
+  if (wiringPiSPIDataRW (spiChannel, (unsigned char *)&spiData, 4) < 0)
+    return -1 ;
+
+  spiData = __bswap_32 (spiData) ;
+
+  for (chan = 0 ; chan < 4 ; ++chan)
+    values [chan] = decode (spiData, chan) ;
+
+  return 4 ;
+}
+
 
 /*
  * max31855Setup:
@@ -26,7 +26,8 @@
 extern "C" {
 #endif
 
-extern int max31855Setup (int pinBase, int spiChannel) ;
+extern int max31855Setup   (int pinBase, int spiChannel) ;
+extern int max31855ReadAll (int spiChannel, int *values) ;
 
 #ifdef __cplusplus
 }
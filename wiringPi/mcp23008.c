@@ -51,6 +51,16 @@ static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
     old |=   mask ;
 
   wiringPiI2CWriteReg8 (node->fd, reg, old) ;
+
+// Keep the direction shadow, and interrupts on inputs only
+
+  node->outputs = ~old & 0xFF ;
+  if (node->intPin >= 0)
+    wiringPiI2CWriteReg8 (node->fd, MCP23x08_GPINTEN, old) ;
+
+// An input that was an output has no sample in the snapshot yet
+
+  __atomic_store_n (&node->snapValid, FALSE, __ATOMIC_RELEASE) ;
 }
 
 
@@ -94,8 +104,9 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
   else
     old |=   bit ;
 
-  wiringPiI2CWriteReg8 (node->fd, MCP23x08_GPIO, old) ;
   node->data2 = old ;
+  if (!wiringPiNodeDefer (node))
+    wiringPiI2CWriteReg8 (node->fd, MCP23x08_GPIO, old) ;
 }
 
 
@@ -107,9 +118,16 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 {
   int mask, value ;
+  unsigned int snap ;
 
   mask  = 1 << ((pin - node->pinBase) & 7) ;
-  value = wiringPiI2CReadReg8 (node->fd, MCP23x08_GPIO) ;
+
+// Outputs raise no INT, so in the snapshot they come from the latch
+
+  if (wiringPiNodeSnapshot (node, &snap) == 0)
+    value = (snap & ~node->outputs) | (node->data2 & node->outputs) ;
+  else
+    value = wiringPiI2CReadReg8 (node->fd, MCP23x08_GPIO) ;
 
   if ((value & mask) == 0)
     return LOW ;
@@ -118,6 +136,37 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myFlush: myRefresh: mySetupInt:
+ *	Cache hooks, see wiringPiNodeBegin.
+ *********************************************************************************
+ */
+
+static int myFlush (struct wiringPiNodeStruct *node)
+{
+  return wiringPiI2CWriteReg8 (node->fd, MCP23x08_GPIO, node->data2) ;
+}
+
+static int myRefresh (struct wiringPiNodeStruct *node)
+{
+  int value ;
+
+  if ((value = wiringPiI2CReadReg8 (node->fd, MCP23x08_GPIO)) < 0)
+    return -1 ;
+
+  node->snapshot = value ;
+  return 0 ;
+}
+
+static int mySetupInt (struct wiringPiNodeStruct *node)
+{
+  if (wiringPiI2CWriteReg8 (node->fd, MCP23x08_INTCON, 0x00) < 0)
+    return -1 ;
+
+  return wiringPiI2CWriteReg8 (node->fd, MCP23x08_GPINTEN, ~node->outputs & 0xFF) ;
+}
+
+
 /*
  * mcp23008Setup:
  *	Create a new instance of an MCP23008 I2C GPIO interface. We know it
@@ -143,7 +192,11 @@ int mcp23008Setup (const int pinBase, const int i2cAddress)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
+  node->flush           = myFlush ;
+  node->refresh         = myRefresh ;
+  node->setupInt        = mySetupInt ;
   node->data2           = wiringPiI2CReadReg8 (fd, MCP23x08_OLAT) ;
+  node->outputs         = ~wiringPiI2CReadReg8 (fd, MCP23x08_IODIR) & 0xFF ;
 
   return TRUE ;
 }
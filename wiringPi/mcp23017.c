@@ -60,6 +60,20 @@ static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
     old |=   mask ;
 
   wiringPiI2CWriteReg8 (node->fd, reg, old) ;
+
+// Keep the direction shadow, and interrupts on inputs only
+
+  if (reg == MCP23x17_IODIRA)
+    node->outputs = (node->outputs & 0xFF00) | (~old & 0xFF) ;
+  else
+    node->outputs = (node->outputs & 0x00FF) | ((~old & 0xFF) << 8) ;
+
+  if (node->intPin >= 0)
+    wiringPiI2CWriteReg8 (node->fd, reg + (MCP23x17_GPINTENA - MCP23x17_IODIRA), old) ;
+
+// An input that was an output has no sample in the snapshot yet
+
+  __atomic_store_n (&node->snapValid, FALSE, __ATOMIC_RELEASE) ;
 }
 
 
@@ -116,8 +130,9 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
     else
       old |=   bit ;
 
-    wiringPiI2CWriteReg8 (node->fd, MCP23x17_GPIOA, old) ;
     node->data2 = old ;
+    if (!wiringPiNodeDefer (node))
+      wiringPiI2CWriteReg8 (node->fd, MCP23x17_GPIOA, old) ;
   }
   else				// Bank B
   {
@@ -128,8 +143,9 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
     else
       old |=   bit ;
 
-    wiringPiI2CWriteReg8 (node->fd, MCP23x17_GPIOB, old) ;
     node->data3 = old ;
+    if (!wiringPiNodeDefer (node))
+      wiringPiI2CWriteReg8 (node->fd, MCP23x17_GPIOB, old) ;
   }
 }
 
@@ -142,6 +158,7 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 {
   int mask, value, gpio ;
+  unsigned int snap ;
 
   pin -= node->pinBase ;
 
@@ -154,7 +171,16 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
   }
 
   mask  = 1 << pin ;
-  value = wiringPiI2CReadReg8 (node->fd, gpio) ;
+
+// Outputs raise no INT, so in the snapshot they come from the latches
+
+  if (wiringPiNodeSnapshot (node, &snap) == 0)
+  {
+    snap  = (snap & ~node->outputs) | (((node->data3 << 8) | node->data2) & node->outputs) ;
+    value = (gpio == MCP23x17_GPIOA) ? (snap & 0xFF) : (snap >> 8) ;
+  }
+  else
+    value = wiringPiI2CReadReg8 (node->fd, gpio) ;
 
   if ((value & mask) == 0)
     return LOW ;
@@ -163,6 +189,72 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myFlush: myRefresh: mySetupInt:
+ *	Cache hooks, see wiringPiNodeBegin. Both ports go in one transaction.
+ *********************************************************************************
+ */
+
+static int myFlush (struct wiringPiNodeStruct *node)
+{
+  struct wiringPiI2CBatch batch ;
+
+  wiringPiI2CBatchInit      (&batch, node->fd) ;
+  wiringPiI2CBatchWriteReg8 (&batch, -1, MCP23x17_GPIOA, node->data2) ;
+  wiringPiI2CBatchWriteReg8 (&batch, -1, MCP23x17_GPIOB, node->data3) ;
+
+  return wiringPiI2CBatchRun (&batch) ;
+}
+
+static int myRefresh (struct wiringPiNodeStruct *node)
+{
+  struct wiringPiI2CBatch batch ;
+  uint8_t gpio [2] ;
+
+  wiringPiI2CBatchInit (&batch, node->fd) ;
+  mcp23017QueueRead    (&batch, -1, gpio) ;
+
+  if (wiringPiI2CBatchRun (&batch) < 0)
+    return -1 ;
+
+  node->snapshot = (gpio [1] << 8) | gpio [0] ;
+  return 0 ;
+}
+
+static int mySetupInt (struct wiringPiNodeStruct *node)
+{
+  struct wiringPiI2CBatch batch ;
+
+// Interrupt on any input change, either port drives both INT pins
+
+  wiringPiI2CBatchInit      (&batch, node->fd) ;
+  wiringPiI2CBatchWriteReg8 (&batch, -1, MCP23x17_IOCON,    IOCON_INIT | IOCON_MIRROR) ;
+  wiringPiI2CBatchWriteReg8 (&batch, -1, MCP23x17_INTCONA,  0x00) ;
+  wiringPiI2CBatchWriteReg8 (&batch, -1, MCP23x17_INTCONB,  0x00) ;
+  wiringPiI2CBatchWriteReg8 (&batch, -1, MCP23x17_GPINTENA, ~node->outputs & 0xFF) ;
+  wiringPiI2CBatchWriteReg8 (&batch, -1, MCP23x17_GPINTENB, (~node->outputs >> 8) & 0xFF) ;
+
+  return wiringPiI2CBatchRun (&batch) ;
+}
+
+
+/*
+ * mcp23017QueueRead:
+ *	Add reads of GPIOA and GPIOB of the expander at i2cAddress to a batch,
+ *	so that the inputs of several expanders on one bus come back from a
+ *	single wiringPiI2CBatchRun. gpio [0] gets port A, gpio [1] port B.
+ *********************************************************************************
+ */
+
+int mcp23017QueueRead (struct wiringPiI2CBatch *batch, int i2cAddress, uint8_t *gpio)
+{
+  if (wiringPiI2CBatchReadReg (batch, i2cAddress, MCP23x17_GPIOA, &gpio [0], 1) < 0)
+    return -1 ;
+
+  return wiringPiI2CBatchReadReg (batch, i2cAddress, MCP23x17_GPIOB, &gpio [1], 1) ;
+}
+
+
 /*
  * mcp23017Setup:
  *	Create a new instance of an MCP23017 I2C GPIO interface. We know it
@@ -175,11 +267,23 @@ int mcp23017Setup (const int pinBase, const int i2cAddress)
 {
   int fd ;
   struct wiringPiNodeStruct *node ;
+  struct wiringPiI2CBatch batch ;
+  uint8_t olat [2], iodir [2] ;
 
   if ((fd = wiringPiI2CSetup (i2cAddress)) < 0)
     return FALSE ;
 
-  wiringPiI2CWriteReg8 (fd, MCP23x17_IOCON, IOCON_INIT) ;
+// Configure and fetch both output latches and directions in one transaction
+
+  wiringPiI2CBatchInit      (&batch, fd) ;
+  wiringPiI2CBatchWriteReg8 (&batch, -1, MCP23x17_IOCON, IOCON_INIT) ;
+  wiringPiI2CBatchReadReg   (&batch, -1, MCP23x17_OLATA,  &olat  [0], 1) ;
+  wiringPiI2CBatchReadReg   (&batch, -1, MCP23x17_OLATB,  &olat  [1], 1) ;
+  wiringPiI2CBatchReadReg   (&batch, -1, MCP23x17_IODIRA, &iodir [0], 1) ;
+  wiringPiI2CBatchReadReg   (&batch, -1, MCP23x17_IODIRB, &iodir [1], 1) ;
+
+  if (wiringPiI2CBatchRun (&batch) < 0)
+    return FALSE ;
 
   node = wiringPiNewNode (pinBase, 16) ;
 
@@ -188,8 +292,12 @@ int mcp23017Setup (const int pinBase, const int i2cAddress)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
-  node->data2           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATA) ;
-  node->data3           = wiringPiI2CReadReg8 (fd, MCP23x17_OLATB) ;
+  node->flush           = myFlush ;
+  node->refresh         = myRefresh ;
+  node->setupInt        = mySetupInt ;
+  node->data2           = olat [0] ;
+  node->data3           = olat [1] ;
+  node->outputs         = ~((iodir [1] << 8) | iodir [0]) & 0xFFFF ;
 
   return TRUE ;
 }
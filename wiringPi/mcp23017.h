@@ -22,11 +22,16 @@
  ***********************************************************************
  */
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-extern int mcp23017Setup (const int pinBase, const int i2cAddress) ;
+struct wiringPiI2CBatch ;
+
+extern int mcp23017Setup     (const int pinBase, const int i2cAddress) ;
+extern int mcp23017QueueRead (struct wiringPiI2CBatch *batch, int i2cAddress, uint8_t *gpio) ;
 
 #ifdef __cplusplus
 }
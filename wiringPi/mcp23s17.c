@@ -71,6 +71,93 @@ static uint8_t readByte (uint8_t spiPort, uint8_t devId, uint8_t reg)
 }
 
 
+/*
+ * mcp23s17ReadAll:
+ *	Read both ports in one SPI message (sequential mode is off, so this
+ *	is two commands). Returns GPIOB << 8 | GPIOA, or -1.
+ *********************************************************************************
+ */
+
+int mcp23s17ReadAll (int spiPort, int devId)
+{
+  struct wiringPiSPIBatch batch ;
+  uint8_t tx [2][3], rx [2][3] ;
+
+  tx [0][0] = tx [1][0] = CMD_READ | ((devId & 7) << 1) ;
+  tx [0][1] = MCP23x17_GPIOA ;
+  tx [1][1] = MCP23x17_GPIOB ;
+  tx [0][2] = tx [1][2] = 0 ;
+
+  wiringPiSPIBatchInit (&batch, spiPort) ;
+  wiringPiSPIBatchAdd  (&batch, tx [0], rx [0], 3) ;
+  wiringPiSPIBatchAdd  (&batch, tx [1], rx [1], 3) ;
+
+  if (wiringPiSPIBatchRun (&batch) < 0)
+    return -1 ;
+
+  return (rx [1][2] << 8) | rx [0][2] ;
+}
+
+
+/*
+ * myFlush: myRefresh: mySetupInt:
+ *	Cache hooks, see wiringPiNodeBegin. Both ports go in one SPI message.
+ *********************************************************************************
+ */
+
+static int myFlush (struct wiringPiNodeStruct *node)
+{
+  struct wiringPiSPIBatch batch ;
+  uint8_t tx [2][3] ;
+
+  tx [0][0] = tx [1][0] = CMD_WRITE | ((node->data1 & 7) << 1) ;
+  tx [0][1] = MCP23x17_GPIOA ; tx [0][2] = node->data2 ;
+  tx [1][1] = MCP23x17_GPIOB ; tx [1][2] = node->data3 ;
+
+  wiringPiSPIBatchInit (&batch, node->data0) ;
+  wiringPiSPIBatchAdd  (&batch, tx [0], NULL, 3) ;
+  wiringPiSPIBatchAdd  (&batch, tx [1], NULL, 3) ;
+
+  return wiringPiSPIBatchRun (&batch) ;
+}
+
+static int myRefresh (struct wiringPiNodeStruct *node)
+{
+  int value ;
+
+  if ((value = mcp23s17ReadAll (node->data0, node->data1)) < 0)
+    return -1 ;
+
+  node->snapshot = value ;
+  return 0 ;
+}
+
+static int mySetupInt (struct wiringPiNodeStruct *node)
+{
+  struct wiringPiSPIBatch batch ;
+  uint8_t tx [5][3] ;
+  static const uint8_t regs [5] =
+    { MCP23x17_IOCON, MCP23x17_INTCONA, MCP23x17_INTCONB, MCP23x17_GPINTENA, MCP23x17_GPINTENB } ;
+  const uint8_t vals [5] =
+    { IOCON_INIT | IOCON_HAEN | IOCON_MIRROR, 0x00, 0x00,
+      ~node->outputs & 0xFF, (~node->outputs >> 8) & 0xFF } ;
+  int i ;
+
+// Interrupt on any input change, either port drives both INT pins
+
+  wiringPiSPIBatchInit (&batch, node->data0) ;
+  for (i = 0 ; i < 5 ; ++i)
+  {
+    tx [i][0] = CMD_WRITE | ((node->data1 & 7) << 1) ;
+    tx [i][1] = regs [i] ;
+    tx [i][2] = vals [i] ;
+    wiringPiSPIBatchAdd (&batch, tx [i], NULL, 3) ;
+  }
+
+  return wiringPiSPIBatchRun (&batch) ;
+}
+
+
 /*
  * myPinMode:
  *********************************************************************************
@@ -99,6 +186,20 @@ static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
     old |=   mask ;
 
   writeByte (node->data0, node->data1, reg, old) ;
+
+// Keep the direction shadow, and interrupts on inputs only
+
+  if (reg == MCP23x17_IODIRA)
+    node->outputs = (node->outputs & 0xFF00) | (~old & 0xFF) ;
+  else
+    node->outputs = (node->outputs & 0x00FF) | ((~old & 0xFF) << 8) ;
+
+  if (node->intPin >= 0)
+    writeByte (node->data0, node->data1, reg + (MCP23x17_GPINTENA - MCP23x17_IODIRA), old) ;
+
+// An input that was an output has no sample in the snapshot yet
+
+  __atomic_store_n (&node->snapValid, FALSE, __ATOMIC_RELEASE) ;
 }
 
 
@@ -155,8 +256,9 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
     else
       old |=   bit ;
 
-    writeByte (node->data0, node->data1, MCP23x17_GPIOA, old) ;
     node->data2 = old ;
+    if (!wiringPiNodeDefer (node))
+      writeByte (node->data0, node->data1, MCP23x17_GPIOA, old) ;
   }
   else				// Bank B
   {
@@ -167,8 +269,9 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
     else
       old |=   bit ;
 
-    writeByte (node->data0, node->data1, MCP23x17_GPIOB, old) ;
     node->data3 = old ;
+    if (!wiringPiNodeDefer (node))
+      writeByte (node->data0, node->data1, MCP23x17_GPIOB, old) ;
   }
 }
 
@@ -181,6 +284,7 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 {
   int mask, value, gpio ;
+  unsigned int snap ;
 
   pin -= node->pinBase ;
 
@@ -193,7 +297,16 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
   }
 
   mask  = 1 << pin ;
-  value = readByte (node->data0, node->data1, gpio) ;
+
+// Outputs raise no INT, so in the snapshot they come from the latches
+
+  if (wiringPiNodeSnapshot (node, &snap) == 0)
+  {
+    snap  = (snap & ~node->outputs) | (((node->data3 << 8) | node->data2) & node->outputs) ;
+    value = (gpio == MCP23x17_GPIOA) ? (snap & 0xFF) : (snap >> 8) ;
+  }
+  else
+    value = readByte (node->data0, node->data1, gpio) ;
 
   if ((value & mask) == 0)
     return LOW ;
@@ -213,12 +326,34 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 int mcp23s17Setup (const int pinBase, const int spiPort, const int devId)
 {
   struct wiringPiNodeStruct *node ;
+  struct wiringPiSPIBatch batch ;
+  uint8_t tx [6][3], rx [6][3] ;
+  uint8_t cmdWrite = CMD_WRITE | ((devId & 7) << 1) ;
+  uint8_t cmdRead  = CMD_READ  | ((devId & 7) << 1) ;
 
   if (wiringPiSPISetup (spiPort, MCP_SPEED) < 0)
     return FALSE ;
 
-  writeByte (spiPort, devId, MCP23x17_IOCON,  IOCON_INIT | IOCON_HAEN) ;
-  writeByte (spiPort, devId, MCP23x17_IOCONB, IOCON_INIT | IOCON_HAEN) ;
+// Configure both IOCON copies and fetch the output latches and directions
+//	in one go
+
+  tx [0][0] = cmdWrite ; tx [0][1] = MCP23x17_IOCON  ; tx [0][2] = IOCON_INIT | IOCON_HAEN ;
+  tx [1][0] = cmdWrite ; tx [1][1] = MCP23x17_IOCONB ; tx [1][2] = IOCON_INIT | IOCON_HAEN ;
+  tx [2][0] = cmdRead  ; tx [2][1] = MCP23x17_OLATA  ; tx [2][2] = 0 ;
+  tx [3][0] = cmdRead  ; tx [3][1] = MCP23x17_OLATB  ; tx [3][2] = 0 ;
+  tx [4][0] = cmdRead  ; tx [4][1] = MCP23x17_IODIRA ; tx [4][2] = 0 ;
+  tx [5][0] = cmdRead  ; tx [5][1] = MCP23x17_IODIRB ; tx [5][2] = 0 ;
+
+  wiringPiSPIBatchInit (&batch, spiPort) ;
+  wiringPiSPIBatchAdd  (&batch, tx [0], NULL,  3) ;
+  wiringPiSPIBatchAdd  (&batch, tx [1], NULL,  3) ;
+  wiringPiSPIBatchAdd  (&batch, tx [2], rx [2], 3) ;
+  wiringPiSPIBatchAdd  (&batch, tx [3], rx [3], 3) ;
+  wiringPiSPIBatchAdd  (&batch, tx [4], rx [4], 3) ;
+  wiringPiSPIBatchAdd  (&batch, tx [5], rx [5], 3) ;
+
+  if (wiringPiSPIBatchRun (&batch) < 0)
+    return FALSE ;
 
   node = wiringPiNewNode (pinBase, 16) ;
 
@@ -228,8 +363,12 @@ int mcp23s17Setup (const int pinBase, const int spiPort, const int devId)
   node->pullUpDnControl = myPullUpDnControl ;
   node->digitalRead     = myDigitalRead ;
   node->digitalWrite    = myDigitalWrite ;
-  node->data2           = readByte (spiPort, devId, MCP23x17_OLATA) ;
-  node->data3           = readByte (spiPort, devId, MCP23x17_OLATB) ;
+  node->flush           = myFlush ;
+  node->refresh         = myRefresh ;
+  node->setupInt        = mySetupInt ;
+  node->data2           = rx [2][2] ;
+  node->data3           = rx [3][2] ;
+  node->outputs         = ~((rx [5][2] << 8) | rx [4][2]) & 0xFFFF ;
 
   return TRUE ;
 }
@@ -53,6 +53,37 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * mcp3002ReadAll:
+ *	Read both channels in one SPI message.
+ *********************************************************************************
+ */
+
+int mcp3002ReadAll (int spiChannel, int *values)
+{
+  struct wiringPiSPIBatch batch ;
+  unsigned char tx [2][2], rx [2][2] ;
+  int chan ;
+
+  wiringPiSPIBatchInit (&batch, spiChannel) ;
+
+  for (chan = 0 ; chan < 2 ; ++chan)
+  {
+    tx [chan][0] = (chan == 0) ? 0b11010000 : 0b11110000 ;
+    tx [chan][1] = 0 ;
+    wiringPiSPIBatchAdd (&batch, tx [chan], rx [chan], 2) ;
+  }
+
+  if (wiringPiSPIBatchRun (&batch) < 0)
+    return -1 ;
+
+  for (chan = 0 ; chan < 2 ; ++chan)
+    values [chan] = ((rx [chan][0] << 8) | (rx [chan][1] >> 1)) & 0x3FF ;
+
+  return 2 ;
+}
+
+
 /*
  * mcp3002Setup:
  *	Create a new wiringPi device node for an mcp3002 on the Pi's
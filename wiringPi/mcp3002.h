@@ -26,7 +26,8 @@
 extern "C" {
 #endif
 
-extern int mcp3002Setup (int pinBase, int spiChannel) ;
+extern int mcp3002Setup   (int pinBase, int spiChannel) ;
+extern int mcp3002ReadAll (int spiChannel, int *values) ;
 
 #ifdef __cplusplus
 }
@@ -53,6 +53,42 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * mcp3004ReadAll:
+ *	Read the first numChannels channels in one SPI message.
+ *	Returns the number of channels read, or -1.
+ *********************************************************************************
+ */
+
+int mcp3004ReadAll (int spiChannel, int *values, int numChannels)
+{
+  struct wiringPiSPIBatch batch ;
+  unsigned char tx [8][3], rx [8][3] ;
+  int chan ;
+
+  if ((numChannels < 1) || (numChannels > 8))
+    return -1 ;
+
+  wiringPiSPIBatchInit (&batch, spiChannel) ;
+
+  for (chan = 0 ; chan < numChannels ; ++chan)
+  {
+    tx [chan][0] = 1 ;				// Start bit
+    tx [chan][1] = 0b10000000 | (chan << 4) ;
+    tx [chan][2] = 0 ;
+    wiringPiSPIBatchAdd (&batch, tx [chan], rx [chan], 3) ;
+  }
+
+  if (wiringPiSPIBatchRun (&batch) < 0)
+    return -1 ;
+
+  for (chan = 0 ; chan < numChannels ; ++chan)
+    values [chan] = ((rx [chan][1] << 8) | rx [chan][2]) & 0x3FF ;
+
+  return numChannels ;
+}
+
+
 /*
  * mcp3004Setup:
  *	Create a new wiringPi device node for an mcp3004 on the Pi's
@@ -26,7 +26,8 @@
 extern "C" {
 #endif
 
-extern int mcp3004Setup (int pinBase, int spiChannel) ;
+extern int mcp3004Setup   (int pinBase, int spiChannel) ;
+extern int mcp3004ReadAll (int spiChannel, int *values, int numChannels) ;
 
 #ifdef __cplusplus
 }
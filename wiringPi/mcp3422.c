@@ -41,21 +41,34 @@
 
 /*
  * waitForConversion:
- *	Common code to wait for the ADC to finish conversion
+ *	Common code to wait for the ADC to finish conversion.
+ *	The config write and the first result read go in one I2C_RDWR
+ *	transaction, only the polls after that are reads on their own.
  *********************************************************************************
  */
 
-void waitForConversion (int fd, unsigned char *buffer, int n)
+int waitForConversion (int fd, unsigned char config, unsigned char *buffer, int n)
 {
-  for (;;)
+  struct wiringPiI2CBatch start, again ;
+
+  wiringPiI2CBatchInit  (&start, fd) ;
+  wiringPiI2CBatchWrite (&start, -1, &config, 1) ;
+  wiringPiI2CBatchRead  (&start, -1, buffer, n) ;
+
+  wiringPiI2CBatchInit  (&again, fd) ;
+  wiringPiI2CBatchRead  (&again, -1, buffer, n) ;
+
+  if (wiringPiI2CBatchRun (&start) < 0)
+    return -1 ;
+
+  while ((buffer [n-1] & 0x80) != 0)
   {
-    if (read(fd, buffer, n) < 0) {
-      fprintf(stderr, "Unable to read from the file descriptor: %s \n", strerror(errno));
-    }
-    if ((buffer [n-1] & 0x80) == 0)
-      break ;
     delay (1) ;
+    if (wiringPiI2CBatchRun (&again) < 0)
+      return -1 ;
   }
+
+  return 0 ;
 }
 
 /*
@@ -75,27 +88,27 @@ int myAnalogRead (struct wiringPiNodeStruct *node, int chan)
 
   config = 0x80 | (realChan << 5) | (node->data0 << 2) | (node->data1) ;
 
-  wiringPiI2CWrite (node->fd, config) ;
+  if (waitForConversion (node->fd, config, buffer, (node->data0 == MCP3422_SR_3_75) ? 4 : 3) < 0)
+  {
+    fprintf (stderr, "mcp3422: Unable to read the conversion: %s\n", strerror (errno)) ;
+    return 0 ;
+  }
 
   switch (node->data0)	// Sample rate
   {
     case MCP3422_SR_3_75:			// 18 bits
-      waitForConversion (node->fd, &buffer [0], 4) ;
       value = ((buffer [0] & 3) << 16) | (buffer [1] << 8) | buffer [2] ;
       break ;
 
     case MCP3422_SR_15:				// 16 bits
-      waitForConversion (node->fd, buffer, 3) ;
       value = (buffer [0] << 8) | buffer [1] ;
       break ;
 
     case MCP3422_SR_60:				// 14 bits
-      waitForConversion (node->fd, buffer, 3) ;
       value = ((buffer [0] & 0x3F) << 8) | buffer [1] ;
       break ;
 
     case MCP3422_SR_240:			// 12 bits - default
-      waitForConversion (node->fd, buffer, 3) ;
       value = ((buffer [0] & 0x0F) << 8) | buffer [1] ;
       break ;
   }
@@ -170,6 +170,7 @@ static int		_getPUPD		(int pin);
 static int		_pullUpDnControl	(int pin, int pud);
 static int		_digitalRead		(int pin);
 static int		_digitalWrite		(int pin, int value);
+static int		_getPinHandle		(int pin, struct wiringPiPinHandle *handle);
 static int		_analogRead		(int pin);
 static int		_digitalWriteByte	(const unsigned int value);
 static unsigned int	_digitalReadByte	(void);
@@ -598,10 +599,32 @@ static int _digitalWrite (int pin, int value)
 	if ((pin = _getModeToGpio(lib->mode, pin)) < 0)
 		return -1;
 
-	if (value == LOW)
-		*(gpio + gpioToGPSETReg(pin)) &= ~(1 << gpioToShiftReg(pin));
-	else
-		*(gpio + gpioToGPSETReg(pin)) |=  (1 << gpioToShiftReg(pin));
+	wiringPiBankWrite(gpio + gpioToGPSETReg(pin), 1 << gpioToShiftReg(pin),
+		value == LOW ? 0 : 1 << gpioToShiftReg(pin));
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+static int _getPinHandle (int pin, struct wiringPiPinHandle *handle)
+{
+	if (lib->mode == MODE_GPIO_SYS)
+		return -1;
+
+	if ((pin = _getModeToGpio(lib->mode, pin)) < 0)
+		return -1;
+
+	if (gpioToGPSETReg(pin) < 0 || gpioToGPLEVReg(pin) < 0)
+		return -1;
+
+	handle->style	= WPI_PIN_SHADOW;
+	handle->outReg	= gpio + gpioToGPSETReg(pin);
+	handle->inReg	= gpio + gpioToGPLEVReg(pin);
+	handle->outMask	= 1 << gpioToShiftReg(pin);
+	handle->inMask	= 1 << gpioToShiftReg(pin);
+
+	if ((handle->bank = wiringPiBankGet(handle->outReg)) == NULL)
+		handle->style = WPI_PIN_RMW;
 
 	return 0;
 }
@@ -671,7 +694,7 @@ static int _digitalWriteByte (const unsigned int value)
 	/* Wiring PI GPIO7 = C1 GPIOX.21 */
 	gpiox.bits.bit21 = (value & 0x80);
 
-	*(gpio + C2_GPIOX_OUTP_REG_OFFSET) = gpiox.wvalue;
+	wiringPiBankWrite(gpio + C2_GPIOX_OUTP_REG_OFFSET, 0x280F28, gpiox.wvalue);
 
 	return 0;
 }
@@ -763,6 +786,7 @@ void init_odroidc2 (struct libodroid *libwiring)
 	libwiring->pullUpDnControl	= _pullUpDnControl;
 	libwiring->digitalRead		= _digitalRead;
 	libwiring->digitalWrite		= _digitalWrite;
+	libwiring->getPinHandle		= _getPinHandle;
 	libwiring->analogRead		= _analogRead;
 	libwiring->digitalWriteByte	= _digitalWriteByte;
 	libwiring->digitalReadByte	= _digitalReadByte;
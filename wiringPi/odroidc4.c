@@ -152,6 +152,7 @@ static char setupedPwmPinPath[10][BLOCK_SIZE] = {
 /*----------------------------------------------------------------------------*/
 /* ADC file descriptor */
 static int adcFds[2];
+static const char *adcNodes[2];
 
 /* GPIO mmap control */
 static volatile uint32_t *gpio;
@@ -167,9 +168,11 @@ static char sysPwmPath[(BLOCK_SIZE / 4)];
 static char pwmExport[(BLOCK_SIZE / 16)];
 static char pwmUnexport[(BLOCK_SIZE / 16)];
 static char pwmPeriod[(BLOCK_SIZE / 16)];
-static char pwmDuty[(BLOCK_SIZE / 16)];
 static unsigned int pwmClock;
 static unsigned int pwmRange;
+/* pwm channels, by pwm pin number */
+static struct wiringPiPwmChannel pwmChannels[10];
+static unsigned long pwmPinReg[10];
 
 /*----------------------------------------------------------------------------*/
 // Function prototype define
@@ -200,8 +203,10 @@ static int		_getPUPD		(int pin);
 static int		_pullUpDnControl	(int pin, int pud);
 static int		_digitalRead		(int pin);
 static int		_digitalWrite		(int pin, int value);
+static int		_getPinHandle		(int pin, struct wiringPiPinHandle *handle);
 static int		_pwmWrite		(int pin, int value);
 static int		_analogRead		(int pin);
+static const char *	_getAdcNode		(int pin);
 static int		_digitalWriteByte	(const unsigned int value);
 static unsigned int	_digitalReadByte	(void);
 static void		_pwmSetRange		(unsigned int range);
@@ -426,6 +431,7 @@ static int pwmSetup (int pin) {
 	sprintf(pwmExport, "%d", (pwmPin % 2));
 	sprintf(pwmPinPath[pwmPin], "%s/pwm%d", sysPwmPath, (pwmPin % 2));
 	strncpy(setupedPwmPinPath[pwmPin], pwmPinPath[pwmPin], (BLOCK_SIZE - 1));
+	pwmPinReg[pwmPin] = strtoul(pinToPwm[pin], NULL, 16) + ((pwmPin % 2) * 4);
 #ifdef ANDROID
 	sprintf(cmd, "su -s sh -c %s %s", SYS_ACCESS_SCRIPT, pwmPinPath[pwmPin]);
 #else
@@ -452,6 +458,7 @@ static int pwmRelease (int pin) {
 	pwmPin = pinToPwmNum[pin];
 	sprintf(pwmUnexport, "%d", (pwmPin % 2));
 	sprintf(pwmPinPath[pwmPin], "%s/pwm%d", sysPwmPath, (pwmPin % 2));
+	wiringPiPwmChannelClose(&pwmChannels[pwmPin]);
 	if ((pwm = opendir(pwmPinPath[pwmPin])) != NULL) {
 		inputToSysNode(pwmPinPath[pwmPin], "enable", "0");
 		inputToSysNode(sysPwmPath, "unexport", pwmUnexport);
@@ -698,10 +705,36 @@ static int _digitalWrite (int pin, int value)
 	if ((pin = _getModeToGpio(lib->mode, pin)) < 0)
 		return -1;
 
-	if (value == LOW)
-		*(gpio + gpioToGPSETReg(pin)) &= ~(1 << gpioToShiftReg(pin));
-	else
-		*(gpio + gpioToGPSETReg(pin)) |=  (1 << gpioToShiftReg(pin));
+	wiringPiBankWrite(gpio + gpioToGPSETReg(pin), 1 << gpioToShiftReg(pin),
+		value == LOW ? 0 : 1 << gpioToShiftReg(pin));
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+static int _getPinHandle (int pin, struct wiringPiPinHandle *handle)
+{
+	if (lib->mode == MODE_GPIO_SYS)
+		return -1;
+
+	if ((pin = _getModeToGpio(lib->mode, pin)) < 0)
+		return -1;
+
+	if (gpioToGPSETReg(pin) < 0 || gpioToGPLEVReg(pin) < 0)
+		return -1;
+
+	handle->style	= WPI_PIN_SHADOW;
+	handle->outReg	= gpio + gpioToGPSETReg(pin);
+	handle->inReg	= gpio + gpioToGPLEVReg(pin);
+	handle->outMask	= 1 << gpioToShiftReg(pin);
+	handle->inMask	= 1 << gpioToShiftReg(pin);
+
+	handle->dirStyle = WPI_DIR_OEN;
+	handle->dirReg	= gpio + gpioToGPFSELReg(pin);
+	handle->dirMask	= 1 << gpioToShiftReg(pin);
+
+	if ((handle->bank = wiringPiBankGet(handle->outReg)) == NULL)
+		handle->style = WPI_PIN_RMW;
 
 	return 0;
 }
@@ -713,11 +746,8 @@ static int _digitalWrite (int pin, int value)
 /*----------------------------------------------------------------------------*/
 static int _pwmWrite (int pin, int value)
 {
-	unsigned int duty;
 	int pwmPin;
 
-	memset(pwmDuty, 0, sizeof(pwmDuty));
-
 	if (lib->mode == MODE_GPIO_SYS)
 		return -1;
 
@@ -727,22 +757,13 @@ static int _pwmWrite (int pin, int value)
 	}
 
 	pwmPin = pinToPwmNum[pin];
-	duty = ((value * 100) / pwmRange);
-	sprintf(pwmDuty, "%d", ((atoi(pwmPeriod) * duty) / 100));
 
-	inputToSysNode(pwmPinPath[pwmPin], "duty_cycle", pwmDuty);
-
-	return 0;
+	return wiringPiPwmChannelWrite(&pwmChannels[pwmPin], value, pwmRange);
 }
 
 /*----------------------------------------------------------------------------*/
-static int _analogRead (int pin)
+static int adcPinToIndex (int pin)
 {
-	char value[5] = {0,};
-
-	if (lib->mode == MODE_GPIO_SYS)
-		return	-1;
-
 	/* wiringPi ADC number = pin 25, pin 29 */
 	switch (pin) {
 #if defined(ARDUINO)
@@ -762,8 +783,23 @@ static int _analogRead (int pin)
 	break;
 #endif
 	default:
-		return	0;
+		return	-1;
 	}
+
+	return	pin;
+}
+
+/*----------------------------------------------------------------------------*/
+static int _analogRead (int pin)
+{
+	char value[5] = {0,};
+
+	if (lib->mode == MODE_GPIO_SYS)
+		return	-1;
+
+	if ((pin = adcPinToIndex(pin)) < 0)
+		return	0;
+
 	if (adcFds [pin] == -1)
 		return 0;
 
@@ -776,6 +812,15 @@ static int _analogRead (int pin)
 	return	atoi(value);
 }
 
+/*----------------------------------------------------------------------------*/
+static const char *_getAdcNode (int pin)
+{
+	if ((pin = adcPinToIndex(pin)) < 0)
+		return	NULL;
+
+	return	adcNodes[pin];
+}
+
 /*----------------------------------------------------------------------------*/
 static int _digitalWriteByte (const unsigned int value)
 {
@@ -803,7 +848,7 @@ static int _digitalWriteByte (const unsigned int value)
 	/* Wiring PI GPIO7 = C4 GPIOX.5 */
 	gpiox.bits.bit5 = (value & 0x80);
 
-	*(gpio + C4_GPIOX_OUTP_REG_OFFSET) = gpiox.wvalue;
+	wiringPiBankWrite(gpio + C4_GPIOX_OUTP_REG_OFFSET, 0x100BF, gpiox.wvalue);
 
 	return 0;
 }
@@ -885,6 +930,8 @@ static void _pwmSetRange (unsigned int range)
 		inputToSysNode(setupedPwmPinPath[i], "period", pwmPeriod);
 		inputToSysNode(setupedPwmPinPath[i], "polarity", "normal");
 		inputToSysNode(setupedPwmPinPath[i], "enable", "1");
+		wiringPiPwmChannelOpen(&pwmChannels[i], setupedPwmPinPath[i],
+					pwmPinReg[i], WPI_PWM_REG_MESON, period);
 	}
 }
 
@@ -968,11 +1015,17 @@ static void init_adc_fds (void)
 
 	adcFds[0] = open(AIN25_NODE, O_RDONLY);
 	adcFds[1] = open(AIN29_NODE, O_RDONLY);
+
+	adcNodes[0] = AIN25_NODE;
+	adcNodes[1] = AIN29_NODE;
 }
 
 /*----------------------------------------------------------------------------*/
 void init_odroidc4 (struct libodroid *libwiring)
 {
+	for (int i = 0; i < 10; i++)
+		pwmChannels[i].dutyFd = -1;
+
 	init_gpio_mmap();
 
 	init_adc_fds();
@@ -987,8 +1040,10 @@ void init_odroidc4 (struct libodroid *libwiring)
 	libwiring->pullUpDnControl	= _pullUpDnControl;
 	libwiring->digitalRead		= _digitalRead;
 	libwiring->digitalWrite		= _digitalWrite;
+	libwiring->getPinHandle		= _getPinHandle;
 	libwiring->pwmWrite		= _pwmWrite;
 	libwiring->analogRead		= _analogRead;
+	libwiring->getAdcNode		= _getAdcNode;
 	libwiring->digitalWriteByte	= _digitalWriteByte;
 	libwiring->digitalReadByte	= _digitalReadByte;
 	libwiring->pwmSetRange		= _pwmSetRange;
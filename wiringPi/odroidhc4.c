@@ -116,6 +116,7 @@ static int		_getPUPD		(int pin);
 static int		_pullUpDnControl	(int pin, int pud);
 static int		_digitalRead		(int pin);
 static int		_digitalWrite		(int pin, int value);
+static int		_getPinHandle		(int pin, struct wiringPiPinHandle *handle);
 
 /*----------------------------------------------------------------------------*/
 // board init function
@@ -497,10 +498,36 @@ static int _digitalWrite (int pin, int value)
 	if ((pin = _getModeToGpio(lib->mode, pin)) < 0)
 		return -1;
 
-	if (value == LOW)
-		*(gpio + gpioToGPSETReg(pin)) &= ~(1 << gpioToShiftReg(pin));
-	else
-		*(gpio + gpioToGPSETReg(pin)) |=  (1 << gpioToShiftReg(pin));
+	wiringPiBankWrite(gpio + gpioToGPSETReg(pin), 1 << gpioToShiftReg(pin),
+		value == LOW ? 0 : 1 << gpioToShiftReg(pin));
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+static int _getPinHandle (int pin, struct wiringPiPinHandle *handle)
+{
+	if (lib->mode == MODE_GPIO_SYS)
+		return -1;
+
+	if ((pin = _getModeToGpio(lib->mode, pin)) < 0)
+		return -1;
+
+	if (gpioToGPSETReg(pin) < 0 || gpioToGPLEVReg(pin) < 0)
+		return -1;
+
+	handle->style	= WPI_PIN_SHADOW;
+	handle->outReg	= gpio + gpioToGPSETReg(pin);
+	handle->inReg	= gpio + gpioToGPLEVReg(pin);
+	handle->outMask	= 1 << gpioToShiftReg(pin);
+	handle->inMask	= 1 << gpioToShiftReg(pin);
+
+	handle->dirStyle = WPI_DIR_OEN;
+	handle->dirReg	= gpio + gpioToGPFSELReg(pin);
+	handle->dirMask	= 1 << gpioToShiftReg(pin);
+
+	if ((handle->bank = wiringPiBankGet(handle->outReg)) == NULL)
+		handle->style = WPI_PIN_RMW;
 
 	return 0;
 }
@@ -565,6 +592,7 @@ void init_odroidhc4 (struct libodroid *libwiring)
 	libwiring->pullUpDnControl	= _pullUpDnControl;
 	libwiring->digitalRead		= _digitalRead;
 	libwiring->digitalWrite		= _digitalWrite;
+	libwiring->getPinHandle		= _getPinHandle;
 
 	/* specify pin base number */
 	libwiring->pinBase		= C4_GPIO_PIN_BASE;
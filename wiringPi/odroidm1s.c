@@ -169,6 +169,7 @@ static char setupedPwmPinPath[10][BLOCK_SIZE] = {
 /*----------------------------------------------------------------------------*/
 /* ADC file descriptor */
 static int adcFds[2];
+static const char *adcNodes[2];
 
 /* GPIO mmap control. Actual GPIO bank number. */
 static volatile uint32_t *gpio[5];
@@ -190,9 +191,11 @@ static char sysPwmPath[(BLOCK_SIZE / 4)];
 static char pwmExport[(BLOCK_SIZE / 16)];
 static char pwmUnexport[(BLOCK_SIZE / 16)];
 static char pwmPeriod[(BLOCK_SIZE / 16)];
-static char pwmDuty[(BLOCK_SIZE / 16)];
 static unsigned int pwmClock;
 static unsigned int pwmRange;
+/* pwm channels, by pwm pin number */
+static struct wiringPiPwmChannel pwmChannels[10];
+static unsigned long pwmPinReg[10];
 /*----------------------------------------------------------------------------*/
 // Function prototype define
 /*----------------------------------------------------------------------------*/
@@ -218,8 +221,10 @@ static int		_getPUPD		(int pin);
 static int		_pullUpDnControl	(int pin, int pud);
 static int		_digitalRead		(int pin);
 static int		_digitalWrite		(int pin, int value);
+static int		_getPinHandle		(int pin, struct wiringPiPinHandle *handle);
 static int		_pwmWrite		(int pin, int value);
 static int		_analogRead		(int pin);
+static const char *	_getAdcNode		(int pin);
 static int		_digitalWriteByte	(const unsigned int value);
 static unsigned int	_digitalReadByte	(void);
 static void		_pwmSetRange	(unsigned int range);
@@ -319,6 +324,7 @@ static int pwmSetup (int pin) {
 	sprintf(pwmExport, "%d", 0);
 	sprintf(pwmPinPath[pwmPin], "%s/pwm%d", sysPwmPath, 0);
 	strncpy(setupedPwmPinPath[pwmPin], pwmPinPath[pwmPin], (BLOCK_SIZE - 1));
+	pwmPinReg[pwmPin] = strtoul(pinToPwm[pin], NULL, 16);
 #ifdef ANDROID
 	sprintf(cmd, "su -s sh -c %s %s", SYS_ACCESS_SCRIPT, pwmPinPath[pwmPin]);
 #else
@@ -345,6 +351,7 @@ static int pwmRelease (int pin) {
 	pwmPin = pinToPwmNum[pin];
 	sprintf(pwmUnexport, "%d", (pwmPin % 2));
 	sprintf(pwmPinPath[pwmPin], "%s/pwm%d", sysPwmPath, (pwmPin % 2));
+	wiringPiPwmChannelClose(&pwmChannels[pwmPin]);
 	if ((pwm = opendir(pwmPinPath[pwmPin])) != NULL) {
 		inputToSysNode(pwmPinPath[pwmPin], "enable", "0");
 		inputToSysNode(sysPwmPath, "unexport", pwmUnexport);
@@ -794,13 +801,37 @@ static int _digitalWrite (int pin, int value)
 	return 0;
 }
 /*----------------------------------------------------------------------------*/
+static int _getPinHandle (int pin, struct wiringPiPinHandle *handle)
+{
+	uint8_t bank, bankOffset;
+
+	if (lib->mode == MODE_GPIO_SYS)
+		return -1;
+
+	if ((pin = _getModeToGpio(lib->mode, pin)) < 0)
+		return -1;
+
+	bank = (pin / GPIO_SIZE);
+	bankOffset = (pin - (bank * GPIO_SIZE));
+
+	// Each half of the data register has its own write_mask in the upper 16 bits
+	handle->style	= WPI_PIN_WMASK;
+	handle->outReg	= gpio[bank] + (bankOffset / 16 == 0 ? M1_GPIO_SET_OFFSET : M1_GPIO_SET_OFFSET + 0x01);
+	handle->inReg	= gpio[bank] + M1_GPIO_GET_OFFSET;
+	handle->outMask	= 1 << gpioToShiftRegBy16(pin);
+	handle->inMask	= 1 << gpioToShiftRegBy32(pin);
+
+	handle->dirStyle = WPI_DIR_WMASK;
+	handle->dirReg	= gpio[bank] + (bankOffset / 16 == 0 ? M1_GPIO_DIR_OFFSET : M1_GPIO_DIR_OFFSET + 0x01);
+	handle->dirMask	= handle->outMask;
+
+	return 0;
+}
+/*----------------------------------------------------------------------------*/
 static int _pwmWrite (int pin, int value)
 {
-	unsigned int duty;
 	int pwmPin;
 
-	memset(pwmDuty, 0, sizeof(pwmDuty));
-
 	if (lib->mode == MODE_GPIO_SYS)
 		return -1;
 
@@ -810,21 +841,12 @@ static int _pwmWrite (int pin, int value)
 	}
 
 	pwmPin = pinToPwmNum[pin];
-	duty = ((value * 100) / pwmRange);
-	sprintf(pwmDuty, "%d", ((atoi(pwmPeriod) * duty) / 100));
 
-	inputToSysNode(pwmPinPath[pwmPin], "duty_cycle", pwmDuty);
-
-	return 0;
+	return wiringPiPwmChannelWrite(&pwmChannels[pwmPin], value, pwmRange);
 }
 /*----------------------------------------------------------------------------*/
-static int _analogRead (int pin)
+static int adcPinToIndex (int pin)
 {
-	char value[5] = {0, };
-
-	if (lib->mode == MODE_GPIO_SYS)
-		return	-1;
-
 	/* wiringPi ADC number = pin 25, pin 29 */
 	switch (pin) {
 #if defined(ARDUINO)
@@ -844,8 +866,22 @@ static int _analogRead (int pin)
 	break;
 #endif
 	default:
-		return	0;
+		return	-1;
 	}
+
+	return	pin;
+}
+/*----------------------------------------------------------------------------*/
+static int _analogRead (int pin)
+{
+	char value[5] = {0, };
+
+	if (lib->mode == MODE_GPIO_SYS)
+		return	-1;
+
+	if ((pin = adcPinToIndex(pin)) < 0)
+		return	0;
+
 	if (adcFds [pin] == -1)
 		return 0;
 
@@ -858,6 +894,14 @@ static int _analogRead (int pin)
 	return	atoi(value);
 }
 /*----------------------------------------------------------------------------*/
+static const char *_getAdcNode (int pin)
+{
+	if ((pin = adcPinToIndex(pin)) < 0)
+		return	NULL;
+
+	return	adcNodes[pin];
+}
+/*----------------------------------------------------------------------------*/
 static int _digitalWriteByte (const unsigned int value)
 {
 	union reg_bitfield gpio0;
@@ -983,6 +1027,8 @@ static void _pwmSetRange (unsigned int range)
 		inputToSysNode(setupedPwmPinPath[i], "period", pwmPeriod);
 		inputToSysNode(setupedPwmPinPath[i], "polarity", "normal");
 		inputToSysNode(setupedPwmPinPath[i], "enable", "1");
+		wiringPiPwmChannelOpen(&pwmChannels[i], setupedPwmPinPath[i],
+					pwmPinReg[i], WPI_PWM_REG_ROCKCHIP, period);
 	}
 }
 /*----------------------------------------------------------------------------*/
@@ -1079,10 +1125,16 @@ static void init_adc_fds (void)
 
 	adcFds[0] = open(AIN0_NODE, O_RDONLY);
 	adcFds[1] = open(AIN1_NODE, O_RDONLY);
+
+	adcNodes[0] = AIN0_NODE;
+	adcNodes[1] = AIN1_NODE;
 }
 /*----------------------------------------------------------------------------*/
 void init_odroidm1s (struct libodroid *libwiring)
 {
+	for (int i = 0; i < 10; i++)
+		pwmChannels[i].dutyFd = -1;
+
 	init_gpio_mmap();
 
 	init_adc_fds();
@@ -1097,7 +1149,9 @@ void init_odroidm1s (struct libodroid *libwiring)
 	libwiring->setDrive			= _setDrive;
 	libwiring->digitalRead		= _digitalRead;
 	libwiring->digitalWrite		= _digitalWrite;
+	libwiring->getPinHandle		= _getPinHandle;
 	libwiring->analogRead		= _analogRead;
+	libwiring->getAdcNode		= _getAdcNode;
 	libwiring->digitalWriteByte	= _digitalWriteByte;
 	libwiring->digitalReadByte	= _digitalReadByte;
 	libwiring->pwmWrite			= _pwmWrite;
@@ -116,6 +116,7 @@ static int		_getPUPD		(int pin);
 static int		_pullUpDnControl	(int pin, int pud);
 static int		_digitalRead		(int pin);
 static int		_digitalWrite		(int pin, int value);
+static int		_getPinHandle		(int pin, struct wiringPiPinHandle *handle);
 static int		_analogRead		(int pin);
 static int		_digitalWriteByte	(const unsigned int value);
 static unsigned int	_digitalReadByte	(void);
@@ -542,6 +543,32 @@ static int _digitalWrite (int pin, int value)
 	return 0;
 }
 
+/*----------------------------------------------------------------------------*/
+static int _getPinHandle (int pin, struct wiringPiPinHandle *handle)
+{
+	volatile uint32_t *base;
+
+	if (lib->mode == MODE_GPIO_SYS)
+		return -1;
+
+	if ((pin = _getModeToGpio(lib->mode, pin)) < 0)
+		return -1;
+
+	if (gpioToGPLEVReg(pin) < 0)
+		return -1;
+
+	// The data register is used for both input and output
+	base = (pin < 100) ? gpio : gpio1;
+
+	handle->style	= WPI_PIN_RMW;
+	handle->outReg	= base + gpioToGPLEVReg(pin);
+	handle->inReg	= base + gpioToGPLEVReg(pin);
+	handle->outMask	= 1 << gpioToShiftReg(pin);
+	handle->inMask	= 1 << gpioToShiftReg(pin);
+
+	return 0;
+}
+
 /*----------------------------------------------------------------------------*/
 static int _analogRead (int pin)
 {
@@ -742,6 +769,7 @@ void init_odroidxu3 (struct libodroid *libwiring)
 	libwiring->pullUpDnControl	= _pullUpDnControl;
 	libwiring->digitalRead		= _digitalRead;
 	libwiring->digitalWrite		= _digitalWrite;
+	libwiring->getPinHandle		= _getPinHandle;
 	libwiring->analogRead		= _analogRead;
 	libwiring->digitalWriteByte	= _digitalWriteByte;
 	libwiring->digitalReadByte	= _digitalReadByte;
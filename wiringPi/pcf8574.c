@@ -53,6 +53,7 @@ static void myPinMode (struct wiringPiNodeStruct *node, int pin, int mode)
 
   wiringPiI2CWrite (node->fd, old) ;
   node->data2 = old ;
+  __atomic_store_n (&node->snapValid, FALSE, __ATOMIC_RELEASE) ;
 }
 
 
@@ -74,8 +75,12 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
   else
     old |=   bit ;
 
-  wiringPiI2CWrite (node->fd, old) ;
   node->data2 = old ;
+  if (!wiringPiNodeDefer (node))
+  {
+    __atomic_store_n (&node->snapValid, FALSE, __ATOMIC_RELEASE) ;
+    wiringPiI2CWrite (node->fd, old) ;
+  }
 }
 
 
@@ -87,9 +92,16 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 {
   int mask, value ;
+  unsigned int snap ;
 
   mask  = 1 << ((pin - node->pinBase) & 7) ;
-  value = wiringPiI2CRead (node->fd) ;
+
+// A pin written low reads low whatever the snapshot says
+
+  if (wiringPiNodeSnapshot (node, &snap) == 0)
+    value = snap & node->data2 ;
+  else
+    value = wiringPiI2CRead (node->fd) ;
 
   if ((value & mask) == 0)
     return LOW ;
@@ -98,6 +110,33 @@ static int myDigitalRead (struct wiringPiNodeStruct *node, int pin)
 }
 
 
+/*
+ * myFlush: myRefresh:
+ *	Cache hooks, see wiringPiNodeBegin. The PCF8574 has one port register,
+ *	and its INT output fires on any input change without any setup.
+ *	Pins written high are inputs again, with levels no INT told us of,
+ *	so every write drops the snapshot.
+ *********************************************************************************
+ */
+
+static int myFlush (struct wiringPiNodeStruct *node)
+{
+  __atomic_store_n (&node->snapValid, FALSE, __ATOMIC_RELEASE) ;
+  return wiringPiI2CWrite (node->fd, node->data2) ;
+}
+
+static int myRefresh (struct wiringPiNodeStruct *node)
+{
+  int value ;
+
+  if ((value = wiringPiI2CRead (node->fd)) < 0)
+    return -1 ;
+
+  node->snapshot = value ;
+  return 0 ;
+}
+
+
 /*
  * pcf8574Setup:
  *	Create a new instance of a PCF8574 I2C GPIO interface. We know it
@@ -120,6 +159,8 @@ int pcf8574Setup (const int pinBase, const int i2cAddress)
   node->pinMode      = myPinMode ;
   node->digitalRead  = myDigitalRead ;
   node->digitalWrite = myDigitalWrite ;
+  node->flush        = myFlush ;
+  node->refresh      = myRefresh ;
   node->data2        = wiringPiI2CRead (fd) ;
 
   return TRUE ;
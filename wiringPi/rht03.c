@@ -25,116 +25,72 @@
 #include <sys/time.h>
 #include <stdio.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "wiringPi.h"
 #include "rht03.h"
 
-/*
- * maxDetectLowHighWait:
- *	Wait for a transition from low to high on the bus
- *********************************************************************************
- */
-
-static int maxDetectLowHighWait (const int pin)
-{
-  struct timeval now, timeOut, timeUp ;
-
-// If already high then wait for pin to go low
-
-  gettimeofday (&now, NULL) ;
-  timerclear   (&timeOut) ;
-  timeOut.tv_usec = 1000 ;
-  timeradd     (&now, &timeOut, &timeUp) ;
+// The sensor is woken by holding the line low (DHT11 wants 18mS), then
+//	answers with 80uS low, 80uS high and 40 bits: 50uS low, then high for
+//	26-28uS (0) or 70uS (1). The whole train is over in about 5mS.
 
-  while (digitalRead (pin) == HIGH)
-  {
-    gettimeofday (&now, NULL) ;
-    if (timercmp (&now, &timeUp, >))
-      return FALSE ;
-  }
+#define	RHT03_START_US		18000
+#define	RHT03_CAPTURE_US	6000
+#define	RHT03_MAX_EDGES		100
+#define	RHT03_ONE_NS		48000
+#define	RHT03_MAX_NS		100000
 
-// Wait for it to go HIGH
+#define	RHT03_TRIES		5
+#define	RHT03_BACKOFF_MS	50
 
-  gettimeofday (&now, NULL) ;
-  timerclear (&timeOut) ;
-  timeOut.tv_usec = 1000 ;
-  timeradd (&now, &timeOut, &timeUp) ;
-
-  while (digitalRead (pin) == LOW)
-  {
-    gettimeofday (&now, NULL) ;
-    if (timercmp (&now, &timeUp, >))
-      return FALSE ;
-  }
-
-  return TRUE ;
-}
+#define	RHT03_MAX_SAMPLERS	8
+#define	RHT03_MIN_PERIOD_MS	2000
 
 
 /*
- * maxDetectClockByte:
- *	Read in a single byte from the MaxDetect bus
- *********************************************************************************
- */
-
-static unsigned int maxDetectClockByte (const int pin)
-{
-  unsigned int byte = 0 ;
-  int bit ;
-
-  for (bit = 0 ; bit < 8 ; ++bit)
-  {
-    if (!maxDetectLowHighWait (pin))
-      return 0 ;
-
-// bit starting now - we need to time it.
-
-    delayMicroseconds (30) ;
-    byte <<= 1 ;
-    if (digitalRead (pin) == HIGH)	// It's a 1
-      byte |= 1 ;
-  }
-
-  return byte ;
-}
-
-
-/*
- * maxDetectRead:
- *	Read in and return the 4 data bytes from the MaxDetect sensor.
+ * rht03Read:
+ *	Wake the sensor, capture the edges of its answer and decode the
+ *	4 data bytes from the widths of the high pulses. Taking the last 40
+ *	means a missed wake-up edge doesn't matter, and a lost data edge
+ *	shows as two edges alike or a pulse too long to be one bit.
  *	Return TRUE/FALSE depending on the checksum validity
  *********************************************************************************
  */
 
-static int maxDetectRead (const int pin, unsigned char buffer [4])
+int rht03Read (const int piPin, unsigned char buffer [4])
 {
-  int i ;
-  unsigned int checksum ;
+  struct wiringPiEventStruct edges [RHT03_MAX_EDGES] ;
+  uint64_t widths [RHT03_MAX_EDGES / 2], lows [RHT03_MAX_EDGES / 2] ;
   unsigned char localBuf [5] ;
-  struct timeval now, then, took ;
-
-// See how long we took
-
-  gettimeofday (&then, NULL) ;
-
-// Wake up the RHT03 by pulling the data line low, then high
-//	Low for 10mS, high for 40uS.
+  unsigned int checksum ;
+  int i, n, highs = 0 ;
 
-  pinMode      (pin, OUTPUT) ;
-  digitalWrite (pin, 0) ; delay             (10) ;
-  digitalWrite (pin, 1) ; delayMicroseconds (40) ;
-  pinMode      (pin, INPUT) ;
+  if ((n = wiringPiCaptureEdges (piPin, RHT03_START_US, RHT03_CAPTURE_US, edges, RHT03_MAX_EDGES)) < 0)
+    return FALSE ;
 
-// Now wait for sensor to pull pin low
+  for (i = 1 ; i < n ; ++i)
+  {
+    if (edges [i].edge == edges [i - 1].edge)	// Lost one
+      return FALSE ;
+    if (edges [i].edge == INT_EDGE_FALLING)
+    {
+      lows   [highs]   = (i > 1) ? edges [i - 1].timestamp - edges [i - 2].timestamp : 0 ;
+      widths [highs++] = edges [i].timestamp - edges [i - 1].timestamp ;
+    }
+  }
 
-  if (!maxDetectLowHighWait (pin))
+  if (highs < 40)
     return FALSE ;
 
-// and read in 5 bytes (40 bits)
-
-  for (i = 0 ; i < 5 ; ++i)
-    localBuf [i] = maxDetectClockByte (pin) ;
+  memset (localBuf, 0, sizeof (localBuf)) ;
+  for (i = 0 ; i < 40 ; ++i)
+  {
+    if ((widths [highs - 40 + i] > RHT03_MAX_NS) || (lows [highs - 40 + i] > RHT03_MAX_NS))
+      return FALSE ;
+    localBuf [i / 8] = (localBuf [i / 8] << 1) | (widths [highs - 40 + i] > RHT03_ONE_NS) ;
+  }
 
   checksum = 0 ;
   for (i = 0 ; i < 4 ; ++i)
@@ -142,25 +98,8 @@ static int maxDetectRead (const int pin, unsigned char buffer [4])
     buffer [i] = localBuf [i] ;
     checksum += localBuf [i] ;
   }
-  checksum &= 0xFF ;
-
-// See how long we took
-  
-  gettimeofday (&now, NULL) ;
-  timersub (&now, &then, &took) ;
-
-// Total time to do this should be:
-//	10mS + 40µS - reset
-//	+ 80µS + 80µS - sensor doing its low -> high thing
-//	+ 40 * (50µS + 27µS (0) or 70µS (1) )
-//	= 15010µS
-// so if we take more than that, we've had a scheduling interruption and the
-// reading is probably bogus.
-
-  if ((took.tv_sec != 0) || (took.tv_usec > 16000))
-    return FALSE ;
 
-  return checksum == localBuf [4] ;
+  return (checksum & 0xFF) == localBuf [4] ;
 }
 
 
@@ -178,7 +117,7 @@ static int myReadRHT03 (const int pin, int *temp, int *rh)
 
 // Read ...
   
-  result = maxDetectRead (pin, buffer) ;
+  result = rht03Read (pin, buffer) ;
 
   if (!result)
     return FALSE ;
@@ -202,6 +141,29 @@ static int myReadRHT03 (const int pin, int *temp, int *rh)
 }
 
 
+/*
+ * readRetry:
+ *	A failed read is usually a busy CPU or a sensor still recovering from
+ *	the last one, so back off a little longer each time before retrying.
+ *********************************************************************************
+ */
+
+static int readRetry (const int pin, int *temp, int *rh)
+{
+  int try, backoff = RHT03_BACKOFF_MS ;
+
+  for (try = 0 ; try < RHT03_TRIES ; ++try)
+  {
+    if (myReadRHT03 (pin, temp, rh))
+      return TRUE ;
+    delay (backoff) ;
+    backoff *= 2 ;
+  }
+
+  return FALSE ;
+}
+
+
 /*
  * myAnalogRead:
  *********************************************************************************
@@ -213,18 +175,69 @@ static int myAnalogRead (struct wiringPiNodeStruct *node, int pin)
   int chan  = pin - node->pinBase ;
   int temp  = -9997 ;
   int rh    = -9997 ;
-  int try ;
 
   if (chan > 1)
     return -9999 ;	// Bad parameters
 
-  for (try = 0 ; try < 10 ; ++try)
+  if (readRetry (piPin, &temp, &rh))
+    return chan == 0 ? temp : rh ;
+
+  return -9998 ;
+}
+
+
+/*
+ * Periodic sampling:
+ *	A thread per sensor reads it every period and analogRead returns the
+ *	last good reading without waiting, -9997 until there is one.
+ *********************************************************************************
+ */
+
+struct rht03Sampler
+{
+  int piPin ;
+  int periodMs ;
+  int temp, rh ;
+  pthread_mutex_t lock ;
+} ;
+
+static struct rht03Sampler samplers [RHT03_MAX_SAMPLERS] ;
+static int numSamplers ;
+
+static void *samplerThread (void *arg)
+{
+  struct rht03Sampler *s = (struct rht03Sampler *)arg ;
+  int temp, rh ;
+
+  for (;;)
   {
-    if (myReadRHT03 (piPin, &temp, &rh))
-      return chan == 0 ? temp : rh ;
+    if (readRetry (s->piPin, &temp, &rh))
+    {
+      pthread_mutex_lock (&s->lock) ;
+	s->temp = temp ;
+	s->rh   = rh ;
+      pthread_mutex_unlock (&s->lock) ;
+    }
+    delay (s->periodMs) ;
   }
 
-  return -9998 ;
+  return NULL ;
+}
+
+static int mySampledRead (struct wiringPiNodeStruct *node, int pin)
+{
+  struct rht03Sampler *s = &samplers [node->data0] ;
+  int chan = pin - node->pinBase ;
+  int value ;
+
+  if (chan > 1)
+    return -9999 ;	// Bad parameters
+
+  pthread_mutex_lock (&s->lock) ;
+    value = (chan == 0) ? s->temp : s->rh ;
+  pthread_mutex_unlock (&s->lock) ;
+
+  return value ;
 }
 
 
@@ -250,3 +263,44 @@ int rht03Setup (const int pinBase, const int piPin)
 
   return TRUE ;
 }
+
+
+/*
+ * rht03SetupPeriodic:
+ *	As rht03Setup, but the sensor is read every periodMs in the background
+ *	(at least every 2 seconds, the sensor can't go faster) and analogRead
+ *	never blocks.
+ *********************************************************************************
+ */
+
+int rht03SetupPeriodic (const int pinBase, const int piPin, const int periodMs)
+{
+  struct wiringPiNodeStruct *node ;
+  struct rht03Sampler *s ;
+  pthread_t thread ;
+
+  if ((piPin & PI_GPIO_MASK) != 0)	// Must be an on-board pin
+    return FALSE ;
+
+  if (numSamplers == RHT03_MAX_SAMPLERS)
+    return FALSE ;
+
+  s = &samplers [numSamplers] ;
+  s->piPin    = piPin ;
+  s->periodMs = (periodMs < RHT03_MIN_PERIOD_MS) ? RHT03_MIN_PERIOD_MS : periodMs ;
+  s->temp     = -9997 ;
+  s->rh       = -9997 ;
+  pthread_mutex_init (&s->lock, NULL) ;
+
+  if (pthread_create (&thread, NULL, samplerThread, s) != 0)
+    return FALSE ;
+  pthread_detach (thread) ;
+
+  node = wiringPiNewNode (pinBase, 2) ;
+
+  node->fd         = piPin ;
+  node->data0      = numSamplers++ ;
+  node->analogRead = mySampledRead ;
+
+  return TRUE ;
+}
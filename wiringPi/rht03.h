@@ -22,4 +22,6 @@
  ***********************************************************************
  */
 
-extern int rht03Setup (const int pinBase, const int devicePin) ;
+extern int rht03Read          (const int piPin, unsigned char buffer [4]) ;
+extern int rht03Setup         (const int pinBase, const int devicePin) ;
+extern int rht03SetupPeriodic (const int pinBase, const int devicePin, const int periodMs) ;
@@ -23,6 +23,9 @@
  */
 
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
 #include <malloc.h>
 #include <pthread.h>
 
@@ -49,13 +52,45 @@
 //
 //	Another way to increase the frequency is to reduce the range - however
 //	that reduces the overall output accuracy...
+//
+//	The pulse time can be changed with softPwmSetup () before any channel
+//	is created.
 
 #define	PULSE_TIME	100
 
 static volatile int marks         [MAX_PINS] ;
 static volatile int range         [MAX_PINS] ;
 static volatile pthread_t threads [MAX_PINS] ;
-static volatile int newPin = -1 ;
+
+static int pwmMode  = SOFT_PWM_THREADED ;
+static int pwmPulse = PULSE_TIME ;		// µS per step of the range
+
+// SOFT_PWM_SHARED:
+//	One scheduler thread for every channel. All channels count the same
+//	ticks of pwmPulse µS; each one only wakes the scheduler at its own
+//	edges (start of period, end of mark), and the pins changing on the same
+//	tick are written together through port groups, one write per register.
+
+#define	GROUP_PINS	WPI_PORT_MAX_PINS
+#define	MAX_GROUPS	((MAX_PINS + GROUP_PINS - 1) / GROUP_PINS)
+
+struct pwmChannel
+{
+  int      group, bit ;		// Where the pin lives in groups []
+  int      falling ;		// A falling edge is due at nextTick
+  uint64_t periodTick ;		// Tick the current period started on
+  uint64_t nextTick ;		// Next edge of the channel
+} ;
+
+static struct pwmChannel channels [MAX_PINS] ;
+static struct wiringPiPortGroup groups [MAX_GROUPS] ;
+static int      numGroups ;
+
+static pthread_mutex_t sharedLock = PTHREAD_MUTEX_INITIALIZER ;
+static pthread_cond_t  sharedCond ;
+static pthread_t       sharedThread ;
+static int      sharedRunning ;
+static uint64_t sharedEpoch ;		// nS, tick 0
 
 
 /*
@@ -75,9 +110,6 @@ static void *softPwmThread (void *arg)
   pin = *((int *)arg) ;
   free (arg) ;
 
-  pin    = newPin ;
-  newPin = -1 ;
-
   piHiPri (90) ;
 
   for (;;)
@@ -87,17 +119,208 @@ static void *softPwmThread (void *arg)
 
     if (mark != 0)
       digitalWrite (pin, HIGH) ;
-    delayMicroseconds (mark * 100) ;
+    delayMicroseconds (mark * pwmPulse) ;
 
     if (space != 0)
       digitalWrite (pin, LOW) ;
-    delayMicroseconds (space * 100) ;
+    delayMicroseconds (space * pwmPulse) ;
   }
 
   return NULL ;
 }
 
 
+/*
+ * sharedRegroup:
+ *	Rebuild the port groups from the running channels.
+ *	Called with sharedLock held.
+ *********************************************************************************
+ */
+
+static void sharedRegroup (void)
+{
+  int pins [MAX_GROUPS][GROUP_PINS] ;
+  int count [MAX_GROUPS] ;
+  int pin, g ;
+
+  memset (count, 0, sizeof (count)) ;
+  numGroups = 0 ;
+
+  for (pin = 0 ; pin < MAX_PINS ; ++pin)
+  {
+    if (range [pin] == 0)
+      continue ;
+
+    g = numGroups - 1 ;
+    if ((g < 0) || (count [g] == GROUP_PINS))
+      g = numGroups++ ;
+
+    channels [pin].group = g ;
+    channels [pin].bit   = count [g] ;
+    pins [g][count [g]++] = pin ;
+  }
+
+  for (g = 0 ; g < numGroups ; ++g)
+    wiringPiPortGroupInit (&groups [g], pins [g], count [g]) ;
+}
+
+
+/*
+ * softPwmSharedThread:
+ *	Sleep to the nearest edge of all the channels, then write every pin
+ *	that changes on that tick.
+ *********************************************************************************
+ */
+
+static void *softPwmSharedThread (UNU void *arg)
+{
+  struct pwmChannel *c ;
+  struct timespec ts ;
+  uint32_t set [MAX_GROUPS], used [MAX_GROUPS] ;
+  uint64_t tick, deadline, pulseNs ;
+  int pin, mark, g ;
+
+  piHiPri (90) ;
+
+  pthread_mutex_lock (&sharedLock) ;
+
+  for (;;)
+  {
+    pulseNs = (uint64_t)pwmPulse * 1000 ;
+
+// Nearest edge
+
+    tick = UINT64_MAX ;
+    for (pin = 0 ; pin < MAX_PINS ; ++pin)
+      if ((range [pin] != 0) && (channels [pin].nextTick < tick))
+	tick = channels [pin].nextTick ;
+
+    if (tick == UINT64_MAX)
+    {
+      pthread_cond_wait (&sharedCond, &sharedLock) ;
+      continue ;
+    }
+
+    deadline = sharedEpoch + tick * pulseNs ;
+    if (deadline > wiringPiMonotonicNs ())
+    {
+      ts.tv_sec  = deadline / 1000000000ULL ;
+      ts.tv_nsec = deadline % 1000000000ULL ;
+      pthread_cond_timedwait (&sharedCond, &sharedLock, &ts) ;
+      continue ;	// Channels may have changed while we slept
+    }
+
+// Collect every pin with an edge on this tick
+
+    memset (set,  0, sizeof (set)) ;
+    memset (used, 0, sizeof (used)) ;
+
+    for (pin = 0 ; pin < MAX_PINS ; ++pin)
+    {
+      c = &channels [pin] ;
+      if ((range [pin] == 0) || (c->nextTick != tick))
+	continue ;
+
+      g = c->group ;
+      used [g] |= 1U << c->bit ;
+
+      if (c->falling)		// End of the mark
+      {
+	c->falling  = FALSE ;
+	c->nextTick = c->periodTick + range [pin] ;
+	continue ;
+      }
+
+      // Start of a period, pick up the latest value
+      mark = marks [pin] ;
+      c->periodTick = tick ;
+      if (mark > 0)
+	set [g] |= 1U << c->bit ;
+      c->falling  = (mark > 0) && (mark < range [pin]) ;
+      c->nextTick = tick + (c->falling ? mark : range [pin]) ;
+    }
+
+    for (g = 0 ; g < numGroups ; ++g)
+      if (used [g])
+	digitalWritePortMasked (&groups [g], set [g], used [g]) ;
+  }
+
+  return NULL ;
+}
+
+
+/*
+ * softPwmSharedCreate:
+ *	Add a channel to the shared scheduler, starting it if needed.
+ *********************************************************************************
+ */
+
+static int softPwmSharedCreate (int pin, int initialValue, int pwmRange)
+{
+  pthread_condattr_t attr ;
+  int res = 0 ;
+
+  pthread_mutex_lock (&sharedLock) ;
+
+  if (!sharedRunning)
+  {
+    pthread_condattr_init (&attr) ;
+    pthread_condattr_setclock (&attr, CLOCK_MONOTONIC) ;
+    pthread_cond_init (&sharedCond, &attr) ;
+    pthread_condattr_destroy (&attr) ;
+
+    sharedEpoch = wiringPiMonotonicNs () ;
+
+    if ((res = pthread_create (&sharedThread, NULL, softPwmSharedThread, NULL)) != 0)
+    {
+      pthread_mutex_unlock (&sharedLock) ;
+      return res ;
+    }
+    sharedRunning = TRUE ;
+  }
+
+  marks [pin] = initialValue ;
+  range [pin] = pwmRange ;
+
+  channels [pin].falling  = FALSE ;
+  channels [pin].nextTick = (wiringPiMonotonicNs () - sharedEpoch) / ((uint64_t)pwmPulse * 1000) + 1 ;
+  sharedRegroup () ;
+
+  pthread_cond_signal (&sharedCond) ;
+  pthread_mutex_unlock (&sharedLock) ;
+
+  return 0 ;
+}
+
+
+/*
+ * softPwmSetup:
+ *	Choose how channels are run and the length of one step of the range
+ *	in µS. Only possible while no channel is running.
+ *********************************************************************************
+ */
+
+int softPwmSetup (int mode, int pulseTime)
+{
+  int pin ;
+
+  if ((mode != SOFT_PWM_THREADED) && (mode != SOFT_PWM_SHARED))
+    return -1 ;
+
+  if (pulseTime <= 0)
+    return -1 ;
+
+  for (pin = 0 ; pin < MAX_PINS ; ++pin)
+    if (range [pin] != 0)
+      return -1 ;
+
+  pwmMode  = mode ;
+  pwmPulse = pulseTime ;
+
+  return 0 ;
+}
+
+
 /*
  * softPwmWrite:
  *	Write a PWM value to the given pin
@@ -139,22 +362,27 @@ int softPwmCreate (int pin, int initialValue, int pwmRange)
   if (pwmRange <= 0)
     return -1 ;
 
+  digitalWrite (pin, LOW) ;
+  pinMode      (pin, OUTPUT) ;
+
+  if (pwmMode == SOFT_PWM_SHARED)
+    return softPwmSharedCreate (pin, initialValue, pwmRange) ;
+
   passPin = malloc (sizeof (*passPin)) ;
   if (passPin == NULL)
     return -1 ;
 
-  digitalWrite (pin, LOW) ;
-  pinMode      (pin, OUTPUT) ;
-
   marks [pin] = initialValue ;
   range [pin] = pwmRange ;
 
   *passPin = pin ;
-  newPin   = pin ;
   res      = pthread_create (&myThread, NULL, softPwmThread, (void *)passPin) ;
-
-  while (newPin != -1)
-    delay (1) ;
+  if (res != 0)
+  {
+    free (passPin) ;
+    range [pin] = 0 ;
+    return res ;
+  }
 
   threads [pin] = myThread ;
 
@@ -174,6 +402,16 @@ void softPwmStop (int pin)
   {
     if (range [pin] != 0)
     {
+      if (pwmMode == SOFT_PWM_SHARED)
+      {
+	pthread_mutex_lock (&sharedLock) ;
+	range [pin] = 0 ;
+	sharedRegroup () ;
+	pthread_mutex_unlock (&sharedLock) ;
+	digitalWrite (pin, LOW) ;
+	return ;
+      }
+
 #ifdef ANDROID
       int status;
       if ( (status = pthread_kill(pin, SIGUSR1)) != 0)
@@ -26,6 +26,11 @@
 extern "C" {
 #endif
 
+// softPwmSetup modes
+#define	SOFT_PWM_THREADED	0	// One thread per pin
+#define	SOFT_PWM_SHARED		1	// One scheduler thread for all pins
+
+extern int  softPwmSetup  (int mode, int pulseTime) ;
 extern int  softPwmCreate (int pin, int value, int range) ;
 extern void softPwmWrite  (int pin, int value) ;
 extern void softPwmStop   (int pin) ;
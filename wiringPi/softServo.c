@@ -24,10 +24,8 @@
  */
 
 //#include <stdio.h>
+#include <stdint.h>
 #include <string.h>
-#include <time.h>
-#include <sys/time.h>
-#include <pthread.h>
 
 #include "wiringPi.h"
 #include "softServo.h"
@@ -54,102 +52,60 @@
 //	the multipexing, but it does need to be at least 10mS, and preferably 16
 //	from what I've been able to determine.
 
-// WARNING:
-//	This code is really experimental. It was written in response to some people
-//	asking for a servo driver, however while it works, there is too much
-//	jitter to successfully drive a small servo - I have tried it with a micro
-//	servo and it worked, but the servo ran hot due to the jitter in the signal
-//	being sent to it.
-//
-//	If you want servo control for the Pi, then use the servoblaster kernel
-//	module.
+// The pulses are played by the wiringPi wave engine: one wave over all the
+//	servo pins, raising them together at the start of each slot and
+//	dropping each one at its own deadline, so there is no sleep jitter
+//	added to the pulse widths.
 
 #define	MAX_SERVOS	8
 
+// Slot width in nS
+#define	SERVO_PERIOD	8000000ULL
+
 static int pinMap     [MAX_SERVOS] ;	// Keep track of our pins
 static int pulseWidth [MAX_SERVOS] ;	// microseconds
+static int waveBit    [MAX_SERVOS] ;	// bit of the servo in the wave
+
+static struct wiringPiWave *servoWave ;
 
 
 /*
- * softServoThread:
- *	Thread to do the actual Servo PWM output
+ * softServoLoad:
+ *	Turn the pulse widths into wave steps: all on, then each servo off
+ *	in order of its width.
  *********************************************************************************
  */
 
-static PI_THREAD (softServoThread)
+static int softServoLoad (void)
 {
-  register int i, j, k, m, tmp ;
-  int lastDelay, pin, servo ;
-
-  int myDelays [MAX_SERVOS] ;
-  int myPins   [MAX_SERVOS] ;
+  struct wiringPiWaveStep steps [MAX_SERVOS + 1], tmp ;
+  int i, n, servo ;
 
-  struct timeval  tNow, tStart, tPeriod, tGap, tTotal ;
-  struct timespec tNs ;
+  steps [0].offset = 0 ;
+  steps [0].set    = 0 ;
+  steps [0].clear  = 0 ;
+  n = 1 ;
 
-  tTotal.tv_sec  =    0 ;
-  tTotal.tv_usec = 8000 ;
-
-  piHiPri (50) ;
-
-  for (;;)
+  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
   {
-    gettimeofday (&tStart, NULL) ;
-
-    memcpy (myDelays, pulseWidth, sizeof (myDelays)) ;
-    memcpy (myPins,   pinMap,     sizeof (myPins)) ;
-
-// Sort the delays (& pins), shortest first
-
-    for (m = MAX_SERVOS / 2 ; m > 0 ; m /= 2 )
-      for (j = m ; j < MAX_SERVOS ; ++j)
-	for (i = j - m ; i >= 0 ; i -= m)
-	{
-	  k = i + m ;
-	  if (myDelays [k] >= myDelays [i])
-	    break ;
-	  else // Swap
-	  {
-	    tmp = myDelays [i] ; myDelays [i] = myDelays [k] ; myDelays [k] = tmp ;
-	    tmp = myPins   [i] ; myPins   [i] = myPins   [k] ; myPins   [k] = tmp ;
-	  }
-	}
-
-// All on
-
-    lastDelay = 0 ;
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
-    {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
+    if (pinMap [servo] == -1)
+      continue ;
 
-      digitalWrite (pin, HIGH) ;
-      myDelays [servo] = myDelays [servo] - lastDelay ;
-      lastDelay += myDelays [servo] ;
-    }
+    steps [0].set     |= 1 << waveBit [servo] ;
+    steps [n].offset   = (uint64_t)pulseWidth [servo] * 1000 ;
+    steps [n].set      = 0 ;
+    steps [n].clear    = 1 << waveBit [servo] ;
 
-// Now loop, turning them all off as required
+// Insertion sort, shortest first
 
-    for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+    for (i = n ; i > 1 && steps [i].offset < steps [i - 1].offset ; --i)
     {
-      if ((pin = myPins [servo]) == -1)
-	continue ;
-
-      delayMicroseconds (myDelays [servo]) ;
-      digitalWrite (pin, LOW) ;
+      tmp = steps [i] ; steps [i] = steps [i - 1] ; steps [i - 1] = tmp ;
     }
-
-// Wait until the end of an 8mS time-slot
-
-    gettimeofday (&tNow, NULL) ;
-    timersub (&tNow, &tStart, &tPeriod) ;
-    timersub (&tTotal, &tPeriod, &tGap) ;
-    tNs.tv_sec  = tGap.tv_sec ;
-    tNs.tv_nsec = tGap.tv_usec * 1000 ;
-    nanosleep (&tNs, NULL) ;
+    ++n ;
   }
 
-  return NULL ;
+  return wiringPiWaveLoad (servoWave, steps, n, SERVO_PERIOD) ;
 }
 
 
@@ -173,6 +129,9 @@ void softServoWrite (int servoPin, int value)
   for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
     if (pinMap [servo] == servoPin)
       pulseWidth [servo] = value + 1000 ; // uS
+
+  if (servoWave != NULL)
+    softServoLoad () ;
 }
 
 
@@ -184,7 +143,13 @@ void softServoWrite (int servoPin, int value)
 
 int softServoSetup (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int p7)
 {
-  int servo ;
+  int pins [MAX_SERVOS] ;
+  int servo, n ;
+
+// Already running: leave its pins alone
+
+  if (servoWave != NULL)
+    return -1 ;
 
   if (p0 != -1) { pinMode (p0, OUTPUT) ; digitalWrite (p0, LOW) ; }
   if (p1 != -1) { pinMode (p1, OUTPUT) ; digitalWrite (p1, LOW) ; }
@@ -204,8 +169,28 @@ int softServoSetup (int p0, int p1, int p2, int p3, int p4, int p5, int p6, int
   pinMap [6] = p6 ;
   pinMap [7] = p7 ;
 
-  for (servo = 0 ; servo < MAX_SERVOS ; ++servo)
+  for (servo = 0, n = 0 ; servo < MAX_SERVOS ; ++servo)
+  {
     pulseWidth [servo] = 1500 ;		// Mid point
-  
-  return piThreadCreate (softServoThread) ;
+    if (pinMap [servo] != -1)
+    {
+      waveBit [servo] = n ;
+      pins [n++] = pinMap [servo] ;
+    }
+  }
+
+  if (n == 0)
+    return -1 ;
+
+  if ((servoWave = wiringPiWaveCreate (pins, n)) == NULL)
+    return -1 ;
+
+  if ((softServoLoad () < 0) || (wiringPiWaveStart (servoWave) < 0))
+  {
+    wiringPiWaveFree (servoWave) ;
+    servoWave = NULL ;
+    return -1 ;
+  }
+
+  return 0 ;
 }
@@ -34,52 +34,10 @@
 
 #define	MAX_PINS	64
 
-#define	PULSE_TIME	100
+// Each tone is a two step wave on the wiringPi wave engine, so all tones
+//	share one real-time thread and their edges land on absolute deadlines.
 
-static int freqs         [MAX_PINS] ;
-static pthread_t threads [MAX_PINS] ;
-
-static int newPin = -1 ;
-
-
-/*
- * softToneThread:
- *	Thread to do the actual PWM output
- *********************************************************************************
- */
-
-static PI_THREAD (softToneThread)
-{
-  int pin, freq, halfPeriod ;
-  struct sched_param param ;
-
-  param.sched_priority = sched_get_priority_max (SCHED_RR) ;
-  pthread_setschedparam (pthread_self (), SCHED_RR, &param) ;
-
-  pin    = newPin ;
-  newPin = -1 ;
-
-  piHiPri (50) ;
-
-  for (;;)
-  {
-    freq = freqs [pin] ;
-    if (freq == 0)
-      delay (1) ;
-    else
-    {
-      halfPeriod = 500000 / freq ;
-
-      digitalWrite (pin, HIGH) ;
-      delayMicroseconds (halfPeriod) ;
-
-      digitalWrite (pin, LOW) ;
-      delayMicroseconds (halfPeriod) ;
-    }
-  }
-
-  return NULL ;
-}
+static struct wiringPiWave *waves [MAX_PINS] ;
 
 
 /*
@@ -90,6 +48,9 @@ static PI_THREAD (softToneThread)
 
 void softToneWrite (int pin, int freq)
 {
+  struct wiringPiWaveStep steps [2] ;
+  uint64_t period ;
+
   pin &= 63 ;
 
   /**/ if (freq < 0)
@@ -97,62 +58,69 @@ void softToneWrite (int pin, int freq)
   else if (freq > 5000)	// Max 5KHz
     freq = 5000 ;
 
-  freqs [pin] = freq ;
+  if (waves [pin] == NULL)
+    return ;
+
+  if (freq == 0)
+  {
+    wiringPiWaveStop (waves [pin]) ;
+    digitalWrite (pin, LOW) ;
+    return ;
+  }
+
+  period = 1000000000ULL / freq ;
+
+  steps [0].offset = 0 ;
+  steps [0].set    = 1 ;
+  steps [0].clear  = 0 ;
+  steps [1].offset = period / 2 ;
+  steps [1].set    = 0 ;
+  steps [1].clear  = 1 ;
+
+  if (wiringPiWaveLoad (waves [pin], steps, 2, period) == 0)
+    wiringPiWaveStart (waves [pin]) ;
 }
 
 
 /*
  * softToneCreate:
- *	Create a new tone thread.
+ *	Create a new tone on the wave engine.
  *********************************************************************************
  */
 
 int softToneCreate (int pin)
 {
-  int res ;
-  pthread_t myThread ;
+  if ((pin < 0) || (pin >= MAX_PINS))
+    return -1 ;
 
   pinMode      (pin, OUTPUT) ;
   digitalWrite (pin, LOW) ;
 
-  if (threads [pin] != 0)
+  if (waves [pin] != NULL)
     return -1 ;
 
-  freqs [pin] = 0 ;
-
-  newPin = pin ;
-  res    = pthread_create (&myThread, NULL, softToneThread, NULL) ;
-
-  while (newPin != -1)
-    delay (1) ;
-
-  threads [pin] = myThread ;
+  if ((waves [pin] = wiringPiWaveCreate (&pin, 1)) == NULL)
+    return -1 ;
 
-  return res ;
+  return 0 ;
 }
 
 
 /*
  * softToneStop:
- *	Stop an existing softTone thread
+ *	Stop an existing softTone
  *********************************************************************************
  */
 
 void softToneStop (int pin)
 {
-  if (threads [pin] != 0)
+  if ((pin < 0) || (pin >= MAX_PINS))
+    return ;
+
+  if (waves [pin] != NULL)
   {
-#ifdef ANDROID
-      int status;
-      if ( (status = pthread_kill(pin, SIGUSR1)) != 0)
-      {
-        printf("Error cancelling thread %d", pin);
-      }
-#else
-      pthread_cancel (threads [pin]) ;
-#endif
-    pthread_join   (threads [pin], NULL) ;
-    threads [pin] = 0 ;
+    wiringPiWaveFree (waves [pin]) ;
+    waves [pin] = NULL ;
     digitalWrite (pin, LOW) ;
   }
 }
@@ -31,9 +31,39 @@
 #include <stdint.h>
 
 #include "wiringPi.h"
+#include "wiringShift.h"
 
 #include "sr595.h"
 
+// Chains are clocked through the shift engine; node->fd indexes shifters.
+//	The 74HC595 needs about 100nS of setup and clock width at 2V.
+
+#define	MAX_SR595	16
+#define	SR595_NS	100
+
+static struct wiringShift *shifters [MAX_SR595] ;
+static int numShifters ;
+
+
+/*
+ * shiftChain:
+ *	Words of up to 8 and 16 bits are held in uint8_t and uint16_t.
+ *********************************************************************************
+ */
+
+static void shiftChain (struct wiringShift *sh, int bits, uint32_t output)
+{
+  uint8_t  w8  = output ;
+  uint16_t w16 = output ;
+
+  if (bits <= 8)
+    shiftWrite (sh, &w8, 1) ;
+  else if (bits <= 16)
+    shiftWrite (sh, &w16, 1) ;
+  else
+    shiftWrite (sh, &output, 1) ;
+}
+
 
 /*
  * myDigitalWrite:
@@ -43,13 +73,10 @@
 static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 {
   unsigned int mask ;
-  int  dataPin, clockPin, latchPin ;
-  int  bit, bits, output ;
+  int  latchPin, bits, output ;
 
   pin     -= node->pinBase ;				// Normalise pin number
   bits     = node->pinMax - node->pinBase + 1 ;		// ie. number of clock pulses
-  dataPin  = node->data0 ;
-  clockPin = node->data1 ;
   latchPin = node->data2 ;
   output   = node->data3 ;
 
@@ -65,13 +92,7 @@ static void myDigitalWrite (struct wiringPiNodeStruct *node, int pin, int value)
 // A low -> high latch transition copies the latch to the output pins
 
   digitalWrite (latchPin, LOW) ; delayMicroseconds (1) ;
-    for (bit = bits - 1 ; bit >= 0 ; --bit)
-    {
-      digitalWrite (dataPin, output & (1 << bit)) ;
-
-      digitalWrite (clockPin, HIGH) ; delayMicroseconds (1) ;
-      digitalWrite (clockPin, LOW) ;  delayMicroseconds (1) ;
-    }
+    shiftChain (shifters [node->fd], bits, output) ;
   digitalWrite (latchPin, HIGH) ; delayMicroseconds (1) ;
 }
 
@@ -86,9 +107,20 @@ int sr595Setup (const int pinBase, const int numPins,
 	const int dataPin, const int clockPin, const int latchPin) 
 {
   struct wiringPiNodeStruct *node ;
+  struct wiringShift *sh ;
+
+  if (numShifters == MAX_SR595)
+    return FALSE ;
+
+// The whole chain is one word of numPins bits
+
+  if ((sh = shiftSetup (&dataPin, 1, clockPin, MSBFIRST, numPins, SR595_NS, SR595_NS)) == NULL)
+    return FALSE ;
 
   node = wiringPiNewNode (pinBase, numPins) ;
 
+  shifters [numShifters] = sh ;
+  node->fd              = numShifters++ ;
   node->data0           = dataPin ;
   node->data1           = clockPin ;
   node->data2           = latchPin ;
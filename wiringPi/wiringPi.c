@@ -119,10 +119,6 @@ const int piMemorySize [8] =
 	0,		//	 7
 } ;
 
-/*----------------------------------------------------------------------------*/
-// Misc
-static pthread_mutex_t pinMutex ;
-
 /*----------------------------------------------------------------------------*/
 #ifdef __ANDROID__
 int pthread_cancel(pthread_t h) {
@@ -140,6 +136,61 @@ int wiringPiSetuped     = FALSE ;
 // ODROID Wiring Library
 struct libodroid	libwiring;
 
+// Pin handles resolved by pinMode for digitalWrite/digitalRead,
+//	indexed by the pin number of the current setup mode.
+#define	PIN_HANDLE_MAX	512
+static struct wiringPiPinHandle pinHandles [PIN_HANDLE_MAX];
+
+// Extension nodes by pin, indexed from NODE_PIN_BASE. The table is replaced,
+//	never resized in place, by wiringPiNewNode; superseded tables are kept
+//	since a core call may still be reading one.
+#define	NODE_PIN_BASE	64
+static struct wiringPiNodeStruct **nodeTable;
+static unsigned int	nodeTableSize;
+
+// Output register shadows, shared by every handle on the same register.
+//	Entries are never removed; the register mappings live as long as the
+//	process does.
+static struct wiringPiBankStruct banks [WPI_BANK_MAX];
+static int		numBanks;
+static int		bankShadowed;
+static pthread_mutex_t	bankMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Bank locks shared between processes, in a shared memory page. Registers
+//	hash onto BANK_LOCKS robust, priority inheriting mutexes by their
+//	offset in the page, so a process that dies holding one doesn't stop
+//	the others. ready is set by the process that created the page once
+//	the mutexes are usable.
+#define	BANK_LOCK_SHM	"/wiringPi-banks"
+#define	BANK_LOCKS	64
+
+struct bankLockPage {
+	uint32_t	ready;
+	pthread_mutex_t	lock [BANK_LOCKS];
+};
+
+static struct bankLockPage *bankLocks;
+
+// delayMicroseconds and the wave engine spin for the last delaySlack nS
+//	instead of trusting the scheduler to wake them on time. Measured at
+//	setup by calibrateDelay.
+#define	DELAY_CAL_LOOPS		16
+#define	DELAY_CAL_SLEEP_NS	50000ULL
+#define	DELAY_CAL_MARGIN_NS	2000ULL
+#define	DELAY_SLACK_MAX_NS	200000ULL
+
+static uint64_t		delaySlack = 100000ULL;
+
+// Timebase for nanos64. countMult is nS per counter tick in 32.32 fixed
+//	point, 0 when CLOCK_MONOTONIC is used instead of the counter.
+#define	COUNTER_CAL_NS		2000000ULL
+
+static uint64_t		epochNs;
+static uint64_t		countMult;
+#if defined(__aarch64__)
+static uint64_t		epochCount;
+#endif
+
 // Current kernel version
 struct kernelVersionStruct *kernelVersion = &(struct kernelVersionStruct) {
 	.major = 0,
@@ -289,6 +340,181 @@ int inputToSysNode (const char* sysPath, const char* node, char* data) {
 	return 0;
 }
 
+/*----------------------------------------------------------------------------*/
+// Meson PWM clock when the channel runs from the crystal (CLK_SEL 0)
+#define	MESON_PWM_XTAL_HZ	24000000ULL
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiPwmChannelOpen:
+ *	Keep the duty_cycle attribute of an exported and enabled PWM output
+ *	open, and, when running as root with a known register layout, map the
+ *	channel registers at regAddr and read back the period the kernel set.
+ *	Called again after every period change.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiPwmChannelOpen (struct wiringPiPwmChannel *ch, const char *pwmPinPath,
+				unsigned long regAddr, int style, unsigned int periodNs)
+{
+	char path[(BLOCK_SIZE * 2)];
+	void *mapped;
+	uint64_t ticks;
+	uint32_t misc, div;
+	int fd, chan;
+
+	if (ch->dutyFd == -1) {
+		sprintf(path, "%s/duty_cycle", pwmPinPath);
+		if ((ch->dutyFd = open(path, O_WRONLY | O_CLOEXEC)) < 0) {
+			fprintf(stderr, "sys: Unable to open %s: %s\n",
+					path, strerror (errno));
+			ch->dutyFd = -1;
+			return -errno;
+		}
+	}
+	ch->periodNs  = periodNs;
+	ch->style     = style;
+	ch->dutyNs    = ~0U;
+	ch->sysDutyNs = ~0U;
+
+	if ((ch->mapped == NULL) && (style != WPI_PWM_REG_NONE) && (regAddr != 0) && !getuid()) {
+		if ((fd = open("/dev/mem", O_RDWR | O_SYNC | O_CLOEXEC)) >= 0) {
+#if defined(ANDROID) && !defined(__aarch64__)
+			mapped = mmap64(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd,
+					(off64_t)(regAddr & ~(BLOCK_SIZE - 1)));
+#else
+			mapped = mmap(0, BLOCK_SIZE, PROT_READ|PROT_WRITE, MAP_SHARED, fd,
+					(off_t)(regAddr & ~(BLOCK_SIZE - 1)));
+#endif
+			close(fd);
+			if (mapped != MAP_FAILED)
+				ch->mapped = (volatile uint32_t *)mapped;
+		}
+	}
+
+	ch->reg    = NULL;
+	ch->counts = 0;
+	if (ch->mapped == NULL)
+		return 0;
+
+	// The kernel has programmed the period; take its tick count from the block
+	switch (style) {
+	case WPI_PWM_REG_MESON:
+		// Not from the duty word, whose hi/lo the kernel stores in more
+		//	than one way: from the clock divider it chose for periodNs.
+		//	Channel 1 sits one word after channel 0, MISC two words on.
+		ch->reg = ch->mapped + ((regAddr & (BLOCK_SIZE - 1)) >> 2);
+		chan = (regAddr >> 2) & 1;
+		misc = *(ch->reg - chan + 2);
+		if (((misc >> (4 + 2 * chan)) & 3) != 0)	// Not the crystal, rate unknown
+			break;
+		div   = ((misc >> (8 + 8 * chan)) & 0x7F) + 1;
+		ticks = (MESON_PWM_XTAL_HZ * periodNs) / (div * 1000000000ULL);
+		if (ticks >= 2 && ticks <= 0xFFFF)
+			ch->counts = ticks;
+		break;
+	case WPI_PWM_REG_ROCKCHIP:
+		// CNT, PERIOD_HPR, DUTY_LPR, CTRL
+		ch->reg = ch->mapped + ((regAddr & (BLOCK_SIZE - 1)) >> 2) + 2;
+		ch->counts = *(ch->reg - 1);
+		break;
+	}
+	if (ch->counts == 0)
+		ch->reg = NULL;
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * pwmSysWrite:
+ *	Write duty (nS) to the open duty_cycle attribute.
+ */
+/*----------------------------------------------------------------------------*/
+static int pwmSysWrite (struct wiringPiPwmChannel *ch, unsigned int duty)
+{
+	char buf[16], *p;
+	unsigned int n = duty;
+
+	p = buf + sizeof(buf);
+	*--p = '\n';
+	do {
+		*--p = '0' + (n % 10);
+		n /= 10;
+	} while (n);
+
+	if (pwrite(ch->dutyFd, p, (buf + sizeof(buf)) - p, 0) < 0)
+		return -errno;
+
+	ch->dutyNs = ch->sysDutyNs = duty;
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiPwmChannelWrite:
+ *	Set the duty to value/range of the period: one register store, or one
+ *	write of the duty in nanoseconds to the open sysfs attribute.
+ *	Meson hardware counts hi + 1 and lo + 1 ticks, so a store can't give
+ *	0% or 100%; those go to the kernel, which special cases them.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiPwmChannelWrite (struct wiringPiPwmChannel *ch, unsigned int value, unsigned int range)
+{
+	unsigned int duty;
+	uint32_t hi;
+	int ret;
+
+	if ((ch->dutyFd == -1) || (range == 0))
+		return -1;
+
+	duty = ((uint64_t)ch->periodNs * value) / range;
+
+	if ((ch->reg != NULL) &&
+	    ((ch->style != WPI_PWM_REG_MESON) || ((value != 0) && (value < range)))) {
+		hi = ((uint64_t)ch->counts * value) / range;
+		if (ch->style == WPI_PWM_REG_MESON) {
+			if (hi < 1)
+				hi = 1;
+			if (hi > ch->counts - 1)
+				hi = ch->counts - 1;
+			*ch->reg = ((hi - 1) << 16) | (ch->counts - hi - 1);
+		} else
+			*ch->reg = hi;
+		ch->dutyNs = duty;
+		return 0;
+	}
+
+	// The kernel ignores a duty_cycle equal to the one it last applied, but
+	//	the registers may since have moved on: tell it where they are first.
+	if ((duty == ch->sysDutyNs) && (ch->dutyNs != duty) && (ch->dutyNs != ~0U))
+		if ((ret = pwmSysWrite(ch, ch->dutyNs)) < 0)
+			return ret;
+
+	return pwmSysWrite(ch, duty);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiPwmChannelClose:
+ *	Drop the open attribute and the register mapping before unexport.
+ */
+/*----------------------------------------------------------------------------*/
+void wiringPiPwmChannelClose (struct wiringPiPwmChannel *ch)
+{
+	if (ch->dutyFd != -1)
+		close(ch->dutyFd);
+	if (ch->mapped != NULL)
+		munmap((void *)ch->mapped, BLOCK_SIZE);
+
+	ch->dutyFd   = -1;
+	ch->mapped   = NULL;
+	ch->reg      = NULL;
+	ch->periodNs  = 0;
+	ch->counts    = 0;
+	ch->dutyNs    = ~0U;
+	ch->sysDutyNs = ~0U;
+}
+
 /*----------------------------------------------------------------------------*/
 /*
  * setKernelVersion:
@@ -725,24 +951,99 @@ int getPUPD (int pin)
 	return	-1;
 }
 
+/*----------------------------------------------------------------------------*/
+static inline struct wiringPiNodeStruct *nodeLookup (int pin)
+{
+	unsigned int idx = (unsigned int)pin - NODE_PIN_BASE;
+
+	// The size is published after its table, and tables only grow
+	if (idx < __atomic_load_n(&nodeTableSize, __ATOMIC_ACQUIRE))
+		return __atomic_load_n(&nodeTable, __ATOMIC_ACQUIRE)[idx];
+
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiPinHandle:
+ *	Resolve pin once into its data registers for digitalWriteFast and
+ *	digitalReadFast. Returns 0 if the pin has a direct register path, or
+ *	-1 if the handle falls back to digitalWrite/digitalRead (node pins,
+ *	sys mode, boards without one, ...). The handle is usable either way.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiPinHandle (int pin, struct wiringPiPinHandle *handle)
+{
+	setupCheck(__func__);
+
+	memset(handle, 0, sizeof(*handle));
+	handle->pin = pin;
+
+	// Extension node pins always go through the node
+	if (nodeLookup(pin) == NULL &&
+	    libwiring.getPinHandle && libwiring.getPinHandle(pin, handle) == 0)
+		return 0;
+
+	handle->style = WPI_PIN_SLOW;
+	return -1;
+}
+
+/*----------------------------------------------------------------------------*/
+static void resetPinHandles (void)
+{
+	memset(pinHandles, 0, sizeof(pinHandles));
+}
+
 /*----------------------------------------------------------------------------*/
 /*
  * Core Functions
+ *	Pins from NODE_PIN_BASE up belong to extension nodes, and are handed
+ *	to them without going through the board code.
  */
 /*----------------------------------------------------------------------------*/
 void pinMode (int pin, int mode)
 {
+	struct wiringPiNodeStruct *node;
+
+	if ((node = nodeLookup(pin)) != NULL) {
+		node->pinMode(node, pin, mode);
+		return;
+	}
+
 	setupCheck(__func__);
 
 	if (libwiring.pinMode)
 		if (libwiring.pinMode(pin, mode) < 0)
 			msg(MSG_WARN, "%s: Not available for pin %d. \n", __func__, pin);
 
+	// Plain gpio pins get their registers cached for digitalWrite/Read
+	if ((unsigned int)pin < PIN_HANDLE_MAX) {
+		switch (mode) {
+		case	INPUT:
+		case	OUTPUT:
+		case	INPUT_PULLUP:
+		case	INPUT_PULLDOWN:
+			(void)wiringPiPinHandle(pin, &pinHandles[pin]);
+			if (pinHandles[pin].style == WPI_PIN_SHADOW)
+				wiringPiBankSync(pinHandles[pin].bank, pinHandles[pin].outMask);
+			break;
+		default:
+			pinHandles[pin].style = WPI_PIN_SLOW;
+			break;
+		}
+	}
 }
 
 /*----------------------------------------------------------------------------*/
 void pullUpDnControl (int pin, int pud)
 {
+	struct wiringPiNodeStruct *node;
+
+	if ((node = nodeLookup(pin)) != NULL) {
+		node->pullUpDnControl(node, pin, pud);
+		return;
+	}
+
 	setupCheck(__func__);
 
 	if (libwiring.pullUpDnControl)
@@ -753,6 +1054,14 @@ void pullUpDnControl (int pin, int pud)
 /*----------------------------------------------------------------------------*/
 int digitalRead (int pin)
 {
+	struct wiringPiNodeStruct *node;
+
+	if ((unsigned int)pin < PIN_HANDLE_MAX && pinHandles[pin].style != WPI_PIN_SLOW)
+		return	digitalReadFast(&pinHandles[pin]);
+
+	if ((node = nodeLookup(pin)) != NULL)
+		return	node->digitalRead(node, pin);
+
 	setupCheck(__func__);
 
 	if (libwiring.digitalRead)
@@ -764,6 +1073,18 @@ int digitalRead (int pin)
 /*----------------------------------------------------------------------------*/
 void digitalWrite (int pin, int value)
 {
+	struct wiringPiNodeStruct *node;
+
+	if ((unsigned int)pin < PIN_HANDLE_MAX && pinHandles[pin].style != WPI_PIN_SLOW) {
+		digitalWriteFast(&pinHandles[pin], value);
+		return;
+	}
+
+	if ((node = nodeLookup(pin)) != NULL) {
+		node->digitalWrite(node, pin, value);
+		return;
+	}
+
 	setupCheck(__func__);
 
 	if (libwiring.digitalWrite)
@@ -774,6 +1095,13 @@ void digitalWrite (int pin, int value)
 /*----------------------------------------------------------------------------*/
 void pwmWrite(int pin, int value)
 {
+	struct wiringPiNodeStruct *node;
+
+	if ((node = nodeLookup(pin)) != NULL) {
+		node->pwmWrite(node, pin, value);
+		return;
+	}
+
 	setupCheck(__func__);
 
 	if (libwiring.pwmWrite) {
@@ -787,6 +1115,11 @@ void pwmWrite(int pin, int value)
 /*----------------------------------------------------------------------------*/
 int analogRead (int pin)
 {
+	struct wiringPiNodeStruct *node;
+
+	if ((node = nodeLookup(pin)) != NULL)
+		return	node->analogRead(node, pin);
+
 	setupCheck(__func__);
 
 	if (libwiring.analogRead)
@@ -795,6 +1128,60 @@ int analogRead (int pin)
 	return	-1;
 }
 
+/*----------------------------------------------------------------------------*/
+/*
+ * analogWrite:
+ *	No ODROID has a DAC of its own, so this is for extension nodes only.
+ */
+/*----------------------------------------------------------------------------*/
+void analogWrite (int pin, int value)
+{
+	struct wiringPiNodeStruct *node;
+
+	if ((node = nodeLookup(pin)) != NULL)
+		node->analogWrite(node, pin, value);
+	else
+		msg(MSG_WARN, "%s: Not available for pin %d. \n", __func__, pin);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * digitalRead8: digitalWrite8:
+ *	Pins pin to pin + 7 as one byte, bit 0 being pin. Host pins go through
+ *	their port registers where the board has them.
+ */
+/*----------------------------------------------------------------------------*/
+unsigned int digitalRead8 (int pin)
+{
+	struct wiringPiNodeStruct *node;
+	int pins [8], i;
+
+	if ((node = nodeLookup(pin)) != NULL)
+		return	node->digitalRead8(node, pin);
+
+	for (i = 0; i < 8; i++)
+		pins[i] = pin + i;
+
+	return	digitalReadMask(pins, 8);
+}
+
+/*----------------------------------------------------------------------------*/
+void digitalWrite8 (int pin, int value)
+{
+	struct wiringPiNodeStruct *node;
+	int pins [8], i;
+
+	if ((node = nodeLookup(pin)) != NULL) {
+		node->digitalWrite8(node, pin, value);
+		return;
+	}
+
+	for (i = 0; i < 8; i++)
+		pins[i] = pin + i;
+
+	digitalWriteMask(pins, 8, value & 0xFF);
+}
+
 /*----------------------------------------------------------------------------*/
 void digitalWriteByte (const int value)
 {
@@ -817,235 +1204,554 @@ unsigned int digitalReadByte (void)
 }
 
 /*----------------------------------------------------------------------------*/
-int waitForInterrupt (int pin, int mS)
+/*
+ * wiringPiBankGet:
+ *	Return the bank of an output register, creating it from the current
+ *	register value on first use. NULL if the table is full.
+ */
+/*----------------------------------------------------------------------------*/
+static pthread_mutex_t *bankLockFor (volatile uint32_t *reg)
 {
-	int fd, x;
-	uint8_t c;
-	struct pollfd polls;
+	return &bankLocks->lock[(((uintptr_t)reg & (PAGE_SIZE - 1)) >> 2) % BANK_LOCKS];
+}
 
-	if ((fd = libwiring.sysFds[PIN_NUM_CALC_SYSFD(pin)]) ==  -1)
-		return	-2;
+struct wiringPiBankStruct *wiringPiBankGet (volatile uint32_t *reg)
+{
+	struct wiringPiBankStruct *bank = NULL;
+	pthread_mutexattr_t attr;
+	int i, n;
+
+	// Entries are only appended and keep their register, so a hit needs no lock
+	n = __atomic_load_n(&numBanks, __ATOMIC_ACQUIRE);
+	for (i = 0; i < n; i++)
+		if (banks[i].reg == reg)
+			return &banks[i];
+
+	pthread_mutex_lock(&bankMutex);
+	for (i = 0; i < numBanks; i++) {
+		if (banks[i].reg == reg) {
+			bank = &banks[i];
+			break;
+		}
+	}
+	if (bank == NULL && numBanks < WPI_BANK_MAX) {
+		bank = &banks[numBanks];
+		bank->reg	= reg;
+		bank->shadow	= *reg;
+		bank->shadowed	= bankShadowed;
+		bank->lock	= bankLocks ? bankLockFor(reg) : NULL;
+
+		pthread_mutexattr_init(&attr);
+		pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+		pthread_mutex_init(&bank->mutex, &attr);
+		pthread_mutexattr_destroy(&attr);
+
+		__atomic_store_n(&numBanks, numBanks + 1, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&bankMutex);
 
-	// Setup poll structure
-	polls.fd     = fd ;
-	polls.events = POLLPRI | POLLERR ;
+	if (bank == NULL)
+		msg(MSG_WARN, "%s: Too many output banks. \n", __func__);
 
-	// Wait for it ...
-	x = poll (&polls, 1, mS) ;
+	return bank;
+}
 
-	// If no error, do a dummy read to clear the interrupt
-	//	A one character read appars to be enough.
-	if (x > 0) {
-		lseek (fd, 0, SEEK_SET) ;	// Rewind
-		if (read (fd, &c, 1) < 0) {	// Read & clear
-			fprintf(stderr, "Unable to read from the file descriptor: %s \n", strerror(errno));
-		}
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiBankWrite:
+ *	Set the masked bits of an output register to value through its bank,
+ *	for board code that has a register rather than a pin handle.
+ */
+/*----------------------------------------------------------------------------*/
+void wiringPiBankWrite (volatile uint32_t *reg, uint32_t mask, uint32_t value)
+{
+	struct wiringPiBankStruct *bank;
+
+	if ((bank = wiringPiBankGet(reg)) != NULL)
+		wiringPiBankUpdate(bank, mask, value & mask);
+	else
+		*reg = (*reg & ~mask) | (value & mask);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiBankSync:
+ *	Reload the masked bits of the shadow from the register, for pins that
+ *	were just made outputs and may have been driven by someone else.
+ */
+/*----------------------------------------------------------------------------*/
+void wiringPiBankSync (struct wiringPiBankStruct *bank, uint32_t mask)
+{
+	if (bank == NULL || bank->lock)
+		return;
+
+	pthread_mutex_lock(&bank->mutex);
+	bank->shadow = (bank->shadow & ~mask) | (*bank->reg & mask);
+	pthread_mutex_unlock(&bank->mutex);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiBankUpdateLocked:
+ *	Read-modify-write under the bank mutex shared by all processes, so
+ *	that bits driven by another process are kept. If the last holder
+ *	died, the register itself is still right, so just carry on.
+ */
+/*----------------------------------------------------------------------------*/
+void wiringPiBankUpdateLocked (struct wiringPiBankStruct *bank, uint32_t clear, uint32_t set)
+{
+	uint32_t val;
+
+	if (pthread_mutex_lock(bank->lock) == EOWNERDEAD)
+		pthread_mutex_consistent(bank->lock);
+
+	val = (*bank->reg & ~clear) | set;
+	*bank->reg = val;
+	__atomic_store_n(&bank->shadow, val, __ATOMIC_RELAXED);
+
+	pthread_mutex_unlock(bank->lock);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiBankShadowMode:
+ *	Let bank writes store the shadow without reading the register first.
+ *	Only for a process that owns every pin of the banks it writes: bits
+ *	changed by anyone else (kernel LEDs, sysfs, gpio) are reverted.
+ */
+/*----------------------------------------------------------------------------*/
+void wiringPiBankShadowMode (int enable)
+{
+	int i;
+
+	pthread_mutex_lock(&bankMutex);
+	bankShadowed = enable ? TRUE : FALSE;
+	for (i = 0; i < numBanks; i++) {
+		wiringPiBankSync(&banks[i], 0xFFFFFFFF);
+		__atomic_store_n(&banks[i].shadowed, bankShadowed, __ATOMIC_RELEASE);
 	}
-	return x ;
+	pthread_mutex_unlock(&bankMutex);
 }
 
 /*----------------------------------------------------------------------------*/
-static void *interruptHandler (void *arg)
+/*
+ * wiringPiBankLockMode:
+ *	Switch every bank to the multi-process lock mode. The locks are robust
+ *	process-shared mutexes in a shared memory page, open to the owner and
+ *	group of the page only.
+ */
+/*----------------------------------------------------------------------------*/
+#if !defined(ANDROID)
+static int bankLockInit (struct bankLockPage *page)
 {
-	int myPin ;
+	pthread_mutexattr_t attr;
+	int i;
 
-	(void)piHiPri (55) ;	// Only effective if we run as root
+	if (pthread_mutexattr_init(&attr) != 0)
+		return -1;
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
 
-	myPin   = *((int *) arg);
-	free(arg);
+	for (i = 0; i < BANK_LOCKS; i++)
+		if (pthread_mutex_init(&page->lock[i], &attr) != 0)
+			break;
+	pthread_mutexattr_destroy(&attr);
 
-	for (;;)
-		if (waitForInterrupt (myPin, -1) > 0) {
-			pthread_mutex_lock (&pinMutex) ;
-			if (libwiring.isrFunctions[PIN_NUM_CALC_SYSFD(myPin)] == 0) {
-				pthread_mutex_unlock (&pinMutex) ;
-				break;
-			}
-			libwiring.isrFunctions [PIN_NUM_CALC_SYSFD(myPin)] () ;
-			pthread_mutex_unlock (&pinMutex) ;
-		}
+	if (i < BANK_LOCKS)
+		return -1;
+
+	__atomic_store_n(&page->ready, 1, __ATOMIC_RELEASE);
+	return 0;
+}
+#endif
+
+int wiringPiBankLockMode (int enable)
+{
+#if !defined(ANDROID)
+	struct bankLockPage *page;
+	void *map;
+	int fd, i, created = TRUE;
+
+	if (!enable) {
+		msg(MSG_WARN, "%s: Bank lock mode can not be turned off. \n", __func__);
+		return bankLocks ? -1 : 0;
+	}
+
+	if (bankLocks)
+		return 0;
+
+	if ((fd = shm_open(BANK_LOCK_SHM, O_RDWR | O_CREAT | O_EXCL, 0660)) < 0) {
+		created = FALSE;
+		fd = shm_open(BANK_LOCK_SHM, O_RDWR, 0);
+	}
+	if (fd < 0) {
+		msg(MSG_WARN, "%s: Unable to open %s: %s\n", __func__, BANK_LOCK_SHM, strerror(errno));
+		return -1;
+	}
+
+	if (created && ftruncate(fd, PAGE_SIZE) < 0) {
+		msg(MSG_WARN, "%s: Unable to size %s: %s\n", __func__, BANK_LOCK_SHM, strerror(errno));
+		close(fd);
+		shm_unlink(BANK_LOCK_SHM);
+		return -1;
+	}
+
+	map = mmap(NULL, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		msg(MSG_WARN, "%s: Unable to map %s: %s\n", __func__, BANK_LOCK_SHM, strerror(errno));
+		return -1;
+	}
+	page = (struct bankLockPage *)map;
+
+	// The creator sets the mutexes up, everyone else waits for it (1S at most)
+	if (created && bankLockInit(page) < 0) {
+		msg(MSG_WARN, "%s: Unable to set up the bank locks\n", __func__);
+		munmap(map, PAGE_SIZE);
+		shm_unlink(BANK_LOCK_SHM);
+		return -1;
+	}
+	for (i = 0; i < 1000 && !__atomic_load_n(&page->ready, __ATOMIC_ACQUIRE); i++)
+		delay(1);
+	if (!page->ready) {
+		msg(MSG_WARN, "%s: %s was never set up\n", __func__, BANK_LOCK_SHM);
+		munmap(map, PAGE_SIZE);
+		return -1;
+	}
+
+	pthread_mutex_lock(&bankMutex);
+	bankLocks = page;
+	for (i = 0; i < numBanks; i++)
+		__atomic_store_n(&banks[i].lock, bankLockFor(banks[i].reg), __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&bankMutex);
 
-	return NULL ;
+	return 0;
+#else
+	if (enable)
+		msg(MSG_WARN, "%s: Not available on this platform. \n", __func__);
+	return enable ? -1 : 0;
+#endif
 }
 
 /*----------------------------------------------------------------------------*/
-int wiringPiISR (int pin, int mode, void (*function)(void))
+/*
+ * wiringPiPortGroupInit:
+ *	Resolve pins and sort them by output and input register. Pins without
+ *	a direct register path are handled one by one through digitalWrite.
+ */
+/*----------------------------------------------------------------------------*/
+static int portBankFind (struct wiringPiPortBank *banks, int *numBanks,
+	int style, volatile uint32_t *reg, struct wiringPiBankStruct *bank)
 {
-	pthread_t threadId;
-	char fName   [64];
-	char  pinS [8];
-	int   count, i;
-	char  c;
-	int   GpioPin;
+	int b;
 
-	if (libwiring.mode == MODE_UNINITIALISED)
-		return wiringPiFailure (
-			WPI_FATAL,
-			"wiringPiISR: wiringPi has not been initialised. " \
-			"Unable to continue.\n") ;
+	for (b = 0; b < *numBanks; b++)
+		if (banks[b].reg == reg)
+			return b;
 
-	if (libwiring.getModeToGpio)
-		GpioPin = libwiring.getModeToGpio(libwiring.mode, pin);
-	else
-		return wiringPiFailure (
-			WPI_FATAL,
-			"%s: getModeToGpio function not initialize!\n",
-			__func__);
-
-	// Now export the pin and set the right edge
-	// We're going to use the gpio program to do this, so it assumes
-	// a full installation of wiringPi. It's a bit 'clunky', but it
-	// is a way that will work when we're running in "Sys" mode, as
-	// a non-root user. (without sudo)
-	if (mode != INT_EDGE_SETUP) {
-		sprintf (pinS, "%d", GpioPin) ;
-
-		char temp[64];
-		sprintf(temp, "/sys/class/gpio/gpio%d", GpioPin);
-		if (access(temp, F_OK) == 0) {
-			FILE *unexport = fopen("/sys/class/gpio/unexport", "w");
-			fprintf (unexport, "%d\n", GpioPin);
-			fclose(unexport);
-		}
+	banks[b].style	= style;
+	banks[b].reg	= reg;
+	banks[b].mask	= 0;
+	banks[b].bank	= bank;
+	(*numBanks)++;
+
+	return b;
+}
 
-		FILE *export, *direct, *edge;
-		int count;
+int wiringPiPortGroupInit (struct wiringPiPortGroup *group, const int *pins, int numPins)
+{
+	struct wiringPiPinHandle *h;
+	int i, b;
 
-		export = fopen("/sys/class/gpio/export", "w") ;
-		fprintf (export, "%d\n", GpioPin) ;
-		fclose (export) ;
+	setupCheck(__func__);
 
-		char fDirection[64];
-		sprintf (fDirection, "/sys/class/gpio/gpio%d/direction", GpioPin) ;
-		for(count = 5; count > 0; --count) {
-			if((direct = fopen(fDirection, "w")) != NULL)
-				break;
-			else
-				if(count != 1)
-					sleep(1);
-				else
-					return wiringPiFailure (
-						WPI_FATAL,
-						"wiringPiISR: unable to open %s: %s\n",
-						fDirection, strerror (errno)) ;
-		}
-		fprintf (direct, "in\n") ;
-		fclose (direct) ;
+	if (numPins < 1 || numPins > WPI_PORT_MAX_PINS)
+		return -1;
 
-		char fEdge[64];
-		sprintf (fEdge, "/sys/class/gpio/gpio%d/edge", GpioPin) ;
-		for(count = 5; count > 0; --count) {
-			if((edge = fopen(fEdge, "w")) != NULL)
-				break;
-			else
-				if(count != 1)
-					sleep(1);
-				else
-					return wiringPiFailure (
-						WPI_FATAL,
-						"wiringPiISR: unable to open %s: %s\n",
-						fEdge, strerror (errno)) ;
+	memset(group, 0, sizeof(*group));
+	group->numPins = numPins;
+
+	for (i = 0; i < numPins; i++) {
+		h = &group->handles[i];
+
+		if (wiringPiPinHandle(pins[i], h) < 0) {
+			group->outBank[i] = group->inBank[i] = -1;
+			continue;
 		}
-		if (mode  == INT_EDGE_FALLING)
-			fprintf (edge, "falling\n");
-		else if (mode  == INT_EDGE_RISING)
-			fprintf (edge, "rising\n");
-		else if (mode == INT_EDGE_BOTH)
-			fprintf (edge, "both\n");
-		else
-			fprintf (edge, "none\n");
-		fclose (edge) ;
+
+		b = portBankFind(group->outBanks, &group->numOutBanks, h->style, h->outReg, h->bank);
+		group->outBanks[b].mask |= h->outMask;
+		group->outBank[i] = b;
+
+		b = portBankFind(group->inBanks, &group->numInBanks, h->style, h->inReg, NULL);
+		group->inBanks[b].mask |= h->inMask;
+		group->inBank[i] = b;
 	}
 
-	// Now pre-open the /sys/class node - but it may already be open if
-	//	we are in Sys mode...
+	return 0;
+}
 
-	if (libwiring.sysFds [PIN_NUM_CALC_SYSFD(GpioPin)] == -1) {
-		sprintf (fName, "/sys/class/gpio/gpio%d/value", GpioPin) ;
+/*----------------------------------------------------------------------------*/
+struct wiringPiPortGroup *wiringPiPortGroupCreate (const int *pins, int numPins)
+{
+	struct wiringPiPortGroup *group;
 
-		if ((libwiring.sysFds [PIN_NUM_CALC_SYSFD(GpioPin)] = open (fName, O_RDWR)) < 0)
-			return wiringPiFailure (
-				WPI_FATAL,
-				"wiringPiISR: unable to open %s: %s\n",
-				fName, strerror (errno)) ;
+	if ((group = malloc(sizeof(*group))) == NULL)
+		return NULL;
+
+	if (wiringPiPortGroupInit(group, pins, numPins) < 0) {
+		free(group);
+		return NULL;
 	}
 
-	// Clear any initial pending interrupt
-	ioctl (libwiring.sysFds [PIN_NUM_CALC_SYSFD(GpioPin)], FIONREAD, &count) ;
-	for (i = 0 ; i < count ; ++i)
-		if (read(libwiring.sysFds [PIN_NUM_CALC_SYSFD(GpioPin)], &c, 1) < 0) {
-			fprintf(stderr, "Unable to read from the sysfs GPIO node: %s \n", strerror(errno));
+	return group;
+}
+
+/*----------------------------------------------------------------------------*/
+void wiringPiPortGroupFree (struct wiringPiPortGroup *group)
+{
+	free(group);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * digitalWritePortMasked:
+ *	Write the bits of values selected by mask, leaving the other pins of
+ *	the group alone. Each register of the group is written once.
+ */
+/*----------------------------------------------------------------------------*/
+void digitalWritePortMasked (const struct wiringPiPortGroup *group, uint32_t values, uint32_t mask)
+{
+	const struct wiringPiPortBank *bank;
+	uint32_t set  [WPI_PORT_MAX_PINS];
+	uint32_t used [WPI_PORT_MAX_PINS];
+	int i, b;
+
+	memset(set,  0, sizeof(uint32_t) * group->numOutBanks);
+	memset(used, 0, sizeof(uint32_t) * group->numOutBanks);
+
+	for (i = 0; i < group->numPins; i++) {
+		if (!(mask & (1U << i)))
+			continue;
+
+		if ((b = group->outBank[i]) < 0) {
+			digitalWrite(group->handles[i].pin, (values >> i) & 1);
+			continue;
 		}
 
-	pthread_mutex_lock (&pinMutex) ;
-	int *pinNumber = malloc(sizeof(*pinNumber));
-	*pinNumber= GpioPin ;
-	pthread_create (&threadId, NULL, interruptHandler, pinNumber) ;
-	pthread_mutex_unlock (&pinMutex) ;
+		used[b] |= group->handles[i].outMask;
+		if (values & (1U << i))
+			set[b] |= group->handles[i].outMask;
+	}
 
-	pthread_mutex_lock (&pinMutex) ;
-	libwiring.isrFunctions [PIN_NUM_CALC_SYSFD(GpioPin)] = function ;
-	libwiring.isrThreadIds [PIN_NUM_CALC_SYSFD(GpioPin)] = threadId ;
-	pthread_mutex_unlock (&pinMutex) ;
+	for (b = 0; b < group->numOutBanks; b++) {
+		if (!used[b])
+			continue;
 
-	return 0 ;
+		bank = &group->outBanks[b];
+		if (bank->style == WPI_PIN_WMASK)
+			*bank->reg = (used[b] << 16) | set[b];
+		else if (bank->style == WPI_PIN_SHADOW)
+			wiringPiBankUpdate(bank->bank, used[b], set[b]);
+		else
+			*bank->reg = (*bank->reg & ~used[b]) | set[b];
+	}
 }
 
 /*----------------------------------------------------------------------------*/
-int wiringPiISRCancel(int pin) {
-	int GpioPin = -1;
-
-	if (libwiring.mode == MODE_UNINITIALISED)
-		return wiringPiFailure (
-			WPI_FATAL,
-			"wiringPiISRCancel: wiringPi has not been initialised. " \
-			"Unable to continue.\n") ;
+void digitalWritePort (const struct wiringPiPortGroup *group, uint32_t values)
+{
+	digitalWritePortMasked(group, values, 0xFFFFFFFF);
+}
 
-	if (libwiring.getModeToGpio)
-		GpioPin = libwiring.getModeToGpio(libwiring.mode, pin);
-	else
-		return wiringPiFailure (
-			WPI_FATAL,
-			"%s: getModeToGpio function not initialize!\n",
-			__func__);
-
-	pthread_t threadId = libwiring.isrThreadIds[PIN_NUM_CALC_SYSFD(GpioPin)];
-
-	if (pthread_cancel(threadId) < 0)
-		return wiringPiFailure (
-			WPI_FATAL,
-			"%s: wiringPiISRCancel: Unregister for the interrupt pin failed!\n",
-			__func__);
-	else {
-		pthread_mutex_lock (&pinMutex) ;
-		libwiring.isrFunctions[PIN_NUM_CALC_SYSFD(GpioPin)] = NULL;
-		libwiring.isrThreadIds[PIN_NUM_CALC_SYSFD(GpioPin)] = 0;
-		pthread_mutex_unlock (&pinMutex) ;
+/*----------------------------------------------------------------------------*/
+uint32_t digitalReadPort (const struct wiringPiPortGroup *group)
+{
+	uint32_t regs [WPI_PORT_MAX_PINS];
+	uint32_t values = 0;
+	int i, b;
+
+	for (b = 0; b < group->numInBanks; b++)
+		regs[b] = *group->inBanks[b].reg;
+
+	for (i = 0; i < group->numPins; i++) {
+		if ((b = group->inBank[i]) < 0) {
+			if (digitalRead(group->handles[i].pin) == HIGH)
+				values |= (1U << i);
+		} else if (regs[b] & group->handles[i].inMask)
+			values |= (1U << i);
 	}
 
-	return 0;
+	return values;
 }
 
 /*----------------------------------------------------------------------------*/
-static void initialiseEpoch (void)
+/*
+ * digitalWriteMask: digitalReadMask:
+ *	One-shot versions of the port group calls. Keep a group around with
+ *	wiringPiPortGroupCreate when the same pins are used repeatedly.
+ */
+/*----------------------------------------------------------------------------*/
+void digitalWriteMask (const int *pins, int numPins, uint32_t values)
 {
-#ifdef	OLD_WAY
-	struct timeval tv;
+	struct wiringPiPortGroup group;
 
-	gettimeofday (&tv, NULL) ;
-	libwiring.epochMilli = (uint64_t)tv.tv_sec * (uint64_t)1000    +
-				(uint64_t)(tv.tv_usec / 1000) ;
-	libwiring.epochMicro = (uint64_t)tv.tv_sec * (uint64_t)1000000 +
-				(uint64_t)(tv.tv_usec) ;
-#else
+	if (wiringPiPortGroupInit(&group, pins, numPins) == 0)
+		digitalWritePort(&group, values);
+}
+
+/*----------------------------------------------------------------------------*/
+uint32_t digitalReadMask (const int *pins, int numPins)
+{
+	struct wiringPiPortGroup group;
+
+	if (wiringPiPortGroupInit(&group, pins, numPins) < 0)
+		return 0;
+
+	return digitalReadPort(&group);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiMonotonicNs: wiringPiSleepAbs: wiringPiSleepUntil:
+ *	The clock every timing loop in the library runs on: absolute
+ *	CLOCK_MONOTONIC nS, which is also the clock of kernel event
+ *	timestamps and of the CLOCK_MONOTONIC condition variables.
+ *	wiringPiSleepAbs just sleeps to the deadline. wiringPiSleepUntil sleeps
+ *	until delaySlack before it, then spins. Sleeping on the deadline itself
+ *	rather than for a length keeps loops from drifting, the spin takes out
+ *	the wake-up latency that clock_nanosleep adds.
+ */
+/*----------------------------------------------------------------------------*/
+uint64_t wiringPiMonotonicNs (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void wiringPiSleepAbs (uint64_t deadline)
+{
 	struct timespec ts;
 
-	clock_gettime (CLOCK_MONOTONIC_RAW, &ts) ;
-	libwiring.epochMilli = (uint64_t)ts.tv_sec * (uint64_t)1000    +
-				(uint64_t)(ts.tv_nsec / 1000000L) ;
-	libwiring.epochMicro = (uint64_t)ts.tv_sec * (uint64_t)1000000 +
-				(uint64_t)(ts.tv_nsec /    1000L) ;
+	ts.tv_sec  = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+	while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+void wiringPiSleepUntil (uint64_t deadline)
+{
+	if (deadline > wiringPiMonotonicNs() + delaySlack)
+		wiringPiSleepAbs(deadline - delaySlack);
+
+	while (wiringPiMonotonicNs() < deadline)
+		;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiDelaySlack:
+ *	How late clock_nanosleep wakes up, in nS, as measured at setup.
+ */
+/*----------------------------------------------------------------------------*/
+uint64_t wiringPiDelaySlack (void)
+{
+	return delaySlack;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * calibrateDelay:
+ *	Measure how late clock_nanosleep wakes up. The second worst of a few
+ *	short sleeps becomes the spin time of delayMicroseconds, so one bad
+ *	preemption does not make every delay spin.
+ */
+/*----------------------------------------------------------------------------*/
+static void calibrateDelay (void)
+{
+	uint64_t late [DELAY_CAL_LOOPS], target, tmp;
+	int i, j;
+
+	for (i = 0; i < DELAY_CAL_LOOPS; i++) {
+		target = wiringPiMonotonicNs() + DELAY_CAL_SLEEP_NS;
+		wiringPiSleepAbs(target);
+		late[i] = wiringPiMonotonicNs() - target;
+
+		for (j = i; j > 0 && late[j] < late[j - 1]; j--) {
+			tmp = late[j]; late[j] = late[j - 1]; late[j - 1] = tmp;
+		}
+	}
+
+	delaySlack = late[DELAY_CAL_LOOPS - 2] + DELAY_CAL_MARGIN_NS;
+	if (delaySlack > DELAY_SLACK_MAX_NS)
+		delaySlack = DELAY_SLACK_MAX_NS;
+
+	if (wiringPiDebug)
+		printf ("wiringPi: delay spin time %llu nS\n", (unsigned long long)delaySlack);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * calibrateCounter:
+ *	Check the ARM generic timer against CLOCK_MONOTONIC over a couple of
+ *	mS. CNTFRQ is set by the firmware and is sometimes wrong, in which
+ *	case the measured rate is used instead.
+ */
+/*----------------------------------------------------------------------------*/
+#if defined(__aarch64__)
+static inline uint64_t readCounter (void)
+{
+	uint64_t val;
+
+	__asm__ __volatile__ ("isb; mrs %0, cntvct_el0" : "=r" (val) :: "memory");
+	return val;
+}
+
+static void calibrateCounter (void)
+{
+	uint64_t freq, measured, c0, c1, t0, t1;
+
+	__asm__ __volatile__ ("mrs %0, cntfrq_el0" : "=r" (freq));
+
+	t0 = wiringPiMonotonicNs();
+	c0 = readCounter();
+	wiringPiSleepUntil(t0 + COUNTER_CAL_NS);
+	t1 = wiringPiMonotonicNs();
+	c1 = readCounter();
+
+	measured = (uint64_t)((unsigned __int128)(c1 - c0) * 1000000000ULL / (t1 - t0));
+	if (measured == 0) {
+		countMult = 0;
+		return;
+	}
+	if (freq == 0 || freq > measured + measured / 100 || freq < measured - measured / 100) {
+		msg(MSG_WARN, "%s: CNTFRQ says %llu Hz, measured %llu Hz. \n", __func__,
+			(unsigned long long)freq, (unsigned long long)measured);
+		freq = measured;
+	}
+
+	countMult  = (uint64_t)(((unsigned __int128)1000000000ULL << 32) / freq);
+	epochCount = readCounter();
+}
+#else
+static void calibrateCounter (void)
+{
+	countMult = 0;
+}
 #endif
+
+/*----------------------------------------------------------------------------*/
+static void initialiseEpoch (void)
+{
+	calibrateDelay ();
+	calibrateCounter ();
+
+	epochNs = wiringPiMonotonicNs();
+	libwiring.epochMilli = epochNs / 1000000ULL;
+	libwiring.epochMicro = epochNs / 1000ULL;
 }
 
 /*----------------------------------------------------------------------------*/
@@ -1062,74 +1768,79 @@ void delay (unsigned int howLong)
 /*----------------------------------------------------------------------------*/
 void delayMicrosecondsHard (unsigned int howLong)
 {
-	struct timeval tNow, tLong, tEnd;
-
-	gettimeofday (&tNow, NULL) ;
-	tLong.tv_sec  = howLong / 1000000 ;
-	tLong.tv_usec = howLong % 1000000 ;
-	timeradd (&tNow, &tLong, &tEnd) ;
+	uint64_t deadline = wiringPiMonotonicNs() + (uint64_t)howLong * 1000ULL;
 
-	while (timercmp (&tNow, &tEnd, <))
-		gettimeofday (&tNow, NULL) ;
+	while (wiringPiMonotonicNs() < deadline)
+		;
 }
 
 /*----------------------------------------------------------------------------*/
 void delayMicroseconds (unsigned int howLong)
 {
-	struct timespec sleeper;
-	unsigned int uSecs = howLong % 1000000;
-	unsigned int wSecs = howLong / 1000000;
-
 	if (howLong == 0)
 		return ;
-	else if (howLong < 100)
-		delayMicrosecondsHard (howLong);
-	else {
-		sleeper.tv_sec  = wSecs;
-		sleeper.tv_nsec = (long)(uSecs * 1000L);
-		nanosleep (&sleeper, NULL);
-	}
+
+	wiringPiSleepUntil(wiringPiMonotonicNs() + (uint64_t)howLong * 1000ULL);
 }
 
 /*----------------------------------------------------------------------------*/
-unsigned int millis (void)
+/*
+ * delayUntil:
+ *	Wait until micros() reaches deadline. Advancing the deadline by the
+ *	period each time round gives a loop that does not drift, e.g.
+ *		next = micros(); for (;;) { next += 1000; delayUntil(next); ... }
+ *	A deadline already passed (within half the micros() range) returns
+ *	at once.
+ */
+/*----------------------------------------------------------------------------*/
+void delayUntil (unsigned int deadline)
 {
-	uint64_t now;
+	int32_t left = (int32_t)(deadline - micros());
 
-#ifdef	OLD_WAY
-	struct timeval tv;
+	if (left <= 0)
+		return ;
 
-	gettimeofday (&tv, NULL);
-	now = (uint64_t)tv.tv_sec * (uint64_t)1000 +
-		(uint64_t)(tv.tv_usec / 1000);
-#else
-	struct  timespec ts;
+	wiringPiSleepUntil(wiringPiMonotonicNs() + (uint64_t)left * 1000ULL);
+}
 
-	clock_gettime (CLOCK_MONOTONIC_RAW, &ts);
-	now = (uint64_t)ts.tv_sec * (uint64_t)1000 +
-		(uint64_t)(ts.tv_nsec / 1000000L);
+/*----------------------------------------------------------------------------*/
+/*
+ * nanos64:
+ *	nS since wiringPiSetup. On aarch64 this is a read of the virtual
+ *	counter and a multiply, with no system call.
+ */
+/*----------------------------------------------------------------------------*/
+uint64_t nanos64 (void)
+{
+#if defined(__aarch64__)
+	if (countMult)
+		return (uint64_t)(((unsigned __int128)(readCounter() - epochCount) * countMult) >> 32);
 #endif
-	return (uint32_t)(now - libwiring.epochMilli);
+	return wiringPiMonotonicNs() - epochNs;
 }
 
 /*----------------------------------------------------------------------------*/
-unsigned int micros (void)
+uint64_t micros64 (void)
 {
-	uint64_t now;
-#ifdef	OLD_WAY
-	struct timeval tv;
+	return nanos64() / 1000ULL;
+}
 
-	gettimeofday (&tv, NULL);
-	now = (uint64_t)tv.tv_sec * (uint64_t)1000000 +
-		(uint64_t)tv.tv_usec;
-#else
-	struct timespec ts;
+/*----------------------------------------------------------------------------*/
+uint64_t millis64 (void)
+{
+	return nanos64() / 1000000ULL;
+}
 
-	clock_gettime (CLOCK_MONOTONIC_RAW, &ts) ;
-	now = (uint64_t)ts.tv_sec * (uint64_t)1000000 +
-		(uint64_t)(ts.tv_nsec / 1000);
-#endif
-	return (uint32_t)(now - libwiring.epochMicro);
+/*----------------------------------------------------------------------------*/
+unsigned int millis (void)
+{
+	return (uint32_t)millis64();
+}
+
+/*----------------------------------------------------------------------------*/
+unsigned int micros (void)
+{
+	return (uint32_t)micros64();
 }
 
 /*----------------------------------------------------------------------------*/
@@ -1142,7 +1853,6 @@ static 	void UNU piGpioLayoutOops	(const char UNU *why)	{ warn_msg(__func__); re
 
 	/* core unsupport function */
 	void pinModeAlt		(int UNU pin, int UNU mode)	{ warn_msg(__func__); return; }
-	void analogWrite	(int UNU pin, int UNU value)	{ warn_msg(__func__); return; }
 	void pwmToneWrite	(int UNU pin, int UNU freq)	{ warn_msg(__func__); return; }
 	void digitalWriteByte2	(const int UNU value)	{ warn_msg(__func__); return; }
 	unsigned int digitalReadByte2 (void)		{ warn_msg(__func__); return -1; }
@@ -1153,25 +1863,79 @@ static 	void UNU piGpioLayoutOops	(const char UNU *why)	{ warn_msg(__func__); re
 /*----------------------------------------------------------------------------*/
 struct wiringPiNodeStruct *wiringPiNodes = NULL ;
 
-struct wiringPiNodeStruct *wiringPiFindNode (int UNU pin) {	return NULL; }
+struct wiringPiNodeStruct *wiringPiFindNode (int pin)
+{
+	return	nodeLookup(pin);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * nodeTableRebuild:
+ *	Lay every node out again in a fresh table covering the highest pin.
+ *	Called with the new node already on the list. The old table is never
+ *	freed: readers index it without a lock and may still be inside it.
+ *	There is one table per node ever created, so little is lost.
+ *	Returns -1, with the old table still in place, if out of memory.
+ */
+/*----------------------------------------------------------------------------*/
+static int nodeTableRebuild (void)
+{
+	struct wiringPiNodeStruct *node, **table;
+	unsigned int size = 0, pin;
+
+	for (node = wiringPiNodes; node != NULL; node = node->next)
+		if ((unsigned int)(node->pinMax - NODE_PIN_BASE + 1) > size)
+			size = node->pinMax - NODE_PIN_BASE + 1;
+
+	if ((table = calloc(size, sizeof(*table))) == NULL)
+		return -1;
+
+	for (node = wiringPiNodes; node != NULL; node = node->next)
+		for (pin = node->pinBase; pin <= (unsigned int)node->pinMax; pin++)
+			table[pin - NODE_PIN_BASE] = node;
+
+	__atomic_store_n(&nodeTable, table, __ATOMIC_RELEASE);
+	__atomic_store_n(&nodeTableSize, size, __ATOMIC_RELEASE);
+
+	return 0;
+}
 
 static		void pinModeDummy		(UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int mode)  { return ; }
 static		void pullUpDnControlDummy	(UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int pud)   { return ; }
-static	unsigned int UNU digitalRead8Dummy		(UNU struct wiringPiNodeStruct *node, UNU int UNU pin)            { return 0 ; }
-static		void UNU digitalWrite8Dummy		(UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
 static		int  digitalReadDummy		(UNU struct wiringPiNodeStruct *node, UNU int UNU pin)            { return LOW ; }
 static		void digitalWriteDummy		(UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
 static		void pwmWriteDummy		(UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
 static		int  analogReadDummy		(UNU struct wiringPiNodeStruct *node, UNU int pin)            { return 0 ; }
 static		void analogWriteDummy		(UNU struct wiringPiNodeStruct *node, UNU int pin, UNU int value) { return ; }
 
+// Drivers without a byte-wide path get one pin at a time
+static unsigned int digitalRead8Generic (struct wiringPiNodeStruct *node, int pin)
+{
+	unsigned int value = 0;
+	int i;
+
+	for (i = 0; i < 8 && pin + i <= node->pinMax; i++)
+		if (node->digitalRead(node, pin + i) != LOW)
+			value |= 1 << i;
+
+	return value;
+}
+
+static void digitalWrite8Generic (struct wiringPiNodeStruct *node, int pin, int value)
+{
+	int i;
+
+	for (i = 0; i < 8 && pin + i <= node->pinMax; i++)
+		node->digitalWrite(node, pin + i, (value >> i) & 1);
+}
+
 struct wiringPiNodeStruct *wiringPiNewNode (int pinBase, int numPins)
 {
 	int	pin ;
 	struct wiringPiNodeStruct *node ;
 
 	// Minimum pin base is 64
-	if (pinBase < 64)
+	if (pinBase < NODE_PIN_BASE)
 		(void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: pinBase of %d is < 64\n", pinBase) ;
 
 	// Check all pins in-case there is overlap:
@@ -1188,18 +1952,138 @@ struct wiringPiNodeStruct *wiringPiNewNode (int pinBase, int numPins)
 	node->pinMode		= pinModeDummy ;
 	node->pullUpDnControl	= pullUpDnControlDummy ;
 	node->digitalRead	= digitalReadDummy ;
-	//node->digitalRead8	= digitalRead8Dummy ;
+	node->digitalRead8	= digitalRead8Generic ;
 	node->digitalWrite	= digitalWriteDummy ;
-	//node->digitalWrite8	= digitalWrite8Dummy ;
+	node->digitalWrite8	= digitalWrite8Generic ;
 	node->pwmWrite		= pwmWriteDummy ;
 	node->analogRead	= analogReadDummy ;
 	node->analogWrite	= analogWriteDummy ;
+	node->intPin		= -1 ;
 	node->next		= wiringPiNodes ;
 	wiringPiNodes		= node ;
 
+	if (nodeTableRebuild () < 0) {
+		wiringPiNodes = node->next ;
+		free (node) ;
+		(void)wiringPiFailure (WPI_FATAL, "wiringPiNewNode: Unable to allocate memory: %s\n", strerror (errno)) ;
+		return NULL ;
+	}
+
 	return node ;
 }
 
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiNodeBegin: wiringPiNodeCommit:
+ *	Between these, writes to the device holding pin only update its output
+ *	shadow and are sent together by the outermost commit, and reads come
+ *	from one snapshot of the inputs taken on the first read. Calls nest.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiNodeBegin (int pin)
+{
+	struct wiringPiNodeStruct *node;
+
+	if ((node = wiringPiFindNode(pin)) == NULL || node->flush == NULL)
+		return -1;
+
+	// Without an INT line the snapshot is only good for one transaction
+	if (node->depth++ == 0 && node->intPin < 0)
+		__atomic_store_n(&node->snapValid, FALSE, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+int wiringPiNodeCommit (int pin)
+{
+	struct wiringPiNodeStruct *node;
+
+	if ((node = wiringPiFindNode(pin)) == NULL || node->depth == 0)
+		return -1;
+
+	if (--node->depth > 0 || !node->dirty)
+		return 0;
+
+	node->dirty = FALSE;
+	return node->flush(node);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiNodeInterrupt:
+ *	The device holding pin has its INT output wired to intPin. Its input
+ *	snapshot is then kept between transactions and only re-read after
+ *	INT has fired.
+ */
+/*----------------------------------------------------------------------------*/
+static void nodeIntHandler (UNU struct wiringPiEventStruct *event, void *userdata)
+{
+	struct wiringPiNodeStruct *node = (struct wiringPiNodeStruct *)userdata;
+
+	__atomic_store_n(&node->snapValid, FALSE, __ATOMIC_RELEASE);
+}
+
+int wiringPiNodeInterrupt (int pin, int intPin)
+{
+	struct wiringPiNodeStruct *node;
+
+	if ((node = wiringPiFindNode(pin)) == NULL || node->refresh == NULL)
+		return -1;
+
+	if (node->setupInt && node->setupInt(node) < 0)
+		return -1;
+
+	__atomic_store_n(&node->snapValid, FALSE, __ATOMIC_RELEASE);
+	pinMode(intPin, INPUT);
+	if (wiringPiISREvent(intPin, INT_EDGE_FALLING, nodeIntHandler, node) < 0)
+		return -1;
+
+	node->intPin = intPin;
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiNodeDefer:
+ *	For drivers: called after updating the output shadow. Returns TRUE if
+ *	the bus write should be left to the commit.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiNodeDefer (struct wiringPiNodeStruct *node)
+{
+	if (node->depth == 0)
+		return FALSE;
+
+	node->dirty = TRUE;
+	return TRUE;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiNodeSnapshot:
+ *	For drivers: the inputs of the device from the snapshot, refreshed if
+ *	needed. Returns -1 when reads are not cached and the driver should go
+ *	to the bus itself.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiNodeSnapshot (struct wiringPiNodeStruct *node, unsigned int *value)
+{
+	if (node->refresh == NULL || (node->depth == 0 && node->intPin < 0))
+		return -1;
+
+	if (!__atomic_load_n(&node->snapValid, __ATOMIC_ACQUIRE)) {
+		// Marked valid first, so an INT during the read invalidates it again
+		__atomic_store_n(&node->snapValid, TRUE, __ATOMIC_RELEASE);
+		if (node->refresh(node) < 0) {
+			__atomic_store_n(&node->snapValid, FALSE, __ATOMIC_RELEASE);
+			return -1;
+		}
+	}
+
+	*value = node->snapshot;
+	return 0;
+}
+
 /*----------------------------------------------------------------------------*/
 void wiringPiVersion (int *major, char **minor)
 {
@@ -1231,6 +2115,12 @@ int wiringPiSetup (void)
 	if (getenv (ENV_CODES) != NULL)
 		wiringPiReturnCodes = TRUE;
 
+	if (getenv (ENV_BANKLOCK) != NULL)
+		(void)wiringPiBankLockMode(TRUE);
+
+	if (getenv (ENV_BANKSHADOW) != NULL)
+		wiringPiBankShadowMode(TRUE);
+
 	(void)piGpioLayout();
 
 	if (wiringPiDebug) {
@@ -1297,6 +2187,7 @@ int wiringPiSetupGpio (void)
 		printf ("wiringPi: wiringPiSetupGpio called\n") ;
 
 	libwiring.mode = MODE_GPIO;
+	resetPinHandles ();
 	return 0 ;
 }
 
@@ -1317,6 +2208,7 @@ int wiringPiSetupPhys (void)
 		printf ("wiringPi: wiringPiSetupPhys called\n") ;
 
 	libwiring.mode = MODE_PHYS ;
+	resetPinHandles ();
 	return 0 ;
 }
 
@@ -1375,6 +2267,7 @@ int wiringPiSetupSys (void)
 	initialiseEpoch ();
 
 	libwiring.mode = MODE_GPIO_SYS;
+	resetPinHandles ();
 	return 0;
 }
 
@@ -47,6 +47,8 @@
 #define	ENV_DEBUG		"WIRINGPI_DEBUG"
 #define	ENV_CODES		"WIRINGPI_CODES"
 #define	ENV_GPIOMEM		"WIRINGPI_GPIOMEM"
+#define	ENV_BANKLOCK		"WIRINGPI_BANKLOCK"
+#define	ENV_BANKSHADOW		"WIRINGPI_BANKSHADOW"
 
 #define KERN_NUM_TO_MAJOR	1
 #define KERN_NUM_TO_MINOR	2
@@ -135,6 +137,116 @@ extern const int   piMemorySize    [ 8];
 #define	MSG_ERR		-1
 #define	MSG_WARN	-2
 
+/*----------------------------------------------------------------------------*/
+// wiringPiBankStruct:
+//	An output register that has no set/clear or write_mask form (Amlogic).
+//	Writes are a read-modify-write under mutex, so threads writing pins of
+//	the same bank never lose each other's bits. mutex inherits priority:
+//	the wave engine and softPwm write from SCHED_FIFO threads, and must
+//	not wait on a preempted SCHED_OTHER holder. In shadow mode
+//	(WIRINGPI_BANKSHADOW) the process owns the whole register: writes
+//	store the shadow and never read the uncached register, and any bit
+//	changed from outside is put back. With WIRINGPI_BANKLOCK set, lock is
+//	a mutex shared between processes, taken instead of mutex.
+/*----------------------------------------------------------------------------*/
+#define	WPI_BANK_MAX		16
+
+struct wiringPiBankStruct
+{
+	volatile uint32_t	*reg;
+	uint32_t		shadow;
+	pthread_mutex_t		mutex;
+	int			shadowed;
+	pthread_mutex_t		*lock;
+};
+
+/*----------------------------------------------------------------------------*/
+// wiringPiPinHandle:
+//	A pin resolved down to its data registers, so that a write is a single
+//	store (WPI_PIN_WMASK, Rockchip write_mask registers; WPI_PIN_SHADOW,
+//	through a bank) or a single read-modify-write (WPI_PIN_RMW).
+//	WPI_PIN_SLOW handles go through the normal digitalWrite/digitalRead path.
+//	Boards that can also give the direction register (dirStyle) let
+//	pinModeFast flip a GPIO between INPUT and OUTPUT with one access.
+/*----------------------------------------------------------------------------*/
+#define	WPI_PIN_SLOW		0
+#define	WPI_PIN_RMW		1
+#define	WPI_PIN_WMASK		2
+#define	WPI_PIN_SHADOW		3
+
+#define	WPI_DIR_NONE		0
+#define	WPI_DIR_OEN		1	// Amlogic: a set bit makes the pin an input
+#define	WPI_DIR_WMASK		2	// Rockchip: a set bit makes an output, write_mask above
+
+struct wiringPiPinHandle
+{
+	int			style;
+	int			pin;
+	volatile uint32_t	*outReg;
+	volatile uint32_t	*inReg;
+	uint32_t		outMask;
+	uint32_t		inMask;
+	struct wiringPiBankStruct *bank;	// WPI_PIN_SHADOW only
+	int			dirStyle;
+	volatile uint32_t	*dirReg;
+	uint32_t		dirMask;
+};
+
+/*----------------------------------------------------------------------------*/
+// wiringPiPortGroup:
+//	A set of up to 32 pins sorted by the register they live in, so that
+//	digitalWritePort() touches each register once. Bit n of the port value
+//	is pins[n]. Pins in the same register change in one store; different
+//	registers are written one after the other.
+/*----------------------------------------------------------------------------*/
+#define	WPI_PORT_MAX_PINS	32
+
+struct wiringPiPortBank
+{
+	int			style;
+	volatile uint32_t	*reg;
+	uint32_t		mask;
+	struct wiringPiBankStruct *bank;	// WPI_PIN_SHADOW only
+};
+
+struct wiringPiPortGroup
+{
+	int	numPins;
+	int	numOutBanks;
+	int	numInBanks;
+
+	struct wiringPiPinHandle handles [WPI_PORT_MAX_PINS];
+	int	outBank [WPI_PORT_MAX_PINS];	// -1 for pins without a handle
+	int	inBank  [WPI_PORT_MAX_PINS];
+
+	struct wiringPiPortBank outBanks [WPI_PORT_MAX_PINS];
+	struct wiringPiPortBank inBanks  [WPI_PORT_MAX_PINS];
+};
+
+/*----------------------------------------------------------------------------*/
+// wiringPiPwmChannel:
+//	A hardware PWM output exported through /sys/class/pwm. The duty_cycle
+//	attribute stays open, and duty is set in nanoseconds. As root, and on
+//	PWM blocks whose layout is known, the duty register is written
+//	directly through /dev/mem instead. The kernel still sets the clock
+//	and period, but its idea of duty_cycle goes stale.
+/*----------------------------------------------------------------------------*/
+#define	WPI_PWM_REG_NONE	0
+#define	WPI_PWM_REG_MESON	1	// Amlogic PWM_AB/CD/EF: hi/lo counts in one word
+#define	WPI_PWM_REG_ROCKCHIP	2	// Rockchip PWM: PERIOD_HPR, DUTY_LPR per channel
+
+struct wiringPiPwmChannel
+{
+	int			dutyFd;		// -1 when closed
+	int			style;
+	volatile uint32_t	*mapped;
+	volatile uint32_t	*reg;		// NULL: go through dutyFd
+	unsigned int		periodNs;
+	unsigned int		counts;		// Clock ticks per period
+	unsigned int		dutyNs;		// Duty now, ~0 if not known
+	unsigned int		sysDutyNs;	// Duty the kernel last applied
+};
+
 /*----------------------------------------------------------------------------*/
 struct libodroid
 {
@@ -154,8 +266,10 @@ struct libodroid
 	int	(*pullUpDnControl)	(int pin, int pud);
 	int	(*digitalRead)		(int pin);
 	int	(*digitalWrite)		(int pin, int value);
+	int	(*getPinHandle)		(int pin, struct wiringPiPinHandle *handle);
 	int	(*pwmWrite)		(int pin, int value);
 	int	(*analogRead)		(int pin);
+	const char *(*getAdcNode)	(int pin);
 	int	(*digitalWriteByte)	(const unsigned int value);
 	unsigned int (*digitalReadByte)	(void);
 	void	(*pwmSetRange)		(unsigned int range);
@@ -163,7 +277,6 @@ struct libodroid
 
 	/* ISR Function pointer */
 	void 	(*isrFunctions[256])(void);
-	pthread_t isrThreadIds[256];
 
 	/* GPIO sysfs file discripter */
 	int 	sysFds[256];
@@ -239,14 +352,33 @@ struct wiringPiNodeStruct
 	void		(*pinMode)		(struct wiringPiNodeStruct *node, int pin, int mode);
 	void		(*pullUpDnControl)	(struct wiringPiNodeStruct *node, int pin, int mode);
 	int		(*digitalRead)		(struct wiringPiNodeStruct *node, int pin);
-	// unsigned int	(*digitalRead8)		(struct wiringPiNodeStruct *node, int pin);
+	unsigned int	(*digitalRead8)		(struct wiringPiNodeStruct *node, int pin);
 	void		(*digitalWrite)		(struct wiringPiNodeStruct *node, int pin, int value);
-	// void		(*digitalWrite8)	(struct wiringPiNodeStruct *node, int pin, int value);
+	void		(*digitalWrite8)	(struct wiringPiNodeStruct *node, int pin, int value);
 	void		(*pwmWrite)		(struct wiringPiNodeStruct *node, int pin, int value);
 	int		(*analogRead)		(struct wiringPiNodeStruct *node, int pin);
 	void		(*analogWrite)		(struct wiringPiNodeStruct *node, int pin, int value);
 
 	struct wiringPiNodeStruct *next;
+
+	// Write combining and input snapshot, see wiringPiNodeBegin.
+	//	flush writes the shadowed outputs, refresh reads every input into
+	//	snapshot (bit n = pinBase + n), setupInt makes the device pulse its
+	//	INT output on input changes. Drivers without flush are not cached.
+	int		(*flush)		(struct wiringPiNodeStruct *node);
+	int		(*refresh)		(struct wiringPiNodeStruct *node);
+	int		(*setupInt)		(struct wiringPiNodeStruct *node);
+
+	int		depth;		// open wiringPiNodeBegin calls
+	int		dirty;		// outputs changed since the last flush
+	int		snapValid;	// snapshot matches the device
+	unsigned int	snapshot;
+	unsigned int	outputs;	// bit n set: pinBase + n is an output
+	int		intPin;		// host pin wired to INT, -1 for none
+
+	// Edge reporting for wiringPiISR on node pins. mode is INT_EDGE_*,
+	//	-1 to stop. The node hands each edge to wiringPiNodeEvent.
+	int		(*watch)		(struct wiringPiNodeStruct *node, int pin, int mode);
 };
 
 extern struct wiringPiNodeStruct *wiringPiNodes;
@@ -265,6 +397,61 @@ struct kernelVersionStruct
 
 extern struct kernelVersionStruct *kernelVersion;
 
+/*----------------------------------------------------------------------------*/
+// wiringPiEventStruct:
+//	One edge seen by the interrupt engine. The timestamp is taken by the
+//	kernel (CLOCK_MONOTONIC, in nS) and seq counts the edges of the line.
+/*----------------------------------------------------------------------------*/
+struct wiringPiEventStruct
+{
+	int		pin;
+	int		edge;		// INT_EDGE_RISING or INT_EDGE_FALLING
+	uint64_t	timestamp;
+	uint32_t	seq;
+};
+
+/*----------------------------------------------------------------------------*/
+// wiringPiWaveStep:
+//	One point of a waveform played by the wave engine. Bit n of set/clear
+//	drives pins[n] of the wave HIGH/LOW, offset is in nS from the start of
+//	the period. Offsets must not decrease and must be below the period.
+/*----------------------------------------------------------------------------*/
+struct wiringPiWaveStep
+{
+	uint64_t	offset;
+	uint32_t	set;
+	uint32_t	clear;
+};
+
+struct wiringPiWaveStats
+{
+	uint64_t	steps;		// steps played
+	uint64_t	lateSum;	// nS, total lateness of the steps
+	uint32_t	lateMax;	// nS, worst step
+	uint32_t	overruns;	// periods skipped because the engine fell behind
+	uint32_t	slack;		// nS, calibrated wake-up latency
+};
+
+struct wiringPiWave;
+
+/*----------------------------------------------------------------------------*/
+// wiringPiAdcSample:
+//	One reading from the ADC sampling engine. timestamp is CLOCK_MONOTONIC
+//	in nS, value is the raw count, or the mean over the decimation when the
+//	engine averages.
+/*----------------------------------------------------------------------------*/
+#define	WPI_ADC_MAX_PINS	8
+
+#define	WPI_ADC_BUFFERED	1	// IIO triggered buffer, /dev/iio:deviceN
+#define	WPI_ADC_POLLED		2	// Engine thread reading in_voltageN_raw
+
+struct wiringPiAdcSample
+{
+	uint64_t	timestamp;
+	int		pin;
+	int		value;
+};
+
 /*----------------------------------------------------------------------------*/
 // Function prototypes
 //	c++ wrappers thanks to a comment by Nick Lott
@@ -277,6 +464,11 @@ extern "C" {
 // Node supports for external boards
 extern struct wiringPiNodeStruct *wiringPiFindNode (int pin);
 extern struct wiringPiNodeStruct *wiringPiNewNode  (int pinBase, int numPins);
+extern		int  wiringPiNodeBegin	(int pin);
+extern		int  wiringPiNodeCommit	(int pin);
+extern		int  wiringPiNodeInterrupt	(int pin, int intPin);
+extern		int  wiringPiNodeDefer	(struct wiringPiNodeStruct *node);
+extern		int  wiringPiNodeSnapshot	(struct wiringPiNodeStruct *node, unsigned int *value);
 
 // Internal WiringPi functions
 extern		int  wiringPiFailure	(int fatal, const char *message, ...);
@@ -287,6 +479,10 @@ extern		void usingGpiomemCheck	(const char *what);
 extern		void setUsingGpiomem	(const unsigned int value);
 extern		void setKernelVersion	(void);
 extern		char cmpKernelVersion	(int num, ...);
+extern	    uint64_t wiringPiMonotonicNs	(void);
+extern		void wiringPiSleepAbs	(uint64_t deadline);
+extern		void wiringPiSleepUntil	(uint64_t deadline);
+extern	    uint64_t wiringPiDelaySlack	(void);
 
 // Core WiringPi functions
 extern		void wiringPiVersion	(int *major, char **minor);
@@ -307,6 +503,28 @@ extern unsigned int  digitalReadByte	(void);
 extern		void digitalWriteByte	(const int value);
 extern		void pwmWrite		(int pin, int value);
 extern		int  analogRead		(int pin);
+extern		void analogWrite	(int pin, int value);
+extern unsigned int  digitalRead8	(int pin);
+extern		void digitalWrite8	(int pin, int value);
+
+// Pre-resolved pin access
+extern		int  wiringPiPinHandle	(int pin, struct wiringPiPinHandle *handle);
+
+// Multi-pin ports
+extern struct wiringPiBankStruct *wiringPiBankGet (volatile uint32_t *reg);
+extern		void wiringPiBankWrite	(volatile uint32_t *reg, uint32_t mask, uint32_t value);
+extern		void wiringPiBankSync	(struct wiringPiBankStruct *bank, uint32_t mask);
+extern		void wiringPiBankUpdateLocked (struct wiringPiBankStruct *bank, uint32_t clear, uint32_t set);
+extern		int  wiringPiBankLockMode	(int enable);
+extern		void wiringPiBankShadowMode	(int enable);
+extern		int  wiringPiPortGroupInit	(struct wiringPiPortGroup *group, const int *pins, int numPins);
+extern struct wiringPiPortGroup *wiringPiPortGroupCreate (const int *pins, int numPins);
+extern		void wiringPiPortGroupFree	(struct wiringPiPortGroup *group);
+extern		void digitalWritePort	(const struct wiringPiPortGroup *group, uint32_t values);
+extern		void digitalWritePortMasked	(const struct wiringPiPortGroup *group, uint32_t values, uint32_t mask);
+extern	    uint32_t digitalReadPort	(const struct wiringPiPortGroup *group);
+extern		void digitalWriteMask	(const int *pins, int numPins, uint32_t values);
+extern	    uint32_t digitalReadMask	(const int *pins, int numPins);
 
 // Hardware specific stuffs
 extern		int  piGpioLayout	(void);
@@ -321,6 +539,31 @@ extern		void pwmSetClock	(int divisor);
 extern		int  waitForInterrupt	(int pin, int mS);
 extern		int  wiringPiISR	(int pin, int mode, void (*function)(void));
 extern		int  wiringPiISRCancel	(int pin);
+extern		int  wiringPiISREvent	(int pin, int mode, void (*function)(struct wiringPiEventStruct *event, void *userdata), void *userdata);
+extern		int  wiringPiISRLastEvent	(int pin, struct wiringPiEventStruct *event);
+extern		int  wiringPiEventRead	(int pin, struct wiringPiEventStruct *buf, int n);
+extern unsigned int  wiringPiEventDropped	(int pin);
+extern		void wiringPiNodeEvent	(const struct wiringPiEventStruct *event);
+extern		int  wiringPiEventAddFd	(int fd, uint32_t events, void (*function)(int fd, uint32_t events, void *userdata), void *userdata);
+extern		int  wiringPiEventDelFd	(int fd);
+extern		int  wiringPiCaptureEdges	(int pin, int lowUs, int timeUs, struct wiringPiEventStruct *evs, int max);
+
+// Waveform engine
+extern		int  wiringPiWaveSetup	(int cpu, int priority);
+extern struct wiringPiWave *wiringPiWaveCreate (const int *pins, int numPins);
+extern		int  wiringPiWaveLoad	(struct wiringPiWave *wave, const struct wiringPiWaveStep *steps, int numSteps, uint64_t period);
+extern		int  wiringPiWaveStart	(struct wiringPiWave *wave);
+extern		void wiringPiWaveStop	(struct wiringPiWave *wave);
+extern		int  wiringPiWaveWait	(struct wiringPiWave *wave, int mS);
+extern		void wiringPiWaveFree	(struct wiringPiWave *wave);
+extern		void wiringPiWaveGetStats	(struct wiringPiWaveStats *stats, int reset);
+
+// ADC sampling engine
+extern		int  wiringPiAdcStart	(const int *pins, int numPins, unsigned int rate, int decimate, int average);
+extern		int  wiringPiAdcRead	(struct wiringPiAdcSample *samples, int max);
+extern		int  wiringPiAdcWait	(int count, int mS);
+extern unsigned int  wiringPiAdcDropped	(void);
+extern		void wiringPiAdcStop	(void);
 
 // Threads
 extern		int  piThreadCreate	(void *(*fn)(void *));
@@ -333,12 +576,15 @@ extern		int  piHiPri		(const int pri);
 // From Arduino land
 extern		void delay		(unsigned int howLong);
 extern		void delayMicroseconds	(unsigned int howLong);
+extern		void delayUntil		(unsigned int deadline);
 extern unsigned int  millis		(void);
 extern unsigned int  micros		(void);
+extern	    uint64_t nanos64		(void);
+extern	    uint64_t micros64		(void);
+extern	    uint64_t millis64		(void);
 
 // Unsupoorted
 extern		void pinModeAlt		(int pin, int mode) UNU;
-extern		void analogWrite	(int pin, int value) UNU;
 extern		void pwmToneWrite	(int pin, int freq) UNU;
 extern		void gpioClockSet	(int pin, int freq) UNU;
 extern unsigned int  digitalReadByte	(void) UNU;
@@ -349,6 +595,91 @@ extern		void digitalWriteByte2	(int value) UNU;
 // sys node
 extern		int inputToSysNode	(const char* sysPath, const char* node, char* data);
 
+// Hardware PWM channels
+extern		int  wiringPiPwmChannelOpen	(struct wiringPiPwmChannel *ch, const char *pwmPinPath,
+						unsigned long regAddr, int style, unsigned int periodNs);
+extern		int  wiringPiPwmChannelWrite	(struct wiringPiPwmChannel *ch, unsigned int value, unsigned int range);
+extern		void wiringPiPwmChannelClose	(struct wiringPiPwmChannel *ch);
+
+/*----------------------------------------------------------------------------*/
+// wiringPiBankUpdate:
+//	Clear then set bits of an output register. The store happens under
+//	the bank lock, so the register only ever holds the latest value.
+/*----------------------------------------------------------------------------*/
+static inline void wiringPiBankUpdate (struct wiringPiBankStruct *bank, uint32_t clear, uint32_t set)
+{
+	uint32_t val;
+
+	if (bank->lock) {
+		wiringPiBankUpdateLocked(bank, clear, set);
+		return;
+	}
+
+	pthread_mutex_lock(&bank->mutex);
+
+	val = ((bank->shadowed ? bank->shadow : *bank->reg) & ~clear) | set;
+	*bank->reg   = val;
+	bank->shadow = val;
+
+	pthread_mutex_unlock(&bank->mutex);
+}
+
+/*----------------------------------------------------------------------------*/
+// digitalWriteFast/digitalReadFast:
+//	Inline access through a handle from wiringPiPinHandle().
+/*----------------------------------------------------------------------------*/
+static inline void digitalWriteFast (const struct wiringPiPinHandle *handle, int value)
+{
+	switch (handle->style) {
+	case	WPI_PIN_WMASK:
+		*handle->outReg = (handle->outMask << 16) | (value ? handle->outMask : 0);
+		break;
+	case	WPI_PIN_SHADOW:
+		wiringPiBankUpdate(handle->bank, handle->outMask, value ? handle->outMask : 0);
+		break;
+	case	WPI_PIN_RMW:
+		if (value)
+			*handle->outReg |=  handle->outMask;
+		else
+			*handle->outReg &= ~handle->outMask;
+		break;
+	default:
+		digitalWrite (handle->pin, value);
+		break;
+	}
+}
+
+static inline int digitalReadFast (const struct wiringPiPinHandle *handle)
+{
+	if (handle->style == WPI_PIN_SLOW)
+		return digitalRead (handle->pin);
+
+	return (*handle->inReg & handle->inMask) ? HIGH : LOW;
+}
+
+/*----------------------------------------------------------------------------*/
+// pinModeFast:
+//	INPUT or OUTPUT through a handle, for a pin already set up as a GPIO
+//	with pinMode. Pull-ups and the pin function are left alone.
+/*----------------------------------------------------------------------------*/
+static inline void pinModeFast (const struct wiringPiPinHandle *handle, int mode)
+{
+	switch (handle->dirStyle) {
+	case	WPI_DIR_OEN:
+		if (mode == OUTPUT)
+			*handle->dirReg &= ~handle->dirMask;
+		else
+			*handle->dirReg |=  handle->dirMask;
+		break;
+	case	WPI_DIR_WMASK:
+		*handle->dirReg = (handle->dirMask << 16) | ((mode == OUTPUT) ? handle->dirMask : 0);
+		break;
+	default:
+		pinMode (handle->pin, mode);
+		break;
+	}
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,738 @@
+/*----------------------------------------------------------------------------*/
+/*
+
+	WiringPi ADC sampling engine for ODROIDs
+
+	Samples a set of analog pins continuously into a ring that the
+	application drains in blocks. Where the SARADC driver has a triggered
+	buffer, an hrtimer IIO trigger paces the conversions and the engine
+	thread reads whole scans from /dev/iio:deviceN. Otherwise the thread is
+	paced by a timerfd and reads each in_voltageN_raw itself, or falls back
+	to analogRead for pins without a sysfs node. Scans can be decimated,
+	keeping either the last reading or the mean of each group.
+
+ */
+/*----------------------------------------------------------------------------*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+/*----------------------------------------------------------------------------*/
+#include "wiringPi.h"
+
+/*----------------------------------------------------------------------------*/
+// Samples kept for wiringPiAdcRead, must be a power of 2
+#define	ADC_RING_SIZE		4096
+
+// Scans read from the IIO buffer at once, and the largest scan accepted:
+//	WPI_ADC_MAX_PINS channels of up to 64 bits plus the timestamp
+#define	ADC_BUFFER_SCANS	64
+#define	ADC_SCAN_MAX		((WPI_ADC_MAX_PINS + 1) * 8)
+#define	ADC_BUFFER_LENGTH	"1024"
+
+#define	ADC_TRIGGER		"wiringPi-adc"
+#define	ADC_TRIGGER_DIR		"/sys/kernel/config/iio/triggers/hrtimer/" ADC_TRIGGER
+#define	ADC_IIO_DEVICES		"/sys/bus/iio/devices"
+
+#define	ADC_PATH_MAX		256
+
+extern	struct libodroid	libwiring;
+
+/*----------------------------------------------------------------------------*/
+// One sampled pin. The scan layout is only used in buffered mode, fd only
+//	in polled mode.
+/*----------------------------------------------------------------------------*/
+struct adcChannel {
+	int		pin;
+	int		fd;		// in_voltageN_raw, or -1 for analogRead
+	int		index;		// N of in_voltageN
+
+	int		offset;		// in the scan, bytes
+	int		bytes;
+	int		bits;
+	int		shift;
+	int		isSigned;
+	int		bigEndian;
+
+	int64_t		sum;		// over the current decimation group
+	int		last;
+};
+
+static struct adcChannel adcChannels[WPI_ADC_MAX_PINS];
+static int		adcNumChannels;
+static int		adcMode;
+static int		adcDecimate;
+static int		adcAverage;
+static int		adcCount;
+
+static char		adcDevDir[ADC_PATH_MAX];
+static int		adcDevFd = -1;
+static int		adcTimerFd = -1;
+static int		adcStopFd = -1;
+static int		adcScanBytes;
+static int		adcStampOffset;	// -1 when the kernel gives no usable timestamp
+static uint8_t		adcScanBuf[ADC_BUFFER_SCANS * ADC_SCAN_MAX];
+
+/*----------------------------------------------------------------------------*/
+// Sample ring, single producer (the engine thread) and single consumer
+//	(wiringPiAdcRead), so head and tail only need acquire/release ordering.
+/*----------------------------------------------------------------------------*/
+static struct wiringPiAdcSample adcRing[ADC_RING_SIZE];
+static uint32_t		adcHead;
+static uint32_t		adcTail;
+static uint32_t		adcDropped;
+static uint32_t		adcWaiters;
+
+static pthread_mutex_t	adcMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	adcCond;
+static pthread_once_t	adcOnce = PTHREAD_ONCE_INIT;
+static pthread_t	adcThreadId;
+static int		adcRunning;
+
+/*----------------------------------------------------------------------------*/
+static void adcInitOnce (void)
+{
+	pthread_condattr_t cattr;
+
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&adcCond, &cattr);
+	pthread_condattr_destroy(&cattr);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * adcSysRead: adcSysWrite:
+ *	Quiet sysfs accessors, most attributes are only probed for.
+ */
+/*----------------------------------------------------------------------------*/
+static int adcSysRead (const char *dir, const char *node, char *buf, int len)
+{
+	char path[ADC_PATH_MAX * 2];
+	int fd, n;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, node);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n < 0)
+		return -1;
+
+	while ((n > 0) && (buf[n - 1] == '\n'))
+		--n;
+	buf[n] = 0;
+
+	return n;
+}
+
+static int adcSysWrite (const char *dir, const char *node, const char *value)
+{
+	char path[ADC_PATH_MAX * 2];
+	int fd, ret;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, node);
+	if ((fd = open(path, O_WRONLY | O_CLOEXEC)) < 0)
+		return -1;
+
+	ret = write(fd, value, strlen(value));
+	close(fd);
+
+	return (ret < 0) ? -1 : 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * adcScanElement:
+ *	Enable scan element name and read back its index and storage type,
+ *	e.g. "le:u12/16>>0".
+ */
+/*----------------------------------------------------------------------------*/
+static int adcScanElement (const char *name, struct adcChannel *ch)
+{
+	char dir[ADC_PATH_MAX + 16], node[64], buf[64];
+	char endian, sign;
+	int storage;
+
+	snprintf(dir, sizeof(dir), "%s/scan_elements", adcDevDir);
+
+	snprintf(node, sizeof(node), "%s_en", name);
+	if (adcSysWrite(dir, node, "1") < 0)
+		return -1;
+
+	snprintf(node, sizeof(node), "%s_index", name);
+	if (adcSysRead(dir, node, buf, sizeof(buf)) < 0)
+		return -1;
+	ch->index = atoi(buf);
+
+	snprintf(node, sizeof(node), "%s_type", name);
+	if (adcSysRead(dir, node, buf, sizeof(buf)) < 0)
+		return -1;
+	if (sscanf(buf, "%ce:%c%d/%d>>%d", &endian, &sign, &ch->bits, &storage, &ch->shift) != 5)
+		return -1;
+	if ((storage < 8) || (storage > 64) || (storage % 8) || (ch->bits < 1) || (ch->bits > storage))
+		return -1;
+
+	ch->bytes     = storage / 8;
+	ch->isSigned  = (sign == 's');
+	ch->bigEndian = (endian == 'b');
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * adcBufferedClose: adcBufferedOpen:
+ *	Set up the IIO triggered buffer for the channels: an hrtimer trigger at
+ *	rate, only our scan elements enabled, and the timestamp on the
+ *	monotonic clock when the kernel allows it.
+ */
+/*----------------------------------------------------------------------------*/
+static void adcBufferedClose (void)
+{
+	char dir[ADC_PATH_MAX + 16];
+	DIR *d;
+	struct dirent *de;
+
+	if (adcDevFd != -1)
+		close(adcDevFd);
+	adcDevFd = -1;
+
+	if (adcDevDir[0] == 0)
+		return;
+
+	(void)adcSysWrite(adcDevDir, "buffer/enable", "0");
+	(void)adcSysWrite(adcDevDir, "trigger/current_trigger", "\n");
+
+	snprintf(dir, sizeof(dir), "%s/scan_elements", adcDevDir);
+	if ((d = opendir(dir)) != NULL) {
+		while ((de = readdir(d)) != NULL)
+			if (strstr(de->d_name, "_en") != NULL)
+				(void)adcSysWrite(dir, de->d_name, "0");
+		closedir(d);
+	}
+
+	(void)rmdir(ADC_TRIGGER_DIR);
+	adcDevDir[0] = 0;
+}
+
+static int adcBufferedOpen (unsigned int rate)
+{
+	char dir[ADC_PATH_MAX + 16], trigDir[ADC_PATH_MAX], buf[64], dev[ADC_PATH_MAX];
+	struct adcChannel stamp, *order[WPI_ADC_MAX_PINS + 1], *tmp;
+	const char *node, *slash;
+	DIR *d;
+	struct dirent *de;
+	int i, j, n, offset, align;
+
+	// All the pins must be channels of the same IIO device
+	for (i = 0; i < adcNumChannels; ++i) {
+		if ((node = libwiring.getAdcNode(adcChannels[i].pin)) == NULL)
+			return -1;
+		if ((slash = strrchr(node, '/')) == NULL)
+			return -1;
+		if (sscanf(slash, "/in_voltage%d_raw", &adcChannels[i].index) != 1)
+			return -1;
+		if (i == 0) {
+			if ((slash - node) >= ADC_PATH_MAX)
+				return -1;
+			memcpy(adcDevDir, node, slash - node);
+			adcDevDir[slash - node] = 0;
+		} else if ((strncmp(adcDevDir, node, slash - node) != 0) || (adcDevDir[slash - node] != 0))
+			return -1;
+	}
+
+	snprintf(dir, sizeof(dir), "%s/trigger/current_trigger", adcDevDir);
+	if (access(dir, W_OK) != 0)
+		goto fail;
+	snprintf(dir, sizeof(dir), "%s/buffer/enable", adcDevDir);
+	if (access(dir, W_OK) != 0)
+		goto fail;
+	(void)adcSysWrite(adcDevDir, "buffer/enable", "0");
+
+	// A private hrtimer trigger, created through configfs
+	if ((mkdir(ADC_TRIGGER_DIR, 0755) < 0) && (errno != EEXIST))
+		goto fail;
+
+	trigDir[0] = 0;
+	if ((d = opendir(ADC_IIO_DEVICES)) != NULL) {
+		while ((de = readdir(d)) != NULL) {
+			if (strncmp(de->d_name, "trigger", 7) != 0)
+				continue;
+			snprintf(dir, sizeof(dir), "%s/%s", ADC_IIO_DEVICES, de->d_name);
+			if ((adcSysRead(dir, "name", buf, sizeof(buf)) > 0) && (strcmp(buf, ADC_TRIGGER) == 0)) {
+				snprintf(trigDir, sizeof(trigDir), "%s", dir);
+				break;
+			}
+		}
+		closedir(d);
+	}
+	if (trigDir[0] == 0)
+		goto fail;
+
+	snprintf(buf, sizeof(buf), "%u", rate);
+	if (adcSysWrite(trigDir, "sampling_frequency", buf) < 0)
+		goto fail;
+	if (adcSysWrite(adcDevDir, "trigger/current_trigger", ADC_TRIGGER) < 0)
+		goto fail;
+
+	// Only our channels in the scan
+	snprintf(dir, sizeof(dir), "%s/scan_elements", adcDevDir);
+	if ((d = opendir(dir)) == NULL)
+		goto fail;
+	while ((de = readdir(d)) != NULL)
+		if (strstr(de->d_name, "_en") != NULL)
+			(void)adcSysWrite(dir, de->d_name, "0");
+	closedir(d);
+
+	n = 0;
+	for (i = 0; i < adcNumChannels; ++i) {
+		snprintf(buf, sizeof(buf), "in_voltage%d", adcChannels[i].index);
+		if (adcScanElement(buf, &adcChannels[i]) < 0)
+			goto fail;
+		order[n++] = &adcChannels[i];
+	}
+
+	adcStampOffset = -1;
+	memset(&stamp, 0, sizeof(stamp));
+	if ((adcSysWrite(adcDevDir, "current_timestamp_clock", "monotonic") == 0) &&
+	    (adcScanElement("in_timestamp", &stamp) == 0))
+		order[n++] = &stamp;
+
+	// Elements are laid out by index, each aligned to its own size
+	for (i = 1; i < n; ++i)
+		for (j = i; (j > 0) && (order[j - 1]->index > order[j]->index); --j) {
+			tmp = order[j]; order[j] = order[j - 1]; order[j - 1] = tmp;
+		}
+
+	offset = align = 0;
+	for (i = 0; i < n; ++i) {
+		offset = (offset + order[i]->bytes - 1) / order[i]->bytes * order[i]->bytes;
+		order[i]->offset = offset;
+		offset += order[i]->bytes;
+		if (order[i]->bytes > align)
+			align = order[i]->bytes;
+	}
+	adcScanBytes = (offset + align - 1) / align * align;
+	if (adcScanBytes > ADC_SCAN_MAX)
+		goto fail;
+	if (stamp.bytes == 8)
+		adcStampOffset = stamp.offset;
+
+	if (adcSysWrite(adcDevDir, "buffer/length", ADC_BUFFER_LENGTH) < 0)
+		goto fail;
+	if (adcSysWrite(adcDevDir, "buffer/enable", "1") < 0)
+		goto fail;
+
+	snprintf(dev, sizeof(dev), "/dev/%s", strrchr(adcDevDir, '/') + 1);
+	if ((adcDevFd = open(dev, O_RDONLY | O_NONBLOCK | O_CLOEXEC)) < 0)
+		goto fail;
+
+	return 0;
+
+fail:
+	adcBufferedClose();
+	return -1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * adcPolledClose: adcPolledOpen:
+ *	Keep each in_voltageN_raw open and tick a timerfd at rate.
+ */
+/*----------------------------------------------------------------------------*/
+static void adcPolledClose (void)
+{
+	int i;
+
+	for (i = 0; i < adcNumChannels; ++i) {
+		if (adcChannels[i].fd != -1)
+			close(adcChannels[i].fd);
+		adcChannels[i].fd = -1;
+	}
+
+	if (adcTimerFd != -1)
+		close(adcTimerFd);
+	adcTimerFd = -1;
+}
+
+static int adcPolledOpen (unsigned int rate)
+{
+	struct itimerspec period;
+	const char *node;
+	uint64_t ns;
+	int i;
+
+	for (i = 0; i < adcNumChannels; ++i) {
+		node = libwiring.getAdcNode ? libwiring.getAdcNode(adcChannels[i].pin) : NULL;
+		adcChannels[i].fd = node ? open(node, O_RDONLY | O_CLOEXEC) : -1;
+	}
+
+	if ((adcTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+		goto fail;
+
+	ns = 1000000000ULL / rate;
+	period.it_interval.tv_sec  = ns / 1000000000ULL;
+	period.it_interval.tv_nsec = ns % 1000000000ULL;
+	period.it_value            = period.it_interval;
+	if (timerfd_settime(adcTimerFd, 0, &period, NULL) < 0)
+		goto fail;
+
+	return 0;
+
+fail:
+	adcPolledClose();
+	return -1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * adcDecode: adcReadRaw:
+ *	One channel out of a buffered scan, or out of its sysfs attribute.
+ */
+/*----------------------------------------------------------------------------*/
+static int adcDecode (const struct adcChannel *ch, const uint8_t *scan)
+{
+	uint64_t raw = 0, mask;
+	int i;
+
+	for (i = 0; i < ch->bytes; ++i)
+		raw |= (uint64_t)scan[ch->offset + (ch->bigEndian ? (ch->bytes - 1 - i) : i)] << (8 * i);
+
+	mask = (ch->bits == 64) ? ~0ULL : ((1ULL << ch->bits) - 1);
+	raw  = (raw >> ch->shift) & mask;
+
+	if (ch->isSigned && (raw & (1ULL << (ch->bits - 1))))
+		raw |= ~mask;
+
+	return (int)(int64_t)raw;
+}
+
+static int adcReadRaw (int fd)
+{
+	char buf[16];
+	ssize_t n;
+	int i, value = 0;
+
+	if ((n = pread(fd, buf, sizeof(buf), 0)) <= 0)
+		return -1;
+
+	for (i = 0; (i < n) && (buf[i] >= '0') && (buf[i] <= '9'); ++i)
+		value = value * 10 + (buf[i] - '0');
+
+	return value;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * adcScan:
+ *	Account one scan of all the channels, and every adcDecimate scans
+ *	push a sample per channel. Full ring drops the new samples.
+ */
+/*----------------------------------------------------------------------------*/
+static void adcScan (const int *values, uint64_t timestamp)
+{
+	struct wiringPiAdcSample *s;
+	uint32_t head, tail;
+	int i;
+
+	for (i = 0; i < adcNumChannels; ++i) {
+		adcChannels[i].sum += values[i];
+		adcChannels[i].last = values[i];
+	}
+
+	if (++adcCount < adcDecimate)
+		return;
+	adcCount = 0;
+
+	head = __atomic_load_n(&adcHead, __ATOMIC_RELAXED);
+	tail = __atomic_load_n(&adcTail, __ATOMIC_ACQUIRE);
+
+	for (i = 0; i < adcNumChannels; ++i) {
+		if ((head - tail) >= ADC_RING_SIZE) {
+			__atomic_add_fetch(&adcDropped, 1, __ATOMIC_RELAXED);
+		} else {
+			s = &adcRing[head & (ADC_RING_SIZE - 1)];
+			s->timestamp = timestamp;
+			s->pin       = adcChannels[i].pin;
+			s->value     = adcAverage ? (int)(adcChannels[i].sum / adcDecimate) : adcChannels[i].last;
+			++head;
+		}
+		adcChannels[i].sum = 0;
+	}
+
+	__atomic_store_n(&adcHead, head, __ATOMIC_RELEASE);
+}
+
+/*----------------------------------------------------------------------------*/
+static void adcWake (void)
+{
+	if (__atomic_load_n(&adcWaiters, __ATOMIC_SEQ_CST) == 0)
+		return;
+
+	pthread_mutex_lock(&adcMutex);
+	pthread_cond_broadcast(&adcCond);
+	pthread_mutex_unlock(&adcMutex);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * adcThread:
+ *	The engine. Sleeps in poll on the IIO buffer or the pacing timer, and
+ *	on adcStopFd.
+ */
+/*----------------------------------------------------------------------------*/
+static void *adcThread (UNU void *arg)
+{
+	struct pollfd fds[2];
+	int values[WPI_ADC_MAX_PINS];
+	const uint8_t *scan;
+	uint64_t expired, now;
+	ssize_t n;
+	int i;
+
+	fds[0].fd     = (adcMode == WPI_ADC_BUFFERED) ? adcDevFd : adcTimerFd;
+	fds[0].events = POLLIN;
+	fds[1].fd     = adcStopFd;
+	fds[1].events = POLLIN;
+
+	for (;;) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[1].revents)
+			break;
+		if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+			break;
+		if (!(fds[0].revents & POLLIN))
+			continue;
+
+		if (adcMode == WPI_ADC_BUFFERED) {
+			if ((n = read(adcDevFd, adcScanBuf, sizeof(adcScanBuf))) <= 0)
+				continue;
+			now = wiringPiMonotonicNs();
+
+			for (scan = adcScanBuf; (scan + adcScanBytes) <= (adcScanBuf + n); scan += adcScanBytes) {
+				for (i = 0; i < adcNumChannels; ++i)
+					values[i] = adcDecode(&adcChannels[i], scan);
+				adcScan(values, (adcStampOffset < 0) ? now :
+						(uint64_t)*(const int64_t *)(scan + adcStampOffset));
+			}
+		} else {
+			if (read(adcTimerFd, &expired, sizeof(expired)) < 0)
+				continue;
+			now = wiringPiMonotonicNs();
+
+			for (i = 0; i < adcNumChannels; ++i)
+				values[i] = (adcChannels[i].fd != -1) ?
+					adcReadRaw(adcChannels[i].fd) : analogRead(adcChannels[i].pin);
+			adcScan(values, now);
+		}
+
+		adcWake();
+	}
+
+	// Stopped or the device went away, either way waiters must not hang
+	pthread_mutex_lock(&adcMutex);
+	adcRunning = FALSE;
+	pthread_cond_broadcast(&adcCond);
+	pthread_mutex_unlock(&adcMutex);
+
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiAdcStart:
+ *	Sample pins rate times a second until wiringPiAdcStop. Each decimate
+ *	scans give one sample per pin, the last reading or, with average, the
+ *	mean of the group. Returns WPI_ADC_BUFFERED or WPI_ADC_POLLED, or -1.
+ *	While the IIO buffer is enabled, analogRead on its channels fails.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiAdcStart (const int *pins, int numPins, unsigned int rate, int decimate, int average)
+{
+	int i;
+
+	if (libwiring.mode == MODE_UNINITIALISED) {
+		(void)wiringPiFailure (
+			WPI_FATAL,
+			"wiringPiAdcStart: wiringPi has not been initialised. " \
+			"Unable to continue.\n") ;
+		return -1;
+	}
+
+	if ((numPins < 1) || (numPins > WPI_ADC_MAX_PINS) || (rate < 1)) {
+		msg(MSG_WARN, "%s: Invalid pins or rate.\n", __func__);
+		return -1;
+	}
+
+	wiringPiAdcStop();
+	pthread_once(&adcOnce, adcInitOnce);
+
+	memset(adcChannels, 0, sizeof(adcChannels));
+	for (i = 0; i < numPins; ++i) {
+		adcChannels[i].pin = pins[i];
+		adcChannels[i].fd  = -1;
+	}
+	adcNumChannels = numPins;
+	adcDecimate    = (decimate < 1) ? 1 : decimate;
+	adcAverage     = average;
+	adcCount       = 0;
+
+	adcHead = adcTail = adcDropped = 0;
+
+	if ((adcStopFd = eventfd(0, EFD_CLOEXEC)) < 0)
+		return -1;
+
+	if (libwiring.getAdcNode && (adcBufferedOpen(rate) == 0))
+		adcMode = WPI_ADC_BUFFERED;
+	else if (adcPolledOpen(rate) == 0)
+		adcMode = WPI_ADC_POLLED;
+	else
+		goto fail;
+
+	// Set before the thread runs, it clears it again if it gives up early
+	pthread_mutex_lock(&adcMutex);
+	adcRunning = TRUE;
+	pthread_mutex_unlock(&adcMutex);
+
+	if (pthread_create(&adcThreadId, NULL, adcThread, NULL) != 0) {
+		adcRunning = FALSE;
+		if (adcMode == WPI_ADC_BUFFERED)
+			adcBufferedClose();
+		else
+			adcPolledClose();
+		goto fail;
+	}
+
+	return adcMode;
+
+fail:
+	close(adcStopFd);
+	adcStopFd = -1;
+	return -1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiAdcRead:
+ *	Take up to max samples out of the ring, oldest first, without blocking.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiAdcRead (struct wiringPiAdcSample *samples, int max)
+{
+	uint32_t head, tail, n, i;
+
+	if (max <= 0)
+		return 0;
+
+	tail = __atomic_load_n(&adcTail, __ATOMIC_RELAXED);
+	head = __atomic_load_n(&adcHead, __ATOMIC_ACQUIRE);
+
+	n = head - tail;
+	if (n > (uint32_t)max)
+		n = max;
+
+	for (i = 0; i < n; ++i)
+		samples[i] = adcRing[(tail + i) & (ADC_RING_SIZE - 1)];
+
+	__atomic_store_n(&adcTail, tail + n, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiAdcWait:
+ *	Wait up to mS (-1 forever) for count samples to be ready. Returns the
+ *	number ready, which is less than count on timeout, when stopped or
+ *	when the engine quit because the device went away.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiAdcWait (int count, int mS)
+{
+	struct timespec ts;
+	uint64_t deadline;
+	uint32_t ready;
+
+	deadline = wiringPiMonotonicNs() + (uint64_t)((mS < 0) ? 0 : mS) * 1000000ULL;
+	ts.tv_sec  = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+
+	pthread_mutex_lock(&adcMutex);
+	__atomic_add_fetch(&adcWaiters, 1, __ATOMIC_SEQ_CST);
+
+	for (;;) {
+		ready = __atomic_load_n(&adcHead, __ATOMIC_SEQ_CST) -
+			__atomic_load_n(&adcTail, __ATOMIC_RELAXED);
+		if ((ready >= (uint32_t)count) || !adcRunning)
+			break;
+		if (mS < 0)
+			pthread_cond_wait(&adcCond, &adcMutex);
+		else if (pthread_cond_timedwait(&adcCond, &adcMutex, &ts) == ETIMEDOUT)
+			break;
+	}
+
+	__atomic_sub_fetch(&adcWaiters, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&adcMutex);
+
+	return ready;
+}
+
+/*----------------------------------------------------------------------------*/
+unsigned int wiringPiAdcDropped (void)
+{
+	return __atomic_load_n(&adcDropped, __ATOMIC_RELAXED);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiAdcStop:
+ *	Stop the engine and give the channels back to analogRead. Samples
+ *	still in the ring can be read until the next wiringPiAdcStart.
+ */
+/*----------------------------------------------------------------------------*/
+void wiringPiAdcStop (void)
+{
+	uint64_t one = 1;
+
+	// Not adcRunning, the thread clears that itself when the device fails
+	if (adcStopFd == -1)
+		return;
+
+	if (write(adcStopFd, &one, sizeof(one)) < 0)
+		msg(MSG_WARN, "%s: Unable to stop the engine: %s\n", __func__, strerror(errno));
+	pthread_join(adcThreadId, NULL);
+
+	if (adcMode == WPI_ADC_BUFFERED)
+		adcBufferedClose();
+	else
+		adcPolledClose();
+
+	close(adcStopFd);
+	adcStopFd = -1;
+
+	pthread_mutex_lock(&adcMutex);
+	adcRunning = FALSE;
+	pthread_cond_broadcast(&adcCond);
+	pthread_mutex_unlock(&adcMutex);
+}
@@ -50,7 +50,10 @@
 #include <errno.h>
 #include <string.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <asm/ioctl.h>
 #include <linux/i2c.h>
 #include <linux/i2c-dev.h>
@@ -60,9 +63,271 @@
 
 uint8_t fdToSlaveAddress[1024] = { 0xFF };
 
+
+/*
+ * Soft I2C:
+ *	A bit-banged master on any two GPIOs, see wiringPiI2CSetupSoft. The
+ *	lines are open drain: the output latches are held low and a line is
+ *	pulled low by making it an output, released by making it an input
+ *	(pinModeFast, one register access on the mmap boards). A slave may
+ *	stretch the clock by holding SCL low for up to SOFT_STRETCH_NS.
+ *	An fd opened on a soft bus is an eventfd standing in for /dev/i2c-N;
+ *	softFds maps it to its bus, so the wiringPiI2C* calls work on it.
+ *********************************************************************************
+ */
+
+#define	SOFT_MAX_BUSES		8
+#define	SOFT_STRETCH_NS		25000000ULL	// The SMBus clock low timeout
+
+struct softI2C
+{
+  int      sdaPin, sclPin ;
+  struct wiringPiPinHandle sda, scl ;
+  uint32_t lowNs, highNs ;
+  pthread_mutex_t lock ;
+} ;
+
+static struct softI2C  softBuses [SOFT_MAX_BUSES] ;
+static int             numSoftBuses ;
+static struct softI2C *softFds [sizeof (fdToSlaveAddress)] ;
+static struct softI2C *softDefault ;
+static pthread_mutex_t softBusLock = PTHREAD_MUTEX_INITIALIZER ;
+
+static inline struct softI2C *softBus (int fd)
+{
+  return ((fd >= 0) && (fd < (int)sizeof (fdToSlaveAddress))) ? softFds [fd] : NULL ;
+}
+
+static inline void softWait (uint32_t ns)
+{
+  uint64_t start = nanos64 () ;
+
+  while ((nanos64 () - start) < ns)
+    ;
+}
+
+static inline void sdaLow     (struct softI2C *bus) { pinModeFast (&bus->sda, OUTPUT) ; }
+static inline void sdaRelease (struct softI2C *bus) { pinModeFast (&bus->sda, INPUT) ; }
+static inline void sclLow     (struct softI2C *bus) { pinModeFast (&bus->scl, OUTPUT) ; }
+
+// Release SCL and wait for it to go high: a slave may be stretching it
+
+static int sclRelease (struct softI2C *bus)
+{
+  uint64_t start ;
+
+  pinModeFast (&bus->scl, INPUT) ;
+  if (digitalReadFast (&bus->scl))
+    return 0 ;
+
+  start = nanos64 () ;
+  while (!digitalReadFast (&bus->scl))
+    if ((nanos64 () - start) > SOFT_STRETCH_NS)
+      return -1 ;
+
+  return 0 ;
+}
+
+
+/*
+ * softStart: softStop:
+ *	(Repeated) start and stop conditions. SCL is left low after a start.
+ *	softStart returns -1 if SCL is held low, -2 if SDA is: another master
+ *	owns the bus or a slave is stuck mid byte.
+ *********************************************************************************
+ */
+
+static int softStart (struct softI2C *bus)
+{
+  sdaRelease (bus) ;
+  softWait (bus->lowNs) ;
+  if (sclRelease (bus) < 0)
+    return -1 ;
+  softWait (bus->highNs) ;
+
+  if (!digitalReadFast (&bus->sda))
+    return -2 ;
+
+  sdaLow (bus) ;
+  softWait (bus->highNs) ;
+  sclLow (bus) ;
+
+  return 0 ;
+}
+
+static void softStop (struct softI2C *bus)
+{
+  sdaLow (bus) ;
+  softWait (bus->lowNs) ;
+  (void)sclRelease (bus) ;
+  softWait (bus->highNs) ;
+  sdaRelease (bus) ;
+  softWait (bus->lowNs) ;
+}
+
+
+/*
+ * softBit: softWriteByte: softReadByte:
+ *	One clock with SDA released (to read) or driven, starting and ending
+ *	with SCL low. softWriteByte returns the slave's ACK (0) or NACK (1).
+ *********************************************************************************
+ */
+
+static int softBit (struct softI2C *bus, int bit)
+{
+  if (bit)
+    sdaRelease (bus) ;
+  else
+    sdaLow (bus) ;
+  softWait (bus->lowNs) ;
+
+  if (sclRelease (bus) < 0)
+    return -1 ;
+  softWait (bus->highNs) ;
+
+  bit = digitalReadFast (&bus->sda) ;
+  sclLow (bus) ;
+
+  return bit ;
+}
+
+static int softWriteByte (struct softI2C *bus, int value)
+{
+  int i ;
+
+  for (i = 7 ; i >= 0 ; --i)
+    if (softBit (bus, (value >> i) & 1) < 0)
+      return -1 ;
+
+  return softBit (bus, 1) ;
+}
+
+static int softReadByte (struct softI2C *bus, int ack)
+{
+  int i, bit, value = 0 ;
+
+  for (i = 0 ; i < 8 ; ++i)
+  {
+    if ((bit = softBit (bus, 1)) < 0)
+      return -1 ;
+    value = (value << 1) | bit ;
+  }
+
+  if (softBit (bus, !ack) < 0)
+    return -1 ;
+
+  return value ;
+}
+
+
+/*
+ * softTransfer:
+ *	Messages joined by repeated starts, as I2C_RDWR does. Returns the
+ *	number of messages, or -1 with errno set.
+ *********************************************************************************
+ */
+
+static int softTransfer (struct softI2C *bus, const struct wiringPiI2CBatchMsg *msgs, int count)
+{
+  const struct wiringPiI2CBatchMsg *msg ;
+  int i, j, value, err = 0 ;
+
+  pthread_mutex_lock (&bus->lock) ;
+
+  for (i = 0 ; (i < count) && !err ; ++i)
+  {
+    msg = &msgs [i] ;
+
+    if ((value = softStart (bus)) < 0)
+      { err = (value == -1) ? ETIMEDOUT : EAGAIN ; break ; }
+
+    if ((value = softWriteByte (bus, (msg->addr << 1) | (msg->read ? 1 : 0))) != 0)
+      { err = (value < 0) ? ETIMEDOUT : ENXIO ; break ; }
+
+    for (j = 0 ; j < msg->len ; ++j)
+    {
+      if (msg->read)
+      {
+	if ((value = softReadByte (bus, j != msg->len - 1)) < 0)
+	  { err = ETIMEDOUT ; break ; }
+	msg->buf [j] = value ;
+      }
+      else if ((value = softWriteByte (bus, msg->buf [j])) != 0)
+	{ err = (value < 0) ? ETIMEDOUT : EREMOTEIO ; break ; }
+    }
+  }
+
+  softStop (bus) ;
+  pthread_mutex_unlock (&bus->lock) ;
+
+  if (err)
+  {
+    errno = err ;
+    return -1 ;
+  }
+
+  return count ;
+}
+
+
+/*
+ * softSmbus:
+ *	The SMBus transfers used here, built from messages.
+ *********************************************************************************
+ */
+
+static int softSmbus (struct softI2C *bus, int fd, char rw, uint8_t command, int size, union i2c_smbus_data *data)
+{
+  struct wiringPiI2CBatchMsg msgs [2] ;
+  uint8_t out [3], in [2] ;
+  int addr = fdToSlaveAddress [fd] ;
+
+  out [0] = command ;
+
+  msgs [0].addr = addr ; msgs [0].read = FALSE ; msgs [0].buf = out ; msgs [0].len = 1 ;
+  msgs [1].addr = addr ; msgs [1].read = TRUE  ; msgs [1].buf = in ;
+
+  switch (size)
+  {
+    case I2C_SMBUS_BYTE:
+      if (rw == I2C_SMBUS_WRITE)
+	return (softTransfer (bus, msgs, 1) < 0) ? -1 : 0 ;
+      msgs [1].len = 1 ;
+      if (softTransfer (bus, &msgs [1], 1) < 0)
+	return -1 ;
+      data->byte = in [0] ;
+      return 0 ;
+
+    case I2C_SMBUS_BYTE_DATA:
+    case I2C_SMBUS_WORD_DATA:
+      if (rw == I2C_SMBUS_WRITE)
+      {
+	out [1]       = data->word & 0xFF ;
+	out [2]       = data->word >> 8 ;
+	msgs [0].len  = (size == I2C_SMBUS_BYTE_DATA) ? 2 : 3 ;
+	return (softTransfer (bus, msgs, 1) < 0) ? -1 : 0 ;
+      }
+      msgs [1].len = (size == I2C_SMBUS_BYTE_DATA) ? 1 : 2 ;
+      if (softTransfer (bus, msgs, 2) < 0)
+	return -1 ;
+      if (size == I2C_SMBUS_BYTE_DATA)
+	data->byte = in [0] ;
+      else
+	data->word = in [0] | (in [1] << 8) ;
+      return 0 ;
+  }
+
+  errno = EINVAL ;
+  return -1 ;
+}
+
 static inline int i2c_smbus_access (int fd, char rw, uint8_t command, int size, union i2c_smbus_data *data)
 {
   struct i2c_smbus_ioctl_data args ;
+  struct softI2C *bus ;
+
+  if ((bus = softBus (fd)) != NULL)
+    return softSmbus (bus, fd, rw, command, size, data) ;
 
   args.read_write = rw ;
   args.command    = command ;
@@ -126,6 +391,15 @@ int wiringPiI2CReadBlock (int fd, int reg, uint8_t *buff, int size)
 	struct i2c_msg 			msgs[2];
 
 	uint8_t reg_addr[1] = { reg };
+	struct softI2C *bus;
+
+	if ((bus = softBus(fd)) != NULL) {
+		struct wiringPiI2CBatchMsg soft[2] = {
+			{ fdToSlaveAddress[fd], FALSE, 1,    reg_addr },
+			{ fdToSlaveAddress[fd], TRUE,  size, buff     },
+		};
+		return softTransfer(bus, soft, 2);
+	}
 
 	msgs[0].addr	= fdToSlaveAddress[fd];
 	msgs[0].flags	= 0;
@@ -192,6 +466,12 @@ int wiringPiI2CWriteBlock (int fd, int reg, uint8_t *buff, int size)
 
 	struct i2c_rdwr_ioctl_data	i2c;
 	struct i2c_msg			msgs;
+	struct softI2C			*bus;
+
+	if ((bus = softBus(fd)) != NULL) {
+		struct wiringPiI2CBatchMsg soft = { fdToSlaveAddress[fd], FALSE, size + 1, temp };
+		return softTransfer(bus, &soft, 1);
+	}
 
 	msgs.addr	= fdToSlaveAddress[fd];
 	msgs.flags	= 0;
@@ -205,6 +485,265 @@ int wiringPiI2CWriteBlock (int fd, int reg, uint8_t *buff, int size)
 }
 
 
+/*
+ * wiringPiI2CGetAddress:
+ *	Slave address the fd was set up for
+ *********************************************************************************
+ */
+int wiringPiI2CGetAddress (int fd)
+{
+	if (fd < 0 || fd >= (int)sizeof(fdToSlaveAddress))
+		return -1;
+
+	return fdToSlaveAddress[fd];
+}
+
+
+/*
+ * wiringPiI2CBatchInit:
+ *	Start an empty batch on the adapter behind fd
+ *********************************************************************************
+ */
+void wiringPiI2CBatchInit (struct wiringPiI2CBatch *batch, int fd)
+{
+	batch->fd	= fd;
+	batch->count	= 0;
+	batch->used	= 0;
+}
+
+
+/*
+ * wiringPiI2CBatchWrite: wiringPiI2CBatchWriteReg8:
+ *	Queue a write. addr < 0 means the address the batch fd was set up for.
+ *	Returns the message number, or -1 if the batch is full.
+ *********************************************************************************
+ */
+static struct wiringPiI2CBatchMsg *batchMsg (struct wiringPiI2CBatch *batch, int addr)
+{
+	struct wiringPiI2CBatchMsg *msg;
+
+	if (batch->count >= WPI_I2C_BATCH_MAX)
+		return NULL;
+
+	if (addr < 0)
+		addr = wiringPiI2CGetAddress(batch->fd);
+
+	msg = &batch->msgs[batch->count];
+	msg->addr	= addr;
+	msg->read	= FALSE;
+	msg->len	= 0;
+	msg->buf	= NULL;
+
+	return msg;
+}
+
+int wiringPiI2CBatchWrite (struct wiringPiI2CBatch *batch, int addr, const uint8_t *data, int size)
+{
+	struct wiringPiI2CBatchMsg *msg;
+
+	if (size < 0 || batch->used + size > WPI_I2C_BATCH_BUF)
+		return -1;
+	if ((msg = batchMsg(batch, addr)) == NULL)
+		return -1;
+
+	msg->len = size;
+	msg->buf = &batch->buf[batch->used];
+	memcpy(msg->buf, data, size);
+	batch->used += size;
+
+	return batch->count++;
+}
+
+int wiringPiI2CBatchWriteReg8 (struct wiringPiI2CBatch *batch, int addr, int reg, int value)
+{
+	uint8_t data[2] = { reg, value };
+
+	return wiringPiI2CBatchWrite(batch, addr, data, 2);
+}
+
+
+/*
+ * wiringPiI2CBatchRead: wiringPiI2CBatchReadReg:
+ *	Queue a read into buff, which must stay valid until the batch has run.
+ *	The register form is a write of the register number and the read,
+ *	joined by a repeated start.
+ *********************************************************************************
+ */
+int wiringPiI2CBatchRead (struct wiringPiI2CBatch *batch, int addr, uint8_t *buff, int size)
+{
+	struct wiringPiI2CBatchMsg *msg;
+
+	if (size <= 0 || (msg = batchMsg(batch, addr)) == NULL)
+		return -1;
+
+	msg->read	= TRUE;
+	msg->len	= size;
+	msg->buf	= buff;
+
+	return batch->count++;
+}
+
+int wiringPiI2CBatchReadReg (struct wiringPiI2CBatch *batch, int addr, int reg, uint8_t *buff, int size)
+{
+	uint8_t reg_addr[1] = { reg };
+
+	if (batch->count + 2 > WPI_I2C_BATCH_MAX)
+		return -1;
+
+	if (wiringPiI2CBatchWrite(batch, addr, reg_addr, 1) < 0)
+		return -1;
+
+	return wiringPiI2CBatchRead(batch, addr, buff, size);
+}
+
+
+/*
+ * wiringPiI2CBatchRun:
+ *	Send all the queued messages in one ioctl. The batch is kept, so it
+ *	can be run again. Returns the number of messages sent, or -1.
+ *********************************************************************************
+ */
+int wiringPiI2CBatchRun (struct wiringPiI2CBatch *batch)
+{
+	struct i2c_rdwr_ioctl_data	i2c;
+	struct i2c_msg			msgs[WPI_I2C_BATCH_MAX];
+	int i;
+
+	if (batch->count == 0)
+		return 0;
+
+	if (softBus(batch->fd) != NULL)
+		return softTransfer(softBus(batch->fd), batch->msgs, batch->count);
+
+	for (i = 0; i < batch->count; i++) {
+		msgs[i].addr	= batch->msgs[i].addr;
+		msgs[i].flags	= batch->msgs[i].read ? I2C_M_RD : 0;
+		msgs[i].len	= batch->msgs[i].len;
+		msgs[i].buf	= batch->msgs[i].buf;
+	}
+
+	i2c.msgs	= msgs;
+	i2c.nmsgs	= batch->count;
+
+	return ioctl(batch->fd, I2C_RDWR, &i2c);
+}
+
+
+/*
+ * softBusGet: softOpen:
+ *	Find or make the soft bus on a pair of pins, and open a device on it.
+ *********************************************************************************
+ */
+static struct softI2C *softBusGet (int sdaPin, int sclPin, int speed)
+{
+	struct softI2C *bus = NULL;
+	uint32_t period;
+	int i;
+
+	pthread_mutex_lock(&softBusLock);
+
+	for (i = 0; i < numSoftBuses; i++)
+		if (softBuses[i].sdaPin == sdaPin && softBuses[i].sclPin == sclPin)
+			bus = &softBuses[i];
+
+	if (bus == NULL && numSoftBuses < SOFT_MAX_BUSES) {
+		bus = &softBuses[numSoftBuses++];
+		bus->sdaPin = sdaPin;
+		bus->sclPin = sclPin;
+		pthread_mutex_init(&bus->lock, NULL);
+
+		(void)wiringPiPinHandle(sdaPin, &bus->sda);
+		(void)wiringPiPinHandle(sclPin, &bus->scl);
+
+		// Released, with the latches ready to pull low
+		pinMode(sdaPin, INPUT);
+		pinMode(sclPin, INPUT);
+		pullUpDnControl(sdaPin, PUD_UP);
+		pullUpDnControl(sclPin, PUD_UP);
+		digitalWrite(sdaPin, LOW);
+		digitalWrite(sclPin, LOW);
+	}
+
+	// tLOW gets a little more than half the period, as the spec asks
+	if (bus != NULL && speed > 0) {
+		period       = 1000000000U / (uint32_t)speed;
+		bus->lowNs   = period * 11 / 20;
+		bus->highNs  = period - bus->lowNs;
+	}
+
+	pthread_mutex_unlock(&softBusLock);
+
+	// A slave left half way through a byte holds SDA low: clock it out
+	if (bus != NULL && !digitalReadFast(&bus->sda)) {
+		pthread_mutex_lock(&bus->lock);
+		for (i = 0; i < 9 && !digitalReadFast(&bus->sda); i++)
+			(void)softBit(bus, 1);
+		softStop(bus);
+		pthread_mutex_unlock(&bus->lock);
+	}
+
+	return bus;
+}
+
+static int softOpen (struct softI2C *bus, int devId)
+{
+	int fd;
+
+	if ((fd = eventfd(0, EFD_CLOEXEC)) < 0)
+		return wiringPiFailure (WPI_ALMOST, "Unable to open soft I2C device: %s\n", strerror (errno)) ;
+
+	if (fd >= (int)sizeof(fdToSlaveAddress)) {
+		close(fd);
+		return wiringPiFailure (WPI_ALMOST, "Unable to open soft I2C device: too many fds\n") ;
+	}
+
+	softFds[fd]		= bus;
+	fdToSlaveAddress[fd]	= devId;
+
+	return fd;
+}
+
+
+/*
+ * wiringPiI2CSetupSoft:
+ *	Open device devId on a bit-banged bus on sdaPin/sclPin at speed Hz
+ *	(100000, 400000, 1000000, ...). Devices on the same pins share the bus.
+ *	The lines need pull-ups; the internal ones are enabled but are weak.
+ *********************************************************************************
+ */
+
+int wiringPiI2CSetupSoft (int sdaPin, int sclPin, int speed, int devId)
+{
+	struct softI2C *bus;
+
+	if ((bus = softBusGet(sdaPin, sclPin, speed)) == NULL)
+		return wiringPiFailure (WPI_ALMOST, "Too many soft I2C buses\n") ;
+
+	return softOpen(bus, devId);
+}
+
+
+/*
+ * wiringPiI2CSoftDefault:
+ *	Make wiringPiI2CSetup, as the device drivers call it, open devices on
+ *	a soft bus. sdaPin -1 goes back to the kernel adapter.
+ *********************************************************************************
+ */
+
+int wiringPiI2CSoftDefault (int sdaPin, int sclPin, int speed)
+{
+	if (sdaPin < 0) {
+		softDefault = NULL;
+		return 0;
+	}
+
+	if ((softDefault = softBusGet(sdaPin, sclPin, speed)) == NULL)
+		return wiringPiFailure (WPI_ALMOST, "Too many soft I2C buses\n") ;
+
+	return 0;
+}
+
+
 /*
  * wiringPiI2CSetupInterface:
  *	Open the I2C device, and regisiter the target device
@@ -223,6 +762,7 @@ int wiringPiI2CSetupInterface (const char *device, int devId)
 	}
 
 	fdToSlaveAddress[fd] = devId;
+	softFds[fd] = NULL;
 
 	return fd ;
 }
@@ -239,6 +779,9 @@ int wiringPiI2CSetup (const int devId)
 	int model, rev, mem, maker, overVolted ;
 	const char *device = NULL;
 
+	if (softDefault != NULL)
+		return softOpen(softDefault, devId);
+
 	piBoardId (&model, &rev, &mem, &maker, &overVolted) ;
 
 	switch(model)	{
@@ -28,6 +28,34 @@ extern "C" {
 
 #include <stdint.h>
 
+// wiringPiI2CBatch:
+//	Messages for one I2C adapter, possibly to several slave addresses,
+//	sent in a single I2C_RDWR ioctl with repeated starts between them.
+//	The kernel takes at most 42 messages per ioctl. Bytes to write are
+//	copied into the batch, read buffers belong to the caller.
+//	Messages are kept in our own form so that this header does not pull
+//	in linux/i2c.h, which clashes with some i2c-dev.h copies.
+
+#define	WPI_I2C_BATCH_MAX	42
+#define	WPI_I2C_BATCH_BUF	256
+
+struct wiringPiI2CBatchMsg
+{
+	uint16_t	addr;
+	uint16_t	read;
+	uint16_t	len;
+	uint8_t		*buf;
+};
+
+struct wiringPiI2CBatch
+{
+	int		fd;
+	int		count;
+	int		used;
+	struct wiringPiI2CBatchMsg msgs[WPI_I2C_BATCH_MAX];
+	uint8_t		buf[WPI_I2C_BATCH_BUF];
+};
+
 extern int wiringPiI2CRead		(int fd);
 extern int wiringPiI2CReadReg8		(int fd, int reg);
 extern int wiringPiI2CReadReg16		(int fd, int reg);
@@ -38,6 +66,16 @@ extern int wiringPiI2CWriteReg8		(int fd, int reg, int data);
 extern int wiringPiI2CWriteReg16	(int fd, int reg, int data);
 extern int wiringPiI2CWriteBlock	(int fd, int reg, uint8_t *buff, int size);
 
+extern int wiringPiI2CGetAddress	(int fd);
+extern void wiringPiI2CBatchInit	(struct wiringPiI2CBatch *batch, int fd);
+extern int wiringPiI2CBatchWrite	(struct wiringPiI2CBatch *batch, int addr, const uint8_t *data, int size);
+extern int wiringPiI2CBatchWriteReg8	(struct wiringPiI2CBatch *batch, int addr, int reg, int value);
+extern int wiringPiI2CBatchRead	(struct wiringPiI2CBatch *batch, int addr, uint8_t *buff, int size);
+extern int wiringPiI2CBatchReadReg	(struct wiringPiI2CBatch *batch, int addr, int reg, uint8_t *buff, int size);
+extern int wiringPiI2CBatchRun		(struct wiringPiI2CBatch *batch);
+
+extern int wiringPiI2CSetupSoft	(int sdaPin, int sclPin, int speed, int devId);
+extern int wiringPiI2CSoftDefault	(int sdaPin, int sclPin, int speed);
 extern int wiringPiI2CSetupInterface	(const char *device, int devId);
 extern int wiringPiI2CSetup		(const int devId);
 
@@ -0,0 +1,1443 @@
+/*----------------------------------------------------------------------------*/
+/*
+
+	WiringPi interrupt engine for ODROIDs
+
+	All registered pins are serviced by a single event thread which waits
+	on an epoll set. Each pin is requested from the GPIO character device
+	as a v2 line with edge detection, so the kernel hands us the edge type,
+	a timestamp and a sequence number with every event. The legacy sysfs
+	"value" node is still accepted for INT_EDGE_SETUP, where the edge has
+	already been configured from outside (e.g. "gpio edge"). It is also
+	used for pins that sysfs already owns (Sys mode, or a value node that
+	is open), whose digitalRead/digitalWrite would break on unexport.
+
+	Other libraries can put their own fds on the same thread with
+	wiringPiEventAddFd, so e.g. UARTs and edges are served together.
+
+ */
+/*----------------------------------------------------------------------------*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <linux/gpio.h>
+
+/*----------------------------------------------------------------------------*/
+#include "wiringPi.h"
+
+/*----------------------------------------------------------------------------*/
+#define	ISR_MAX_PINS		256
+#define	ISR_MAX_EVENTS		16
+#define	ISR_CONSUMER		"wiringPi"
+#define	ISR_KERNEL_BUFFER	64
+
+// Edge records kept per pin for wiringPiEventRead, must be a power of 2
+#define	ISR_RING_SIZE		1024
+
+extern	struct libodroid	libwiring;
+
+/*----------------------------------------------------------------------------*/
+// Per pin edge ring
+//	Single producer (the event thread) and single consumer (whoever calls
+//	wiringPiEventRead), so head and tail only need acquire/release ordering.
+//	A ring is never freed once allocated, only reset on registration.
+/*----------------------------------------------------------------------------*/
+struct isrRingStruct {
+	uint32_t	head;		// written by the event thread
+	uint32_t	tail;		// written by the consumer
+	uint32_t	dropped;	// edges lost because the ring was full
+	struct wiringPiEventStruct ev[ISR_RING_SIZE];
+};
+
+/*----------------------------------------------------------------------------*/
+// Per pin interrupt state
+/*----------------------------------------------------------------------------*/
+struct isrPinStruct {
+	int	fd;		// line request fd or sysfs value fd
+	int	pin;		// pin number as registered by the caller
+	int	gpio;		// native gpio number
+	int	sysfs;		// TRUE if fd is a sysfs value node
+	void	(*function)(void);
+	void	(*eventFunction)(struct wiringPiEventStruct *event, void *userdata);
+	void	*userdata;
+	int	busy;		// callbacks of this pin being dispatched
+
+	struct wiringPiEventStruct last;
+	struct isrRingStruct *ring;
+};
+
+static struct isrPinStruct isrPins [ISR_MAX_PINS];
+
+// Pins of extension nodes, which report their own edges through
+//	wiringPiNodeEvent. fd is ISR_NODE_FD while a pin is registered.
+#define	ISR_MAX_NODE_PINS	64
+#define	ISR_NODE_FD		(-2)
+
+static struct isrPinStruct isrNodePins [ISR_MAX_NODE_PINS];
+
+// Foreign fds on the event thread, see wiringPiEventAddFd. Their epoll
+//	data is ISR_FD_TAG | index. isrFdBusy is the index whose handler is
+//	running, so wiringPiEventDelFd can wait for it.
+#define	ISR_MAX_FDS		32
+#define	ISR_FD_TAG		0x10000
+
+struct isrFdStruct {
+	int	fd;
+	void	(*function)(int fd, uint32_t events, void *userdata);
+	void	*userdata;
+};
+
+static struct isrFdStruct isrFds [ISR_MAX_FDS];
+static int		isrFdBusy = -1;
+
+static pthread_mutex_t	isrMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	isrCond;
+static pthread_t	isrThreadId;
+static pthread_once_t	isrOnce = PTHREAD_ONCE_INIT;
+static int		isrEpollFd = -1;
+
+// The event currently being dispatched, for wiringPiISRLastEvent
+static __thread const struct wiringPiEventStruct *isrCurrent = NULL;
+
+/*----------------------------------------------------------------------------*/
+static void isrInitOnce (void)
+{
+	pthread_condattr_t cattr;
+	int i;
+
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&isrCond, &cattr);
+	pthread_condattr_destroy(&cattr);
+
+	for (i = 0; i < ISR_MAX_PINS; i++)
+		isrPins[i].fd = -1;
+	for (i = 0; i < ISR_MAX_NODE_PINS; i++)
+		isrNodePins[i].fd = -1;
+	for (i = 0; i < ISR_MAX_FDS; i++)
+		isrFds[i].fd = -1;
+}
+
+static void isrInit (void)
+{
+	pthread_once (&isrOnce, isrInitOnce);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrNodeFind:
+ *	The registration of an extension node pin, if any. Called with
+ *	isrMutex held.
+ */
+/*----------------------------------------------------------------------------*/
+static struct isrPinStruct *isrNodeFind (int pin)
+{
+	int i;
+
+	for (i = 0; i < ISR_MAX_NODE_PINS; i++)
+		if (isrNodePins[i].fd != -1 && isrNodePins[i].pin == pin)
+			return &isrNodePins[i];
+
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrPinIdle:
+ *	Wait until no callback of p is running, unless it is the caller
+ *	itself. Called with isrMutex held.
+ */
+/*----------------------------------------------------------------------------*/
+static void isrPinIdle (struct isrPinStruct *p)
+{
+	if (isrCurrent != NULL && isrCurrent->pin == p->pin)
+		return;
+
+	while (p->busy)
+		pthread_cond_wait (&isrCond, &isrMutex);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrPinSet:
+ *	Fill in a registration, keeping the count of callbacks still running
+ *	from the one it replaces.
+ */
+/*----------------------------------------------------------------------------*/
+static void isrPinSet (struct isrPinStruct *p, int fd, int pin, int gpio, void (*function)(void),
+	void (*eventFunction)(struct wiringPiEventStruct *, void *), void *userdata,
+	struct isrRingStruct *ring)
+{
+	int busy = p->busy;
+
+	memset(p, 0, sizeof(*p));
+	p->pin			= pin;
+	p->gpio			= gpio;
+	p->function		= function;
+	p->eventFunction	= eventFunction;
+	p->userdata		= userdata;
+	p->ring			= ring;
+	p->busy			= busy;
+	__atomic_store_n (&p->fd, fd, __ATOMIC_RELEASE);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrGpioToSlot:
+ *	Translate the native gpio number into an index of the pin table,
+ *	in the same way as the sysfs file descriptor table.
+ */
+/*----------------------------------------------------------------------------*/
+static int isrGpioToSlot (int gpio)
+{
+	int slot = PIN_NUM_CALC_SYSFD(gpio);
+
+	return (slot < 0 || slot >= ISR_MAX_PINS) ? -1 : slot;
+}
+
+#if defined(GPIO_V2_GET_LINE_IOCTL)
+/*----------------------------------------------------------------------------*/
+static int readSysValue (const char *dir, const char *node, char *buf, int len)
+{
+	char path[PATH_MAX];
+	int fd, n;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, node);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n <= 0)
+		return -1;
+
+	buf[n] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * gpioToLabel:
+ *	Find the label of the gpiochip holding a native gpio number, and the
+ *	line offset in it. The character device doesn't know the global
+ *	numbering, so it is taken from /sys/class/gpio/gpiochipN/{base,ngpio}
+ *	(CONFIG_GPIO_SYSFS) or, without that, from the ranges listed in
+ *	/sys/kernel/debug/gpio (debugfs, root only). With neither, -1.
+ */
+/*----------------------------------------------------------------------------*/
+static int gpioToLabel (int gpio, char *label, int len, int *line)
+{
+	struct dirent *ent;
+	DIR *dir;
+	FILE *fp;
+	char path[PATH_MAX], buf[256], *p;
+	int base, last, ngpio;
+
+	if ((dir = opendir("/sys/class/gpio")) != NULL) {
+		while ((ent = readdir(dir)) != NULL) {
+			if (strncmp(ent->d_name, "gpiochip", 8) != 0)
+				continue;
+
+			snprintf(path, sizeof(path), "/sys/class/gpio/%s", ent->d_name);
+			if (readSysValue(path, "base", buf, sizeof(buf)) < 0)
+				continue;
+			base = atoi(buf);
+			if (readSysValue(path, "ngpio", buf, sizeof(buf)) < 0)
+				continue;
+			ngpio = atoi(buf);
+
+			if (gpio < base || gpio >= base + ngpio)
+				continue;
+
+			closedir(dir);
+			*line = gpio - base;
+			return readSysValue(path, "label", label, len);
+		}
+		closedir(dir);
+	}
+
+	// "gpiochip0: GPIOs 410-495, parent: platform/ff634400.bank, periphs-banks:"
+	if ((fp = fopen("/sys/kernel/debug/gpio", "r")) == NULL)
+		return -1;
+
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		if (sscanf(buf, "gpiochip%*d: GPIOs %d-%d,", &base, &last) != 2)
+			continue;
+		if (gpio < base || gpio > last)
+			continue;
+		if ((p = strrchr(buf, ',')) == NULL)
+			break;
+
+		fclose(fp);
+		p += strspn(p, ", ");
+		p[strcspn(p, ":\n")] = '\0';
+		snprintf(label, len, "%s", p);
+		*line = gpio - base;
+		return 0;
+	}
+	fclose(fp);
+
+	return -1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * gpioToChipLine:
+ *	Find the gpiochip device and line offset of a native gpio number: the
+ *	character device whose label matches the chip gpioToLabel found.
+ *	Returns an open file descriptor of the gpiochip.
+ */
+/*----------------------------------------------------------------------------*/
+static int gpioToChipLine (int gpio, int *line)
+{
+	struct gpiochip_info info;
+	struct dirent *ent;
+	DIR *dir;
+	char path[PATH_MAX], label[32];
+	int fd = -1;
+
+	if (gpioToLabel(gpio, label, sizeof(label), line) < 0)
+		return -1;
+
+	if ((dir = opendir("/dev")) == NULL)
+		return -1;
+
+	while ((ent = readdir(dir)) != NULL) {
+		if (strncmp(ent->d_name, "gpiochip", 8) != 0)
+			continue;
+
+		snprintf(path, sizeof(path), "/dev/%s", ent->d_name);
+		if ((fd = open(path, O_RDWR | O_CLOEXEC)) < 0)
+			continue;
+
+		memset(&info, 0, sizeof(info));
+		if (ioctl(fd, GPIO_GET_CHIPINFO_IOCTL, &info) == 0 &&
+		    strncmp(info.label, label, sizeof(info.label)) == 0)
+			break;
+
+		close(fd);
+		fd = -1;
+	}
+	closedir(dir);
+
+	return fd;
+}
+
+/*----------------------------------------------------------------------------*/
+// A pin still exported through sysfs is busy for the character device
+/*----------------------------------------------------------------------------*/
+static void isrUnexport (int gpio)
+{
+	char path[64];
+	FILE *unexport;
+
+	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d", gpio);
+	if (access(path, F_OK) == 0) {
+		if ((unexport = fopen("/sys/class/gpio/unexport", "w")) != NULL) {
+			fprintf(unexport, "%d\n", gpio);
+			fclose(unexport);
+		}
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrRequestLine:
+ *	Request a single input line with edge detection from the gpiochip.
+ *	Returns the line request file descriptor.
+ */
+/*----------------------------------------------------------------------------*/
+static int isrRequestLine (int gpio, int mode)
+{
+	struct gpio_v2_line_request req;
+	int chipFd, line = 0, ret;
+
+	isrUnexport(gpio);
+
+	if ((chipFd = gpioToChipLine(gpio, &line)) < 0)
+		return -1;
+
+	memset(&req, 0, sizeof(req));
+	req.offsets[0]		= line;
+	req.num_lines		= 1;
+	req.event_buffer_size	= ISR_KERNEL_BUFFER;
+	strncpy(req.consumer, ISR_CONSUMER, sizeof(req.consumer) - 1);
+
+	req.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+	switch (mode) {
+	case	INT_EDGE_FALLING:
+		req.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+		break;
+	case	INT_EDGE_RISING:
+		req.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+		break;
+	default:
+		req.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING |
+				    GPIO_V2_LINE_FLAG_EDGE_FALLING;
+		break;
+	}
+
+	ret = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req);
+	close(chipFd);
+
+	if (ret < 0)
+		return -1;
+
+	fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+	return req.fd;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * captureLine:
+ *	wiringPiCaptureEdges through the character device: the line is
+ *	requested as an output driven low, then switched to an input with edge
+ *	detection, so every edge is timestamped by the kernel.
+ *	Returns -1 before the start pulse if the line can't be had this way.
+ */
+/*----------------------------------------------------------------------------*/
+static int captureLine (int gpio, int pin, int lowUs, int timeUs,
+	struct wiringPiEventStruct *evs, int max)
+{
+	struct gpio_v2_line_request req;
+	struct gpio_v2_line_config cfg;
+	struct gpio_v2_line_event le[ISR_MAX_EVENTS];
+	struct pollfd pfd;
+	uint64_t start, end, now;
+	ssize_t len;
+	int chipFd, line = 0, ret, i, n = 0;
+
+	isrUnexport(gpio);
+
+	if ((chipFd = gpioToChipLine(gpio, &line)) < 0)
+		return -1;
+
+	memset(&req, 0, sizeof(req));
+	req.offsets[0]		= line;
+	req.num_lines		= 1;
+	req.event_buffer_size	= ISR_KERNEL_BUFFER;
+	strncpy(req.consumer, ISR_CONSUMER, sizeof(req.consumer) - 1);
+
+	req.config.flags		= GPIO_V2_LINE_FLAG_OUTPUT;
+	req.config.num_attrs		= 1;
+	req.config.attrs[0].mask	= 1;
+	req.config.attrs[0].attr.id	= GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+	req.config.attrs[0].attr.values	= 0;
+
+	ret = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &req);
+	close(chipFd);
+
+	if (ret < 0)
+		return -1;
+
+	delayMicroseconds(lowUs);
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.flags = GPIO_V2_LINE_FLAG_INPUT |
+		    GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+	start = wiringPiMonotonicNs();
+	if (ioctl(req.fd, GPIO_V2_LINE_SET_CONFIG_IOCTL, &cfg) < 0) {
+		close(req.fd);
+		return -1;
+	}
+	end = start + (uint64_t)timeUs * 1000;
+
+	pfd.fd	   = req.fd;
+	pfd.events = POLLIN;
+
+	while (n < max && (now = wiringPiMonotonicNs()) < end) {
+		if (poll(&pfd, 1, (end - now + 999999) / 1000000) <= 0)
+			break;
+		if ((len = read(req.fd, le, sizeof(le))) <= 0)
+			break;
+
+		for (i = 0; i < (int)(len / sizeof(le[0])) && n < max; i++, n++) {
+			evs[n].pin	 = pin;
+			evs[n].edge	 = (le[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE) ?
+						INT_EDGE_RISING : INT_EDGE_FALLING;
+			evs[n].timestamp = le[i].timestamp_ns - start;
+			evs[n].seq	 = le[i].line_seqno;
+		}
+	}
+	close(req.fd);
+
+	return n;
+}
+#else
+/*----------------------------------------------------------------------------*/
+static int isrRequestLine (int UNU gpio, int UNU mode)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+static int captureLine (int UNU gpio, int UNU pin, int UNU lowUs, int UNU timeUs,
+	struct wiringPiEventStruct UNU *evs, int UNU max)
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif	/* GPIO_V2_GET_LINE_IOCTL */
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrOpenSysfs:
+ *	Open the value node of a pin which has been exported and had its
+ *	edge set from outside. It may already be open in Sys mode.
+ */
+/*----------------------------------------------------------------------------*/
+static int isrOpenSysfs (int gpio)
+{
+	char fName[64], c;
+	int fd, slot = PIN_NUM_CALC_SYSFD(gpio);
+
+	if (slot >= 0 && slot < 256 && libwiring.sysFds[slot] != -1)
+		fd = dup(libwiring.sysFds[slot]);
+	else {
+		snprintf(fName, sizeof(fName), "/sys/class/gpio/gpio%d/value", gpio);
+		fd = open(fName, O_RDONLY | O_CLOEXEC);
+	}
+
+	if (fd < 0)
+		return -1;
+
+	// Clear any initial pending interrupt
+	lseek(fd, 0, SEEK_SET);
+	if (read(fd, &c, 1) < 0)
+		msg(MSG_WARN, "%s: Unable to read from the sysfs GPIO node: %s\n",
+			__func__, strerror(errno));
+
+	return fd;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrSysfsOwned: isrSysfsEdge:
+ *	A pin that wiringPi reaches through its sysfs value node must stay
+ *	exported, so its edges are taken from sysfs too: make it an input and
+ *	set the edge, exporting it first if need be.
+ */
+/*----------------------------------------------------------------------------*/
+static int isrSysfsOwned (int gpio)
+{
+	int slot = PIN_NUM_CALC_SYSFD(gpio);
+
+	if (libwiring.mode == MODE_GPIO_SYS)
+		return TRUE;
+
+	return (slot >= 0 && slot < 256 && libwiring.sysFds[slot] != -1);
+}
+
+static int isrSysfsEdge (int gpio, int mode)
+{
+	const char *edge;
+	char path[64];
+	FILE *fp;
+
+	switch (mode) {
+	case	INT_EDGE_FALLING:	edge = "falling";	break;
+	case	INT_EDGE_RISING:	edge = "rising";	break;
+	case	INT_EDGE_BOTH:		edge = "both";		break;
+	default:			edge = "none";		break;
+	}
+
+	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d", gpio);
+	if (access(path, F_OK) != 0) {
+		if ((fp = fopen("/sys/class/gpio/export", "w")) == NULL)
+			return -1;
+		fprintf(fp, "%d\n", gpio);
+		fclose(fp);
+	}
+
+	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/direction", gpio);
+	if ((fp = fopen(path, "w")) == NULL)
+		return -1;
+	fprintf(fp, "in\n");
+	fclose(fp);
+
+	snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/edge", gpio);
+	if ((fp = fopen(path, "w")) == NULL)
+		return -1;
+	fprintf(fp, "%s\n", edge);
+	fclose(fp);
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrReadEvents:
+ *	Drain the pending edges of one pin into evs. Called with isrMutex held.
+ *	Returns the number of events stored.
+ */
+/*----------------------------------------------------------------------------*/
+static int isrReadEvents (struct isrPinStruct *p, struct wiringPiEventStruct *evs, int max)
+{
+	int n = 0;
+
+	if (p->sysfs) {
+		char c;
+
+		lseek(p->fd, 0, SEEK_SET);
+		if (read(p->fd, &c, 1) < 0)
+			return 0;
+
+		evs[0].pin	 = p->pin;
+		evs[0].edge	 = (c == '0') ? INT_EDGE_FALLING : INT_EDGE_RISING;
+		evs[0].timestamp = wiringPiMonotonicNs();
+		evs[0].seq	 = p->last.seq + 1;
+		n = 1;
+	}
+#if defined(GPIO_V2_GET_LINE_IOCTL)
+	else {
+		struct gpio_v2_line_event le[ISR_MAX_EVENTS];
+		ssize_t len;
+		int i;
+
+		if (max > ISR_MAX_EVENTS)
+			max = ISR_MAX_EVENTS;
+
+		if ((len = read(p->fd, le, sizeof(le[0]) * max)) <= 0)
+			return 0;
+
+		n = len / sizeof(le[0]);
+		for (i = 0; i < n; i++) {
+			evs[i].pin	 = p->pin;
+			evs[i].edge	 = (le[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE) ?
+						INT_EDGE_RISING : INT_EDGE_FALLING;
+			evs[i].timestamp = le[i].timestamp_ns;
+			evs[i].seq	 = le[i].line_seqno;
+		}
+	}
+#endif
+
+	if (n > 0)
+		p->last = evs[n - 1];
+
+	return n;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrRingPush:
+ *	Producer side of the edge ring, called with isrMutex held by the event
+ *	thread or, for node pins, by the node reporting the edge.
+ */
+/*----------------------------------------------------------------------------*/
+static void isrRingPush (struct isrRingStruct *ring, const struct wiringPiEventStruct *evs, int count)
+{
+	uint32_t head, tail;
+	int i;
+
+	head = __atomic_load_n (&ring->head, __ATOMIC_RELAXED);
+	tail = __atomic_load_n (&ring->tail, __ATOMIC_ACQUIRE);
+
+	for (i = 0; i < count; i++) {
+		if (head - tail >= ISR_RING_SIZE) {
+			__atomic_add_fetch (&ring->dropped, count - i, __ATOMIC_RELAXED);
+			break;
+		}
+		ring->ev[head & (ISR_RING_SIZE - 1)] = evs[i];
+		head++;
+	}
+
+	__atomic_store_n (&ring->head, head, __ATOMIC_RELEASE);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrThread:
+ *	The one and only interrupt thread. Waits on every registered pin and
+ *	runs the callbacks in the order the edges were read.
+ */
+/*----------------------------------------------------------------------------*/
+static void *isrThread (UNU void *arg)
+{
+	struct epoll_event ready[ISR_MAX_EVENTS];
+	struct wiringPiEventStruct evs[ISR_MAX_EVENTS];
+	void (*function)(void);
+	void (*eventFunction)(struct wiringPiEventStruct *, void *);
+	void (*fdFunction)(int, uint32_t, void *);
+	void *userdata;
+	int i, j, n, count, slot, fd;
+
+	(void)piHiPri (55) ;	// Only effective if we run as root
+
+	for (;;) {
+		n = epoll_wait(isrEpollFd, ready, ISR_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			slot = ready[i].data.u32;
+
+			if (slot & ISR_FD_TAG) {
+				slot &= ~ISR_FD_TAG;
+
+				pthread_mutex_lock (&isrMutex);
+				fd		= isrFds[slot].fd;
+				fdFunction	= isrFds[slot].function;
+				userdata	= isrFds[slot].userdata;
+				isrFdBusy	= (fd != -1) ? slot : -1;
+				pthread_mutex_unlock (&isrMutex);
+
+				if (fd != -1)
+					fdFunction(fd, ready[i].events, userdata);
+
+				pthread_mutex_lock (&isrMutex);
+				isrFdBusy = -1;
+				pthread_cond_broadcast (&isrCond);
+				pthread_mutex_unlock (&isrMutex);
+				continue;
+			}
+
+			pthread_mutex_lock (&isrMutex);
+			if (isrPins[slot].fd == -1) {
+				pthread_mutex_unlock (&isrMutex);
+				continue;
+			}
+			count		= isrReadEvents(&isrPins[slot], evs, ISR_MAX_EVENTS);
+			function	= isrPins[slot].function;
+			eventFunction	= isrPins[slot].eventFunction;
+			userdata	= isrPins[slot].userdata;
+			if (count > 0) {
+				isrRingPush(isrPins[slot].ring, evs, count);
+				isrPins[slot].busy++;
+				pthread_cond_broadcast (&isrCond);
+			}
+			pthread_mutex_unlock (&isrMutex);
+
+			if (count <= 0)
+				continue;
+
+			// Callbacks run without any lock held
+			for (j = 0; j < count; j++) {
+				isrCurrent = &evs[j];
+				if (eventFunction)
+					eventFunction(&evs[j], userdata);
+				else if (function)
+					function();
+			}
+			isrCurrent = NULL;
+
+			pthread_mutex_lock (&isrMutex);
+			isrPins[slot].busy--;
+			pthread_cond_broadcast (&isrCond);
+			pthread_mutex_unlock (&isrMutex);
+		}
+	}
+
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+static int isrStartThread (void)
+{
+	if (isrEpollFd != -1)
+		return 0;
+
+	if ((isrEpollFd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		return -1;
+
+	if (pthread_create(&isrThreadId, NULL, isrThread, NULL) != 0) {
+		close(isrEpollFd);
+		isrEpollFd = -1;
+		return -1;
+	}
+	pthread_detach(isrThreadId);
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+static int isrPinToGpio (int pin)
+{
+	if (libwiring.mode == MODE_UNINITIALISED) {
+		(void)wiringPiFailure (
+			WPI_FATAL,
+			"wiringPiISR: wiringPi has not been initialised. " \
+			"Unable to continue.\n") ;
+		return -1;
+	}
+
+	if (!libwiring.getModeToGpio) {
+		(void)wiringPiFailure (
+			WPI_FATAL,
+			"%s: getModeToGpio function not initialize!\n",
+			__func__);
+		return -1;
+	}
+
+	return libwiring.getModeToGpio(libwiring.mode, pin);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * waitForInterrupt:
+ *	Wait for an edge on a native gpio number for up to mS milliseconds
+ *	(-1 waits forever). Pins owned by the interrupt engine are woken by the
+ *	event thread, anything else falls back to polling the sysfs node.
+ *	Returns > 0 on an interrupt, 0 on timeout and < 0 on error.
+ */
+/*----------------------------------------------------------------------------*/
+int waitForInterrupt (int pin, int mS)
+{
+	struct pollfd polls;
+	struct timespec deadline;
+	struct isrPinStruct *p;
+	uint32_t seq;
+	uint8_t c;
+	int fd, x, slot;
+
+	isrInit();
+
+	slot = isrGpioToSlot(pin);
+
+	pthread_mutex_lock (&isrMutex);
+	if ((p = isrNodeFind(pin)) == NULL && slot >= 0 && isrPins[slot].fd != -1)
+		p = &isrPins[slot];
+
+	if (p != NULL) {
+		seq = p->last.seq;
+
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec  += mS / 1000;
+		deadline.tv_nsec += (long)(mS % 1000) * 1000000L;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		while (p->fd != -1 && p->last.seq == seq) {
+			if (mS < 0)
+				pthread_cond_wait (&isrCond, &isrMutex);
+			else if (pthread_cond_timedwait (&isrCond, &isrMutex, &deadline) == ETIMEDOUT)
+				break;
+		}
+		x = (p->last.seq != seq);
+		pthread_mutex_unlock (&isrMutex);
+		return x;
+	}
+	pthread_mutex_unlock (&isrMutex);
+
+	if (slot < 0 || (fd = libwiring.sysFds[slot]) == -1)
+		return -2;
+
+	// Setup poll structure
+	polls.fd     = fd;
+	polls.events = POLLPRI | POLLERR;
+
+	// Wait for it ...
+	x = poll (&polls, 1, mS);
+
+	// If no error, do a dummy read to clear the interrupt
+	//	A one character read appars to be enough.
+	if (x > 0) {
+		lseek (fd, 0, SEEK_SET);	// Rewind
+		if (read (fd, &c, 1) < 0)	// Read & clear
+			fprintf(stderr, "Unable to read from the file descriptor: %s \n", strerror(errno));
+	}
+	return x;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrNodeRegister: isrNodeCancel:
+ *	Extension node pins: the node is asked to start or stop reporting the
+ *	edges of pin, which it then hands to wiringPiNodeEvent.
+ */
+/*----------------------------------------------------------------------------*/
+static int isrNodeRegister (struct wiringPiNodeStruct *node, int pin, int mode, void (*function)(void),
+	void (*eventFunction)(struct wiringPiEventStruct *, void *), void *userdata)
+{
+	struct isrPinStruct *p;
+	struct isrRingStruct *ring;
+	int i;
+
+	if (node->watch == NULL || mode == INT_EDGE_SETUP) {
+		(void)wiringPiFailure (WPI_FATAL, "wiringPiISR: pin %d can't report edges\n", pin);
+		return -1;
+	}
+
+	isrInit();
+
+	pthread_mutex_lock (&isrMutex);
+	if ((p = isrNodeFind(pin)) == NULL)
+		for (i = 0; i < ISR_MAX_NODE_PINS && p == NULL; i++)
+			if (isrNodePins[i].fd == -1)
+				p = &isrNodePins[i];
+
+	if (p == NULL) {
+		pthread_mutex_unlock (&isrMutex);
+		(void)wiringPiFailure (WPI_FATAL, "wiringPiISR: too many extension pins\n");
+		return -1;
+	}
+
+	if ((ring = p->ring) == NULL &&
+	    (ring = calloc(1, sizeof(*ring))) == NULL) {
+		pthread_mutex_unlock (&isrMutex);
+		(void)wiringPiFailure (WPI_FATAL, "wiringPiISR: Unable to allocate memory: %s\n",
+			strerror (errno));
+		return -1;
+	}
+	ring->head = ring->tail = ring->dropped = 0;
+
+	isrPinSet(p, ISR_NODE_FD, pin, -1, function, eventFunction, userdata, ring);
+	pthread_mutex_unlock (&isrMutex);
+
+	if (node->watch(node, pin, mode) < 0) {
+		pthread_mutex_lock (&isrMutex);
+		p->fd = -1;
+		pthread_mutex_unlock (&isrMutex);
+		(void)wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to watch pin %d\n", pin);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int isrNodeCancel (struct wiringPiNodeStruct *node, int pin)
+{
+	struct isrPinStruct *p;
+
+	isrInit();
+
+	pthread_mutex_lock (&isrMutex);
+	if ((p = isrNodeFind(pin)) == NULL) {
+		pthread_mutex_unlock (&isrMutex);
+		(void)wiringPiFailure (WPI_FATAL,
+			"%s: wiringPiISRCancel: Unregister for the interrupt pin failed!\n", __func__);
+		return -1;
+	}
+
+	p->fd			= -1;
+	p->function		= NULL;
+	p->eventFunction	= NULL;
+
+	pthread_cond_broadcast (&isrCond);
+	isrPinIdle(p);
+	pthread_mutex_unlock (&isrMutex);
+
+	return node->watch(node, pin, -1);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiNodeEvent:
+ *	For extension nodes: deliver an edge of one of their pins, as the
+ *	event thread does for local ones. Callbacks run in the caller.
+ */
+/*----------------------------------------------------------------------------*/
+void wiringPiNodeEvent (const struct wiringPiEventStruct *event)
+{
+	struct wiringPiEventStruct ev = *event;
+	struct isrPinStruct *p;
+	void (*function)(void);
+	void (*eventFunction)(struct wiringPiEventStruct *, void *);
+	void *userdata;
+
+	isrInit();
+
+	pthread_mutex_lock (&isrMutex);
+	if ((p = isrNodeFind(ev.pin)) == NULL) {
+		pthread_mutex_unlock (&isrMutex);
+		return;
+	}
+	p->last		= ev;
+	function	= p->function;
+	eventFunction	= p->eventFunction;
+	userdata	= p->userdata;
+	isrRingPush(p->ring, &ev, 1);
+	p->busy++;
+	pthread_cond_broadcast (&isrCond);
+	pthread_mutex_unlock (&isrMutex);
+
+	isrCurrent = &ev;
+	if (eventFunction)
+		eventFunction(&ev, userdata);
+	else if (function)
+		function();
+	isrCurrent = NULL;
+
+	pthread_mutex_lock (&isrMutex);
+	p->busy--;
+	pthread_cond_broadcast (&isrCond);
+	pthread_mutex_unlock (&isrMutex);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrPinRelease:
+ *	Stop watching the pin in slot and wait for its callbacks to finish.
+ *	Called with isrMutex held.
+ */
+/*----------------------------------------------------------------------------*/
+static void isrPinRelease (int slot)
+{
+	int fd = isrPins[slot].fd;
+
+	epoll_ctl(isrEpollFd, EPOLL_CTL_DEL, fd, NULL);
+	close(fd);
+
+	__atomic_store_n (&isrPins[slot].fd, -1, __ATOMIC_RELEASE);
+	isrPins[slot].function		= NULL;
+	isrPins[slot].eventFunction	= NULL;
+	libwiring.isrFunctions[slot] = NULL;
+
+	// Wake up anyone still waiting on this pin
+	pthread_cond_broadcast (&isrCond);
+	isrPinIdle(&isrPins[slot]);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * isrRegister:
+ *	Start watching pin. The pin is taken from the gpio character device
+ *	unless mode is INT_EDGE_SETUP, in which case the already configured
+ *	sysfs node is used, or sysfs already owns the pin.
+ */
+/*----------------------------------------------------------------------------*/
+static int isrRegister (int pin, int mode, void (*function)(void),
+	void (*eventFunction)(struct wiringPiEventStruct *, void *), void *userdata)
+{
+	struct epoll_event ev;
+	struct isrRingStruct *ring;
+	struct wiringPiNodeStruct *node;
+	int GpioPin, slot, fd, sysfs;
+
+	if ((node = wiringPiFindNode(pin)) != NULL)
+		return isrNodeRegister(node, pin, mode, function, eventFunction, userdata);
+
+	if ((GpioPin = isrPinToGpio(pin)) < 0)
+		return -1;
+
+	if ((slot = isrGpioToSlot(GpioPin)) < 0) {
+		(void)wiringPiFailure (WPI_FATAL, "wiringPiISR: pin %d out of range\n", pin);
+		return -1;
+	}
+
+	isrInit();
+
+	// Replace an earlier registration of the same pin
+	pthread_mutex_lock (&isrMutex);
+	if (isrPins[slot].fd != -1)
+		isrPinRelease(slot);
+	pthread_mutex_unlock (&isrMutex);
+
+	sysfs = (mode == INT_EDGE_SETUP) || isrSysfsOwned(GpioPin);
+
+	if (mode == INT_EDGE_SETUP)
+		fd = isrOpenSysfs(GpioPin);
+	else if (sysfs)
+		fd = (isrSysfsEdge(GpioPin, mode) < 0) ? -1 : isrOpenSysfs(GpioPin);
+	else
+		fd = isrRequestLine(GpioPin, mode);
+
+	if (fd < 0) {
+		(void)wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to request gpio %d: %s\n",
+			GpioPin, strerror (errno));
+		return -1;
+	}
+
+	pthread_mutex_lock (&isrMutex);
+	if (isrStartThread() < 0) {
+		pthread_mutex_unlock (&isrMutex);
+		close(fd);
+		(void)wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to start interrupt thread: %s\n",
+			strerror (errno));
+		return -1;
+	}
+
+	if ((ring = isrPins[slot].ring) == NULL &&
+	    (ring = calloc(1, sizeof(*ring))) == NULL) {
+		pthread_mutex_unlock (&isrMutex);
+		close(fd);
+		(void)wiringPiFailure (WPI_FATAL, "wiringPiISR: Unable to allocate memory: %s\n",
+			strerror (errno));
+		return -1;
+	}
+	ring->head = ring->tail = ring->dropped = 0;
+
+	isrPinSet(&isrPins[slot], fd, pin, GpioPin, function, eventFunction, userdata, ring);
+	isrPins[slot].sysfs		= sysfs;
+	libwiring.isrFunctions[slot] = function;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events   = isrPins[slot].sysfs ? (EPOLLPRI | EPOLLERR) : EPOLLIN;
+	ev.data.u32 = slot;
+	if (epoll_ctl(isrEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		__atomic_store_n (&isrPins[slot].fd, -1, __ATOMIC_RELEASE);
+		pthread_mutex_unlock (&isrMutex);
+		close(fd);
+		(void)wiringPiFailure (WPI_FATAL, "wiringPiISR: unable to watch gpio %d: %s\n",
+			GpioPin, strerror (errno));
+		return -1;
+	}
+	pthread_mutex_unlock (&isrMutex);
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiISR:
+ *	Register function to be called on an edge of pin. function may be
+ *	NULL, in which case the edges are only queued for wiringPiEventRead.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiISR (int pin, int mode, void (*function)(void))
+{
+	return isrRegister(pin, mode, function, NULL, NULL);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiISREvent:
+ *	As wiringPiISR, but function is handed the edge record and userdata.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiISREvent (int pin, int mode,
+	void (*function)(struct wiringPiEventStruct *event, void *userdata), void *userdata)
+{
+	return isrRegister(pin, mode, NULL, function, userdata);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiISRCancel:
+ *	Stop watching pin. Once this returns its callback is not running and
+ *	won't be called again, unless called from the callback itself.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiISRCancel (int pin)
+{
+	struct wiringPiNodeStruct *node;
+	int GpioPin, slot;
+
+	if ((node = wiringPiFindNode(pin)) != NULL)
+		return isrNodeCancel(node, pin);
+
+	if ((GpioPin = isrPinToGpio(pin)) < 0)
+		return -1;
+
+	if ((slot = isrGpioToSlot(GpioPin)) < 0)
+		return -1;
+
+	isrInit();
+
+	pthread_mutex_lock (&isrMutex);
+	if (isrPins[slot].fd == -1) {
+		pthread_mutex_unlock (&isrMutex);
+		(void)wiringPiFailure (WPI_FATAL,
+			"%s: wiringPiISRCancel: Unregister for the interrupt pin failed!\n", __func__);
+		return -1;
+	}
+
+	isrPinRelease(slot);
+	pthread_mutex_unlock (&isrMutex);
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiISRLastEvent:
+ *	Fetch the edge type, kernel timestamp (CLOCK_MONOTONIC, ns) and
+ *	sequence number of the edge that fired the running callback. Outside
+ *	a callback it returns the most recent edge seen on pin.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiISRLastEvent (int pin, struct wiringPiEventStruct *event)
+{
+	struct isrPinStruct *p;
+	int GpioPin, slot;
+
+	if (isrCurrent && isrCurrent->pin == pin) {
+		*event = *isrCurrent;
+		return 0;
+	}
+
+	if (wiringPiFindNode(pin) != NULL) {
+		isrInit();
+
+		pthread_mutex_lock (&isrMutex);
+		if ((p = isrNodeFind(pin)) != NULL)
+			*event = p->last;
+		pthread_mutex_unlock (&isrMutex);
+
+		return (p != NULL && event->seq != 0) ? 0 : -1;
+	}
+
+	if ((GpioPin = isrPinToGpio(pin)) < 0)
+		return -1;
+
+	if ((slot = isrGpioToSlot(GpioPin)) < 0)
+		return -1;
+
+	isrInit();
+
+	pthread_mutex_lock (&isrMutex);
+	*event = isrPins[slot].last;
+	pthread_mutex_unlock (&isrMutex);
+
+	return (event->seq != 0) ? 0 : -1;
+}
+
+/*----------------------------------------------------------------------------*/
+static struct isrRingStruct *isrPinToRing (int pin)
+{
+	struct isrPinStruct *p;
+	struct isrRingStruct *ring = NULL;
+	int GpioPin, slot;
+
+	if (wiringPiFindNode(pin) != NULL) {
+		isrInit();
+
+		pthread_mutex_lock (&isrMutex);
+		if ((p = isrNodeFind(pin)) != NULL)
+			ring = p->ring;
+		pthread_mutex_unlock (&isrMutex);
+
+		return ring;
+	}
+
+	if ((GpioPin = isrPinToGpio(pin)) < 0)
+		return NULL;
+
+	if ((slot = isrGpioToSlot(GpioPin)) < 0)
+		return NULL;
+
+	isrInit();
+
+	if (__atomic_load_n (&isrPins[slot].fd, __ATOMIC_ACQUIRE) == -1)
+		return NULL;
+
+	return __atomic_load_n (&isrPins[slot].ring, __ATOMIC_ACQUIRE);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiEventRead:
+ *	Drain up to n queued edges of pin into buf, oldest first, without
+ *	blocking. Only one thread may read a given pin at a time.
+ *	Returns the number of edges copied, or -1 if pin is not registered.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiEventRead (int pin, struct wiringPiEventStruct *buf, int n)
+{
+	struct isrRingStruct *ring;
+	uint32_t head, tail;
+	int count = 0;
+
+	if ((ring = isrPinToRing(pin)) == NULL)
+		return -1;
+
+	tail = __atomic_load_n (&ring->tail, __ATOMIC_RELAXED);
+	head = __atomic_load_n (&ring->head, __ATOMIC_ACQUIRE);
+
+	while (tail != head && count < n)
+		buf[count++] = ring->ev[tail++ & (ISR_RING_SIZE - 1)];
+
+	__atomic_store_n (&ring->tail, tail, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiEventDropped:
+ *	Number of edges of pin thrown away because its queue was full.
+ */
+/*----------------------------------------------------------------------------*/
+unsigned int wiringPiEventDropped (int pin)
+{
+	struct isrRingStruct *ring;
+
+	if ((ring = isrPinToRing(pin)) == NULL)
+		return 0;
+
+	return __atomic_load_n (&ring->dropped, __ATOMIC_RELAXED);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiEventAddFd:
+ *	Have the event thread call function whenever fd is ready for events
+ *	(EPOLLIN, ...). Handlers run on the event thread, one at a time, so
+ *	must not block.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiEventAddFd (int fd, uint32_t events,
+	void (*function)(int fd, uint32_t events, void *userdata), void *userdata)
+{
+	struct epoll_event ev;
+	int i;
+
+	isrInit();
+
+	pthread_mutex_lock (&isrMutex);
+	if (isrStartThread() < 0) {
+		pthread_mutex_unlock (&isrMutex);
+		return -1;
+	}
+
+	for (i = 0; i < ISR_MAX_FDS; i++)
+		if (isrFds[i].fd == -1)
+			break;
+
+	if (i == ISR_MAX_FDS) {
+		pthread_mutex_unlock (&isrMutex);
+		errno = ENOSPC;
+		return -1;
+	}
+
+	isrFds[i].fd		= fd;
+	isrFds[i].function	= function;
+	isrFds[i].userdata	= userdata;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events   = events;
+	ev.data.u32 = ISR_FD_TAG | i;
+	if (epoll_ctl(isrEpollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		isrFds[i].fd = -1;
+		pthread_mutex_unlock (&isrMutex);
+		return -1;
+	}
+	pthread_mutex_unlock (&isrMutex);
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiEventDelFd:
+ *	Stop watching fd. Once this returns its handler is not running and
+ *	won't be called again, unless called from the handler itself.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiEventDelFd (int fd)
+{
+	int i;
+
+	isrInit();
+
+	pthread_mutex_lock (&isrMutex);
+	for (i = 0; i < ISR_MAX_FDS; i++)
+		if (isrFds[i].fd == fd)
+			break;
+
+	if (i == ISR_MAX_FDS) {
+		pthread_mutex_unlock (&isrMutex);
+		return -1;
+	}
+
+	epoll_ctl(isrEpollFd, EPOLL_CTL_DEL, fd, NULL);
+	isrFds[i].fd = -1;
+
+	if (!pthread_equal(pthread_self(), isrThreadId))
+		while (isrFdBusy == i)
+			pthread_cond_wait (&isrCond, &isrMutex);
+	pthread_mutex_unlock (&isrMutex);
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * capturePolled:
+ *	wiringPiCaptureEdges by sampling the pin through its handle. An edge
+ *	can only be timed to the sampling gap, so a capture which sees one
+ *	after losing the CPU for longer than CAPTURE_MAX_GAP_NS is abandoned.
+ */
+/*----------------------------------------------------------------------------*/
+#define	CAPTURE_MAX_GAP_NS	10000
+
+static int capturePolled (int pin, int lowUs, int timeUs,
+	struct wiringPiEventStruct *evs, int max)
+{
+	struct wiringPiPinHandle handle;
+	uint64_t start, end, last, now;
+	int level, value, n = 0;
+
+	(void)wiringPiPinHandle(pin, &handle);
+
+	digitalWrite(pin, LOW);
+	pinMode(pin, OUTPUT);
+	delayMicroseconds(lowUs);
+	pinModeFast(&handle, INPUT);
+
+	start = last = nanos64();
+	end   = start + (uint64_t)timeUs * 1000;
+	level = digitalReadFast(&handle);
+
+	while (n < max) {
+		value = digitalReadFast(&handle);
+		now   = nanos64();
+
+		if (now >= end)
+			break;
+
+		if (value != level) {
+			if (now - last > CAPTURE_MAX_GAP_NS) {
+				errno = EINTR;
+				return -1;
+			}
+			evs[n].pin	 = pin;
+			evs[n].edge	 = value ? INT_EDGE_RISING : INT_EDGE_FALLING;
+			evs[n].timestamp = now - start;
+			evs[n].seq	 = n + 1;
+			level = value;
+			n++;
+		}
+		last = now;
+	}
+
+	return n;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiCaptureEdges:
+ *	Pull pin low for lowUs, let it go and record its edges for timeUs, for
+ *	sensors that answer a start pulse with a pulse train (MaxDetect/DHT).
+ *	On-board pins use the kernel's edge timestamps, anything else (or a
+ *	kernel without gpio v2) samples the pin. Timestamps are nS from the
+ *	release. Returns the number of edges stored, or -1.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiCaptureEdges (int pin, int lowUs, int timeUs,
+	struct wiringPiEventStruct *evs, int max)
+{
+	int gpio, n;
+
+	// Pins that sysfs owns are sampled, taking the line would unexport them
+	if (wiringPiFindNode(pin) == NULL && (gpio = isrPinToGpio(pin)) >= 0 &&
+	    !isrSysfsOwned(gpio))
+		if ((n = captureLine(gpio, pin, lowUs, timeUs, evs, max)) >= 0)
+			return n;
+
+	return capturePolled(pin, lowUs, timeUs, evs, max);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
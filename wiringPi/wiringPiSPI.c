@@ -24,10 +24,13 @@
 
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/eventfd.h>
 #include <asm/ioctl.h>
 #include <linux/spi/spidev.h>
 
@@ -46,6 +49,92 @@ static const uint16_t    spiDelay       = 0;
 static uint32_t    spiSpeeds [8];
 static int         spiFds [8];
 
+// Bit-banged channels, see wiringPiSPISetupSoft. Pins without a handle
+//	(not wired, or on an extension node) fall back to digitalWrite/Read.
+
+struct softSpi
+{
+  struct wiringPiPinHandle sclk, mosi, miso, cs ;
+  int      haveMosi, haveMiso, haveCs ;
+  int      mode ;
+  uint32_t halfNs ;			// Half a clock period, 0 for flat out
+} ;
+
+static struct softSpi *spiSoft [8] ;
+
+
+/*
+ * softSetSpeed:
+ *	Also parks the clock at the idle level of the new mode.
+ *********************************************************************************
+ */
+
+static void softSetSpeed (struct softSpi *soft, int speed, int mode)
+{
+  soft->mode   = mode & (SPI_MODE_3 | SPI_LSB_FIRST) ;
+  soft->halfNs = (speed > 0) ? 500000000U / (uint32_t)speed : 0 ;
+
+  digitalWriteFast (&soft->sclk, (soft->mode & SPI_CPOL) ? HIGH : LOW) ;
+}
+
+
+/*
+ * softTransfer:
+ *	Clock len bytes out of tx and into rx (either may be NULL, and they
+ *	may be the same buffer). The chip select is left to the caller.
+ *	CPOL is the idle level of the clock. With CPHA=0 MOSI is set up half
+ *	a clock before the first edge and sampled on it; with CPHA=1 it
+ *	changes on the first edge and is sampled on the second.
+ *********************************************************************************
+ */
+
+static void softTransfer (struct softSpi *soft, const unsigned char *tx, unsigned char *rx, int len, uint32_t halfNs)
+{
+  int idle   = (soft->mode & SPI_CPOL) ? HIGH : LOW ;
+  int cpha   = (soft->mode & SPI_CPHA) != 0 ;
+  int lsb    = (soft->mode & SPI_LSB_FIRST) != 0 ;
+  uint64_t t = halfNs ? nanos64 () : 0 ;
+  unsigned int out, in, bit ;
+  int i, b ;
+
+  for (i = 0 ; i < len ; ++i)
+  {
+    out = tx ? tx [i] : 0 ;
+    in  = 0 ;
+
+    for (b = 0 ; b < 8 ; ++b)
+    {
+      bit = lsb ? (1U << b) : (0x80U >> b) ;
+
+      if (cpha)
+	digitalWriteFast (&soft->sclk, !idle) ;
+
+      if (soft->haveMosi)
+	digitalWriteFast (&soft->mosi, out & bit) ;
+
+      if (halfNs) { t += halfNs ; while (nanos64 () < t) ; }
+
+      digitalWriteFast (&soft->sclk, cpha ? idle : !idle) ;
+      if (soft->haveMiso && digitalReadFast (&soft->miso))
+	in |= bit ;
+
+      if (halfNs) { t += halfNs ; while (nanos64 () < t) ; }
+
+      if (!cpha)
+	digitalWriteFast (&soft->sclk, idle) ;
+    }
+
+    if (rx)
+      rx [i] = in ;
+  }
+}
+
+static void softSelect (struct softSpi *soft, int select)
+{
+  if (soft->haveCs)
+    digitalWriteFast (&soft->cs, select ? LOW : HIGH) ;
+}
+
 
 /*
  * wiringPiSPIGetFd:
@@ -74,6 +163,14 @@ int wiringPiSPIDataRW (int channel, unsigned char *data, int len)
 
   channel &= 0x7 ;
 
+  if (spiSoft [channel] != NULL)
+  {
+    softSelect   (spiSoft [channel], TRUE) ;
+    softTransfer (spiSoft [channel], data, data, len, spiSoft [channel]->halfNs) ;
+    softSelect   (spiSoft [channel], FALSE) ;
+    return len ;
+  }
+
 // Mentioned in spidev.h but not used in the original kernel documentation
 //	test program )-:
 
@@ -89,6 +186,185 @@ int wiringPiSPIDataRW (int channel, unsigned char *data, int len)
   return ioctl (spiFds [channel], SPI_IOC_MESSAGE(1), &spi) ;
 }
 
+
+/*
+ * wiringPiSPIBatchInit:
+ *	Start an empty batch of transfers for the given channel.
+ *********************************************************************************
+ */
+
+void wiringPiSPIBatchInit (struct wiringPiSPIBatch *batch, int channel)
+{
+  batch->channel = channel & 0x7 ;
+  batch->count   = 0 ;
+}
+
+
+/*
+ * wiringPiSPIBatchAddEx:
+ *	Queue one transfer. tx may be NULL to send zeros and rx NULL to drop
+ *	what is read. speed 0 uses the speed of the channel, bitsPerWord 0 the
+ *	default 8. csChange deselects the chip after this transfer, which is
+ *	what separates commands to the device; it is ignored on the last one.
+ *	Returns the segment number, or -1 if the batch is full.
+ *********************************************************************************
+ */
+
+int wiringPiSPIBatchAddEx (struct wiringPiSPIBatch *batch, const unsigned char *tx, unsigned char *rx, int len,
+			   int speed, int delayUs, int bitsPerWord, int csChange)
+{
+  struct spi_ioc_transfer *spi ;
+
+  if ((batch->count >= WPI_SPI_BATCH_MAX) || (len <= 0))
+    return -1 ;
+
+  spi = &batch->xfer [batch->count] ;
+  memset (spi, 0, sizeof (*spi)) ;
+
+  spi->tx_buf        = (unsigned long)tx ;
+  spi->rx_buf        = (unsigned long)rx ;
+  spi->len           = len ;
+  spi->delay_usecs   = delayUs ;
+  spi->speed_hz      = speed ? (uint32_t)speed : spiSpeeds [batch->channel] ;
+  spi->bits_per_word = bitsPerWord ? bitsPerWord : spiBPW ;
+  spi->cs_change     = csChange ? 1 : 0 ;
+
+  return batch->count++ ;
+}
+
+
+/*
+ * wiringPiSPIBatchAdd:
+ *	Queue one command at the channel's speed: the chip is deselected
+ *	after it, as with a wiringPiSPIDataRW call.
+ *********************************************************************************
+ */
+
+int wiringPiSPIBatchAdd (struct wiringPiSPIBatch *batch, const unsigned char *tx, unsigned char *rx, int len)
+{
+  return wiringPiSPIBatchAddEx (batch, tx, rx, len, 0, spiDelay, 0, TRUE) ;
+}
+
+
+/*
+ * wiringPiSPIBatchRun:
+ *	Send the whole batch in one ioctl.
+ *	Returns the number of bytes transferred, or -1. Soft channels only
+ *	clock 8 bit words, and fail the whole batch (EINVAL) on anything else.
+ *********************************************************************************
+ */
+
+int wiringPiSPIBatchRun (struct wiringPiSPIBatch *batch)
+{
+  struct softSpi *soft = spiSoft [batch->channel] ;
+  struct spi_ioc_transfer *spi ;
+  uint8_t csLast ;
+  int i, ret ;
+
+  if (batch->count == 0)
+    return 0 ;
+
+// Soft channels walk the batch as spidev would
+
+  if (soft != NULL)
+  {
+    for (i = 0 ; i < batch->count ; ++i)
+      if (batch->xfer [i].bits_per_word != 8)
+      {
+	errno = EINVAL ;
+	return -1 ;
+      }
+
+    ret = 0 ;
+    softSelect (soft, TRUE) ;
+    for (i = 0 ; i < batch->count ; ++i)
+    {
+      spi = &batch->xfer [i] ;
+      softTransfer (soft, (const unsigned char *)(uintptr_t)spi->tx_buf, (unsigned char *)(uintptr_t)spi->rx_buf,
+		spi->len, spi->speed_hz ? 500000000U / spi->speed_hz : soft->halfNs) ;
+      ret += spi->len ;
+      if (spi->delay_usecs)
+	delayMicroseconds (spi->delay_usecs) ;
+      if (spi->cs_change && (i != batch->count - 1))
+      {
+	softSelect (soft, FALSE) ;
+	softSelect (soft, TRUE) ;
+      }
+    }
+    softSelect (soft, FALSE) ;
+    return ret ;
+  }
+
+// cs_change on the last transfer would leave the chip selected
+
+  csLast = batch->xfer [batch->count - 1].cs_change ;
+  batch->xfer [batch->count - 1].cs_change = 0 ;
+
+  ret = ioctl (spiFds [batch->channel], SPI_IOC_MESSAGE(batch->count), batch->xfer) ;
+
+  batch->xfer [batch->count - 1].cs_change = csLast ;
+
+  return ret ;
+}
+
+/*
+ * wiringPiSPISetupSoft:
+ *	Make channel a bit-banged SPI master on any GPIOs. mosiPin, misoPin
+ *	and csPin may be -1 when not wired; the chip select is active low.
+ *	Later wiringPiSPISetup calls on the channel, as the device drivers
+ *	make, only change its speed and mode, so every driver works over it.
+ *	Returns a placeholder fd for wiringPiSPIGetFd.
+ *********************************************************************************
+ */
+
+int wiringPiSPISetupSoft (int channel, int sclkPin, int mosiPin, int misoPin, int csPin, int speed, int mode)
+{
+	struct softSpi *soft ;
+	int fd ;
+
+	channel &= 0x7;
+
+	if (spiSoft [channel] != NULL)
+		return wiringPiSPISetupInterface(NULL, channel, speed, mode);
+
+	if ((soft = calloc (1, sizeof (*soft))) == NULL)
+		return wiringPiFailure (WPI_ALMOST, "Out of memory for soft SPI\n");
+
+	if ((fd = eventfd (0, EFD_CLOEXEC)) < 0) {
+		free (soft) ;
+		return wiringPiFailure (WPI_ALMOST,
+			"Unable to create the soft SPI fd: %s\n", strerror (errno));
+	}
+
+	(void)wiringPiPinHandle (sclkPin, &soft->sclk) ;
+	if ((soft->haveMosi = (mosiPin >= 0)))
+		(void)wiringPiPinHandle (mosiPin, &soft->mosi) ;
+	if ((soft->haveMiso = (misoPin >= 0)))
+		(void)wiringPiPinHandle (misoPin, &soft->miso) ;
+	if ((soft->haveCs = (csPin >= 0)))
+		(void)wiringPiPinHandle (csPin, &soft->cs) ;
+
+	// Idle levels first, then drive the pins
+	softSetSpeed (soft, speed, mode) ;
+	pinMode (sclkPin, OUTPUT) ;
+	if (soft->haveMosi) {
+		digitalWrite (mosiPin, LOW) ;
+		pinMode (mosiPin, OUTPUT) ;
+	}
+	if (soft->haveMiso)
+		pinMode (misoPin, INPUT) ;
+	if (soft->haveCs) {
+		digitalWrite (csPin, HIGH) ;
+		pinMode (csPin, OUTPUT) ;
+	}
+
+	spiSpeeds [channel] = speed ;
+	spiFds    [channel] = fd ;
+	spiSoft   [channel] = soft ;
+
+	return fd ;
+}
+
 /*
  * wiringPiSPISetupInterface:
  *	Open the SPI device, and set it up, with the mode, etc.
@@ -100,7 +376,15 @@ int wiringPiSPISetupInterface	(const char *device, int channel, int speed, int m
 	int fd ;
 
 	channel &= 0x7;
-	mode    &= 3;
+
+	// Soft channels also take SPI_LSB_FIRST
+	if (spiSoft [channel] != NULL) {
+		spiSpeeds [channel] = speed ;
+		softSetSpeed (spiSoft [channel], speed, mode) ;
+		return spiFds [channel] ;
+	}
+
+	mode &= 3;
 
 	if ((fd = open (device, O_RDWR)) < 0)
 		return wiringPiFailure (WPI_ALMOST,
@@ -136,15 +420,19 @@ int wiringPiSPISetupMode (int channel, int speed, int mode)
 	char device[25];
 	int model, temp;
 
+	// Channels set up with wiringPiSPISetupSoft stay bit-banged
+	if (spiSoft [channel & 0x7] != NULL)
+		return wiringPiSPISetupInterface(NULL, channel, speed, mode);
+
 	piBoardId (&model, &temp, &temp, &temp, &temp) ;
 
 	switch(model)	{
 	case MODEL_ODROID_C2:
 		return wiringPiFailure (WPI_ALMOST,
-			"ODROID C2 does not support hardware SPI. Check out the SPI bitbang and use wiringPiSPISetupInterface.\n");
+			"ODROID C2 does not support hardware SPI. Use wiringPiSPISetupSoft.\n");
 	case MODEL_ODROID_HC4:
 		return wiringPiFailure (WPI_ALMOST,
-			"ODROID HC4 does not support hardware SPI.\n");
+			"ODROID HC4 does not support hardware SPI. Use wiringPiSPISetupSoft.\n");
 	case MODEL_ODROID_C1:
 	case MODEL_ODROID_N2:
 	case MODEL_ODROID_C4:
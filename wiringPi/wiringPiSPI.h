@@ -22,6 +22,23 @@
  ***********************************************************************
  */
 
+#include <linux/spi/spidev.h>
+
+// wiringPiSPIBatch:
+//	A list of transfers sent to one channel in a single SPI_IOC_MESSAGE
+//	ioctl. Segments are kept after wiringPiSPIBatchRun, so a scan can be
+//	built once and run again and again. Note that spidev limits the total
+//	number of bytes of one message (bufsiz, 4096 by default).
+
+#define	WPI_SPI_BATCH_MAX	64
+
+struct wiringPiSPIBatch
+{
+  int channel ;
+  int count ;
+  struct spi_ioc_transfer xfer [WPI_SPI_BATCH_MAX] ;
+} ;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -29,6 +46,13 @@ extern "C" {
 int wiringPiSPIGetFd	(int channel) ;
 int wiringPiSPIDataRW	(int channel, unsigned char *data, int len) ;
 
+void wiringPiSPIBatchInit	(struct wiringPiSPIBatch *batch, int channel) ;
+int  wiringPiSPIBatchAdd	(struct wiringPiSPIBatch *batch, const unsigned char *tx, unsigned char *rx, int len) ;
+int  wiringPiSPIBatchAddEx	(struct wiringPiSPIBatch *batch, const unsigned char *tx, unsigned char *rx, int len,
+				 int speed, int delayUs, int bitsPerWord, int csChange) ;
+int  wiringPiSPIBatchRun	(struct wiringPiSPIBatch *batch) ;
+
+int wiringPiSPISetupSoft	(int channel, int sclkPin, int mosiPin, int misoPin, int csPin, int speed, int mode) ;
 int wiringPiSPISetupInterface	(const char *device, int channel, int speed, int mode) ;
 int wiringPiSPISetupMode	(int channel, int speed, int mode) ;
 int wiringPiSPISetup		(int channel, int speed) ;
@@ -0,0 +1,481 @@
+/*----------------------------------------------------------------------------*/
+/*
+
+	WiringPi waveform engine for ODROIDs
+
+	Waveforms are lists of {offset, set, clear} steps over a port group.
+	All of them are played by a single SCHED_FIFO thread pinned to one
+	CPU. The thread sleeps with clock_nanosleep on absolute CLOCK_MONOTONIC
+	deadlines until just before the next step, then spins the rest of the
+	way, the margin being the wake-up latency measured when it starts.
+	Each step is one digitalWritePortMasked, so pins sharing a register
+	change together.
+
+ */
+/*----------------------------------------------------------------------------*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+
+/*----------------------------------------------------------------------------*/
+#include "wiringPi.h"
+
+/*----------------------------------------------------------------------------*/
+#define	WAVE_PRIORITY		80
+
+// Time given to the engine to pick up a wave that was just started
+#define	WAVE_LEAD_NS		2000000ULL
+
+// Longest single sleep, so that new waves are noticed while idling
+#define	WAVE_POLL_NS		1000000ULL
+
+/*----------------------------------------------------------------------------*/
+// A loaded program. Programs are swapped at a period boundary, the one
+//	replaced is kept in retired until the next load or free, so that the
+//	engine never calls free().
+/*----------------------------------------------------------------------------*/
+struct waveProgram {
+	int		numSteps;
+	uint64_t	period;		// 0 plays the steps once
+	struct wiringPiWaveStep steps[];
+};
+
+struct wiringPiWave {
+	struct wiringPiPortGroup group;
+
+	struct waveProgram	*prog;
+	struct waveProgram	*next;
+	struct waveProgram	*retired;
+
+	uint64_t	start;		// start of the current period
+	int		step;		// next step to play
+	int		active;
+
+	struct wiringPiWave	*link;
+};
+
+static struct wiringPiWave *waveList;
+static struct wiringPiWaveStats waveStats;
+
+static pthread_mutex_t	waveMutex;
+static pthread_cond_t	waveCond;
+static pthread_once_t	waveOnce = PTHREAD_ONCE_INIT;
+static pthread_t	waveThreadId;
+static int		waveRunning;
+
+static int		waveCpu = -1;
+static int		wavePriority = WAVE_PRIORITY;
+static int		waveReconfig;
+
+/*----------------------------------------------------------------------------*/
+static void waveInitOnce (void)
+{
+	pthread_mutexattr_t mattr;
+	pthread_condattr_t cattr;
+
+	// The engine runs SCHED_FIFO, so callers holding the lock borrow its
+	//	priority rather than stall it.
+	pthread_mutexattr_init(&mattr);
+	pthread_mutexattr_setprotocol(&mattr, PTHREAD_PRIO_INHERIT);
+	pthread_mutex_init(&waveMutex, &mattr);
+	pthread_mutexattr_destroy(&mattr);
+
+	pthread_condattr_init(&cattr);
+	pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+	pthread_cond_init(&waveCond, &cattr);
+	pthread_condattr_destroy(&cattr);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * waveConfigure:
+ *	Pin the calling thread to waveCpu and make it SCHED_FIFO.
+ */
+/*----------------------------------------------------------------------------*/
+static void waveConfigure (void)
+{
+	struct sched_param param;
+	cpu_set_t cpus;
+	int cpu = waveCpu;
+
+	if (cpu < 0)
+		cpu = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+
+	if (cpu >= 0 && cpu < CPU_SETSIZE) {
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+			msg(MSG_WARN, "%s: Unable to pin to cpu %d: %s\n", __func__, cpu, strerror(errno));
+	}
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = wavePriority;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+		msg(MSG_WARN, "%s: Unable to set SCHED_FIFO, timing will suffer.\n", __func__);
+}
+
+/*----------------------------------------------------------------------------*/
+static void waveUnlink (struct wiringPiWave *wave)
+{
+	struct wiringPiWave **pp;
+
+	for (pp = &waveList; *pp; pp = &(*pp)->link) {
+		if (*pp == wave) {
+			*pp = wave->link;
+			break;
+		}
+	}
+	wave->link   = NULL;
+	wave->active = FALSE;
+	pthread_cond_broadcast(&waveCond);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wavePlay:
+ *	Play every step of the wave that is due, return its next deadline.
+ *	Called with waveMutex held.
+ */
+/*----------------------------------------------------------------------------*/
+static uint64_t wavePlay (struct wiringPiWave *wave, uint64_t now)
+{
+	const struct wiringPiWaveStep *step;
+	struct waveProgram *prog;
+	uint64_t deadline, late, skip;
+
+	for (;;) {
+		prog = wave->prog;
+
+		if (wave->step >= prog->numSteps) {
+			if (prog->period == 0) {
+				waveUnlink(wave);
+				return UINT64_MAX;
+			}
+
+			wave->start += prog->period;
+			wave->step   = 0;
+
+			if (wave->next) {
+				wave->retired = prog;
+				wave->prog    = prog = wave->next;
+				wave->next    = NULL;
+			}
+
+			// Fell behind by a whole period or more, drop those periods
+			//	but keep the phase.
+			if (prog->period && now >= wave->start + prog->period) {
+				skip = (now - wave->start) / prog->period;
+				wave->start += skip * prog->period;
+				waveStats.overruns += skip;
+			}
+		}
+
+		step = &prog->steps[wave->step];
+		deadline = wave->start + step->offset;
+		if (deadline > now)
+			return deadline;
+
+		digitalWritePortMasked(&wave->group, step->set, step->set | step->clear);
+		wave->step++;
+
+		late = wiringPiMonotonicNs() - deadline;
+		waveStats.steps++;
+		waveStats.lateSum += late;
+		if (late > waveStats.lateMax)
+			waveStats.lateMax = late > UINT32_MAX ? UINT32_MAX : (uint32_t)late;
+	}
+}
+
+/*----------------------------------------------------------------------------*/
+static void *waveThread (UNU void *arg)
+{
+	struct wiringPiWave *wave, *link;
+	uint64_t now, next, deadline;
+
+	waveConfigure();
+
+	// How early to stop sleeping before a step, as delayMicroseconds does
+	waveStats.slack = (uint32_t)wiringPiDelaySlack();
+
+	pthread_mutex_lock(&waveMutex);
+	for (;;) {
+		if (waveReconfig) {
+			waveReconfig = FALSE;
+			waveConfigure();
+		}
+
+		if (waveList == NULL) {
+			pthread_cond_wait(&waveCond, &waveMutex);
+			continue;
+		}
+
+		now  = wiringPiMonotonicNs();
+		next = UINT64_MAX;
+		for (wave = waveList; wave; wave = link) {
+			link = wave->link;
+			deadline = wavePlay(wave, now);
+			if (deadline < next)
+				next = deadline;
+		}
+		pthread_mutex_unlock(&waveMutex);
+
+		// Sleep to just before the deadline, spin the rest
+		now = wiringPiMonotonicNs();
+		if (next > now + waveStats.slack) {
+			deadline = next - waveStats.slack;
+			if (deadline > now + WAVE_POLL_NS)
+				deadline = now + WAVE_POLL_NS;
+			wiringPiSleepAbs(deadline);
+		} else {
+			while (wiringPiMonotonicNs() < next)
+				;
+		}
+
+		pthread_mutex_lock(&waveMutex);
+	}
+
+	return NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiWaveSetup:
+ *	Choose the CPU (-1 for the last one) and SCHED_FIFO priority of the
+ *	engine thread. May be called while it runs.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiWaveSetup (int cpu, int priority)
+{
+	if (priority < sched_get_priority_min(SCHED_FIFO) ||
+	    priority > sched_get_priority_max(SCHED_FIFO))
+		return -1;
+
+	pthread_once(&waveOnce, waveInitOnce);
+
+	pthread_mutex_lock(&waveMutex);
+	waveCpu      = cpu;
+	wavePriority = priority;
+	waveReconfig = waveRunning;
+	pthread_cond_broadcast(&waveCond);
+	pthread_mutex_unlock(&waveMutex);
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiWaveCreate:
+ *	Make a wave over up to 32 pins, which should already be outputs.
+ *	Nothing plays until a program is loaded and the wave started.
+ */
+/*----------------------------------------------------------------------------*/
+struct wiringPiWave *wiringPiWaveCreate (const int *pins, int numPins)
+{
+	struct wiringPiWave *wave;
+
+	pthread_once(&waveOnce, waveInitOnce);
+
+	if ((wave = calloc(1, sizeof(*wave))) == NULL)
+		return NULL;
+
+	if (wiringPiPortGroupInit(&wave->group, pins, numPins) < 0) {
+		free(wave);
+		return NULL;
+	}
+
+	return wave;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiWaveLoad:
+ *	Give the wave a list of steps, repeated every period nS (0 to play
+ *	them once). A playing wave switches at the end of its current period.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiWaveLoad (struct wiringPiWave *wave, const struct wiringPiWaveStep *steps,
+	int numSteps, uint64_t period)
+{
+	struct waveProgram *prog;
+	int i;
+
+	if (numSteps < 1)
+		return -1;
+
+	for (i = 0; i < numSteps; i++) {
+		if (i && steps[i].offset < steps[i - 1].offset)
+			return -1;
+		if (period && steps[i].offset >= period)
+			return -1;
+	}
+
+	prog = malloc(sizeof(*prog) + sizeof(*steps) * numSteps);
+	if (prog == NULL)
+		return -1;
+
+	prog->numSteps = numSteps;
+	prog->period   = period;
+	memcpy(prog->steps, steps, sizeof(*steps) * numSteps);
+
+	pthread_mutex_lock(&waveMutex);
+	free(wave->retired);
+	wave->retired = NULL;
+
+	if (wave->active && wave->prog->period) {
+		free(wave->next);
+		wave->next = prog;
+	} else {
+		// Stopped, or a one-shot still playing, which restarts with the
+		//	new steps if started again.
+		free(wave->next);
+		wave->next = NULL;
+		if (wave->active)
+			waveUnlink(wave);
+		free(wave->prog);
+		wave->prog = prog;
+	}
+	pthread_mutex_unlock(&waveMutex);
+
+	return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiWaveStart:
+ *	Queue a loaded wave on the engine. Its first period starts a couple
+ *	of mS from now. Starting a playing wave does nothing.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiWaveStart (struct wiringPiWave *wave)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&waveMutex);
+
+	if (wave->prog == NULL) {
+		ret = -1;
+		goto out;
+	}
+	if (wave->active)
+		goto out;
+
+	if (!waveRunning) {
+		if (pthread_create(&waveThreadId, NULL, waveThread, NULL) != 0) {
+			msg(MSG_WARN, "%s: Unable to start the wave engine.\n", __func__);
+			ret = -1;
+			goto out;
+		}
+		pthread_detach(waveThreadId);
+		waveRunning = TRUE;
+	}
+
+	wave->start  = wiringPiMonotonicNs() + WAVE_LEAD_NS;
+	wave->step   = 0;
+	wave->active = TRUE;
+	wave->link   = waveList;
+	waveList     = wave;
+	pthread_cond_broadcast(&waveCond);
+out:
+	pthread_mutex_unlock(&waveMutex);
+
+	return ret;
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiWaveStop:
+ *	Take the wave off the engine. The pins keep their last level.
+ */
+/*----------------------------------------------------------------------------*/
+void wiringPiWaveStop (struct wiringPiWave *wave)
+{
+	pthread_mutex_lock(&waveMutex);
+	if (wave->active)
+		waveUnlink(wave);
+	pthread_mutex_unlock(&waveMutex);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiWaveWait:
+ *	Wait for a wave to stop playing, mS < 0 waits forever.
+ *	Returns 1 once it has stopped, 0 on timeout.
+ */
+/*----------------------------------------------------------------------------*/
+int wiringPiWaveWait (struct wiringPiWave *wave, int mS)
+{
+	struct timespec ts;
+	uint64_t until;
+	int ret = 1;
+
+	if (mS >= 0) {
+		until = wiringPiMonotonicNs() + (uint64_t)mS * 1000000ULL;
+		ts.tv_sec  = until / 1000000000ULL;
+		ts.tv_nsec = until % 1000000000ULL;
+	}
+
+	pthread_mutex_lock(&waveMutex);
+	while (wave->active) {
+		if (mS < 0) {
+			pthread_cond_wait(&waveCond, &waveMutex);
+		} else if (pthread_cond_timedwait(&waveCond, &waveMutex, &ts) == ETIMEDOUT) {
+			ret = !wave->active;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&waveMutex);
+
+	return ret;
+}
+
+/*----------------------------------------------------------------------------*/
+void wiringPiWaveFree (struct wiringPiWave *wave)
+{
+	if (wave == NULL)
+		return;
+
+	pthread_mutex_lock(&waveMutex);
+	if (wave->active)
+		waveUnlink(wave);
+	pthread_mutex_unlock(&waveMutex);
+
+	free(wave->prog);
+	free(wave->next);
+	free(wave->retired);
+	free(wave);
+}
+
+/*----------------------------------------------------------------------------*/
+/*
+ * wiringPiWaveGetStats:
+ *	Timing of the steps played so far, lateness being measured after the
+ *	register write. reset clears the counters (but not the slack).
+ */
+/*----------------------------------------------------------------------------*/
+void wiringPiWaveGetStats (struct wiringPiWaveStats *stats, int reset)
+{
+	pthread_once(&waveOnce, waveInitOnce);
+
+	pthread_mutex_lock(&waveMutex);
+	*stats = waveStats;
+	if (reset) {
+		waveStats.steps    = 0;
+		waveStats.lateSum  = 0;
+		waveStats.lateMax  = 0;
+		waveStats.overruns = 0;
+	}
+	pthread_mutex_unlock(&waveMutex);
+}
+
+/*----------------------------------------------------------------------------*/
+/*----------------------------------------------------------------------------*/
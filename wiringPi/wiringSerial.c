@@ -32,9 +32,28 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <linux/serial.h>
 
+#include "wiringPi.h"
 #include "wiringSerial.h"
 
+// Buffered channel, see serialChannelOpen. Unread input is
+//	rBuf [rStart .. rEnd), output not yet sent is wBuf [0 .. wUsed).
+
+#define	SERIAL_BUF_SIZE	4096
+
+struct serialChannel
+{
+  int fd ;
+  int rStart, rEnd ;
+  int wUsed ;
+  uint8_t rBuf [SERIAL_BUF_SIZE] ;
+  uint8_t wBuf [SERIAL_BUF_SIZE] ;
+} ;
+
 /*
  * serialOpen:
  *	Open and initialise the serial port, setting all the right
@@ -226,3 +245,660 @@ int serialGetchar (const int fd)
 
   return ((int)x) & 0xFF ;
 }
+
+
+/*
+ * serialSetTiming:
+ *	Set how a read of the port waits: vmin characters, or vtime tenths of
+ *	a second between characters (see termios(3)). serialOpen sets 0 and
+ *	100: return whatever is there, or wait up to ten seconds for one.
+ *********************************************************************************
+ */
+
+int serialSetTiming (const int fd, const int vmin, const int vtime)
+{
+  struct termios options ;
+
+  if ((vmin < 0) || (vmin > 255) || (vtime < 0) || (vtime > 255))
+    return -1 ;
+
+  if (tcgetattr (fd, &options) < 0)
+    return -1 ;
+
+  options.c_cc [VMIN]  = vmin ;
+  options.c_cc [VTIME] = vtime ;
+
+  return tcsetattr (fd, TCSANOW, &options) ;
+}
+
+
+/*
+ * serialSetLowLatency:
+ *	Ask the UART driver to pass on received characters at once instead
+ *	of batching them up. Not every driver can.
+ *********************************************************************************
+ */
+
+int serialSetLowLatency (const int fd, const int enable)
+{
+  struct serial_struct serial ;
+
+  if (ioctl (fd, TIOCGSERIAL, &serial) < 0)
+    return -1 ;
+
+  if (enable)
+    serial.flags |=  ASYNC_LOW_LATENCY ;
+  else
+    serial.flags &= ~ASYNC_LOW_LATENCY ;
+
+  return ioctl (fd, TIOCSSERIAL, &serial) ;
+}
+
+
+/*
+ * serialChannelOpen: serialChannelAttach: serialChannelClose:
+ *	A buffered channel on a serial port: input is read in as large chunks
+ *	as are waiting, output is gathered and sent by serialWriteFlush, or
+ *	when the buffer fills, or before a read has to wait. Reads wait as set
+ *	by serialSetTiming. A channel is for one thread at a time.
+ *********************************************************************************
+ */
+
+struct serialChannel *serialChannelAttach (const int fd)
+{
+  struct serialChannel *ch ;
+
+  if ((ch = calloc (1, sizeof (*ch))) == NULL)
+    return NULL ;
+
+  ch->fd = fd ;
+  return ch ;
+}
+
+struct serialChannel *serialChannelOpen (const char *device, const int baud)
+{
+  struct serialChannel *ch ;
+  int fd ;
+
+  if ((fd = serialOpen (device, baud)) < 0)
+    return NULL ;
+
+  if ((ch = serialChannelAttach (fd)) == NULL)
+    close (fd) ;
+
+  return ch ;
+}
+
+void serialChannelClose (struct serialChannel *ch)
+{
+  (void)serialWriteFlush (ch) ;
+  close (ch->fd) ;
+  free  (ch) ;
+}
+
+int serialChannelFd (struct serialChannel *ch)
+{
+  return ch->fd ;
+}
+
+
+/*
+ * writeAll:
+ *	writev until everything has gone.
+ *********************************************************************************
+ */
+
+static int writeAll (const int fd, struct iovec *iov, int count)
+{
+  ssize_t n ;
+
+  while (count > 0)
+  {
+    if ((n = writev (fd, iov, count)) < 0)
+    {
+      if (errno == EINTR)
+	continue ;
+      return -1 ;
+    }
+
+    while ((count > 0) && ((size_t)n >= iov->iov_len))
+    {
+      n -= iov->iov_len ;
+      ++iov ;
+      --count ;
+    }
+
+    if (count > 0)
+    {
+      iov->iov_base  = (uint8_t *)iov->iov_base + n ;
+      iov->iov_len  -= n ;
+    }
+  }
+
+  return 0 ;
+}
+
+
+/*
+ * serialWriteFlush:
+ *	Send everything gathered so far.
+ *********************************************************************************
+ */
+
+int serialWriteFlush (struct serialChannel *ch)
+{
+  struct iovec iov ;
+
+  if (ch->wUsed == 0)
+    return 0 ;
+
+  iov.iov_base = ch->wBuf ;
+  iov.iov_len  = ch->wUsed ;
+  ch->wUsed    = 0 ;
+
+  return writeAll (ch->fd, &iov, 1) ;
+}
+
+
+/*
+ * serialWrite:
+ *	Gather len bytes for sending. Anything that won't fit the buffer goes
+ *	out straight from buf, in the same writev as what is gathered.
+ *********************************************************************************
+ */
+
+int serialWrite (struct serialChannel *ch, const void *buf, int len)
+{
+  struct iovec iov [2] ;
+
+  if (len <= SERIAL_BUF_SIZE - ch->wUsed)
+  {
+    memcpy (ch->wBuf + ch->wUsed, buf, len) ;
+    ch->wUsed += len ;
+    return len ;
+  }
+
+  iov [0].iov_base = ch->wBuf ;
+  iov [0].iov_len  = ch->wUsed ;
+  iov [1].iov_base = (void *)buf ;
+  iov [1].iov_len  = len ;
+  ch->wUsed        = 0 ;
+
+  return (writeAll (ch->fd, iov, 2) < 0) ? -1 : len ;
+}
+
+
+/*
+ * serialWritef:
+ *	Printf into the channel, formatted in place in the output buffer.
+ *********************************************************************************
+ */
+
+int serialWritef (struct serialChannel *ch, const char *message, ...)
+{
+  va_list argp, again ;
+  char *buffer ;
+  int len, space ;
+
+  space = SERIAL_BUF_SIZE - ch->wUsed ;
+
+  va_start (argp, message) ;
+  va_copy  (again, argp) ;
+  len = vsnprintf ((char *)ch->wBuf + ch->wUsed, space, message, argp) ;
+  va_end   (argp) ;
+
+  if (len < space)			// Fitted, or failed
+  {
+    if (len > 0)
+      ch->wUsed += len ;
+    va_end (again) ;
+    return len ;
+  }
+
+  if (len < SERIAL_BUF_SIZE)		// Fits once the buffer is empty
+  {
+    if (serialWriteFlush (ch) < 0)
+      len = -1 ;
+    else
+      ch->wUsed = vsnprintf ((char *)ch->wBuf, SERIAL_BUF_SIZE, message, again) ;
+    va_end (again) ;
+    return len ;
+  }
+
+  if ((buffer = malloc (len + 1)) == NULL)
+  {
+    va_end (again) ;
+    return -1 ;
+  }
+
+  vsnprintf (buffer, len + 1, message, again) ;
+  va_end (again) ;
+
+  len = serialWrite (ch, buffer, len) ;
+  free (buffer) ;
+
+  return len ;
+}
+
+
+/*
+ * fillBuffer:
+ *	Read in whatever is waiting, as much as there is room for, waiting
+ *	as set by serialSetTiming if there's nothing. Pending output is sent
+ *	first, it's probably what is being answered. Returns the number of
+ *	bytes read, 0 on a timeout or -1 on an error.
+ *********************************************************************************
+ */
+
+static int fillBuffer (struct serialChannel *ch)
+{
+  ssize_t n ;
+
+  if (serialWriteFlush (ch) < 0)
+    return -1 ;
+
+  if (ch->rStart == ch->rEnd)
+    ch->rStart = ch->rEnd = 0 ;
+  else if ((ch->rEnd == SERIAL_BUF_SIZE) && (ch->rStart > 0))
+  {
+    memmove (ch->rBuf, ch->rBuf + ch->rStart, ch->rEnd - ch->rStart) ;
+    ch->rEnd  -= ch->rStart ;
+    ch->rStart = 0 ;
+  }
+
+  for (;;)
+  {
+    if ((n = read (ch->fd, ch->rBuf + ch->rEnd, SERIAL_BUF_SIZE - ch->rEnd)) >= 0)
+      break ;
+    if (errno != EINTR)
+      return -1 ;
+  }
+
+  ch->rEnd += n ;
+  return n ;
+}
+
+
+/*
+ * serialRead:
+ *	Read up to len bytes, waiting only if none are buffered. Returns the
+ *	number read, 0 on a timeout or -1 on an error.
+ *********************************************************************************
+ */
+
+int serialRead (struct serialChannel *ch, void *buf, int len)
+{
+  int n ;
+
+  if (ch->rStart == ch->rEnd)
+  {
+    if (len >= SERIAL_BUF_SIZE / 2)	// Big enough to go straight in
+    {
+      if (serialWriteFlush (ch) < 0)
+	return -1 ;
+      while (((n = read (ch->fd, buf, len)) < 0) && (errno == EINTR))
+	;
+      return n ;
+    }
+
+    if ((n = fillBuffer (ch)) <= 0)
+      return n ;
+  }
+
+  n = ch->rEnd - ch->rStart ;
+  if (n > len)
+    n = len ;
+
+  memcpy (buf, ch->rBuf + ch->rStart, n) ;
+  ch->rStart += n ;
+
+  return n ;
+}
+
+
+/*
+ * serialReadFrame:
+ *	Read up to the next delimiter, which is dropped. Frames longer than
+ *	max come back in pieces of max bytes. Returns the frame length, or -1
+ *	on a timeout or error, when any part frame stays buffered.
+ *********************************************************************************
+ */
+
+int serialReadFrame (struct serialChannel *ch, void *buf, int max, int delimiter)
+{
+  uint8_t *start, *end ;
+  int avail, len, skip ;
+
+  for (;;)
+  {
+    start = ch->rBuf + ch->rStart ;
+    avail = ch->rEnd - ch->rStart ;
+
+    if ((end = memchr (start, delimiter, avail)) != NULL)
+    {
+      len  = end - start ;
+      skip = 1 ;
+    }
+    else
+    {
+      len  = avail ;
+      skip = 0 ;
+    }
+
+    if (len > max)
+    {
+      len  = max ;
+      skip = 0 ;
+    }
+
+    if ((end != NULL) || (len == max) || (avail == SERIAL_BUF_SIZE))
+    {
+      memcpy (buf, start, len) ;
+      ch->rStart += len + skip ;
+      return len ;
+    }
+
+    if (fillBuffer (ch) <= 0)
+      return -1 ;
+  }
+}
+
+
+/*
+ * serialReadLine:
+ *	serialReadFrame on newlines, less any carriage return, as a string.
+ *********************************************************************************
+ */
+
+int serialReadLine (struct serialChannel *ch, char *buf, int max)
+{
+  int len ;
+
+  if (max < 1)
+    return -1 ;
+
+  if ((len = serialReadFrame (ch, buf, max - 1, '\n')) < 0)
+    return -1 ;
+
+  if ((len > 0) && (buf [len - 1] == '\r'))
+    --len ;
+
+  buf [len] = 0 ;
+  return len ;
+}
+
+
+/*
+ * Receive engine:
+ *	A UART is read by the wiringPi event thread whenever it has input, and
+ *	the bytes are cut into frames that are handed to a callback:
+ *
+ *	SERIAL_FRAME_DELIMITER	Ended by the byte param, which is dropped.
+ *	SERIAL_FRAME_LENGTH	param (1 or 2) bytes of big-endian length,
+ *				then that many bytes.
+ *	SERIAL_FRAME_GAP	Ended by param uS of silence, as Modbus RTU
+ *				does: 3.5 characters, or 1750uS over 19200 baud.
+ *
+ *	Frames over SERIAL_RX_MAX bytes are dropped and counted. If the UART
+ *	hangs up or fails, it is no longer watched and the callback gets a
+ *	NULL frame of length 0; any part frame is lost.
+ *********************************************************************************
+ */
+
+struct serialRx
+{
+  int fd, timerFd ;
+  int mode, param ;
+  void (*function)(const unsigned char *frame, int len, void *userdata) ;
+  void *userdata ;
+
+  int need ;			// Length mode: prefix bytes still to come, then body
+  int prefix ;			//  TRUE while reading the prefix
+  int skip ;			// Dropping the rest of an oversize frame
+  int dead ;			// Hung up or failed, no longer watched
+  unsigned int dropped ;
+  int have ;
+  unsigned char buf [SERIAL_RX_MAX] ;
+} ;
+
+
+/*
+ * rxByte:
+ *	Run one byte through the framer.
+ *********************************************************************************
+ */
+
+static void rxByte (struct serialRx *rx, unsigned char c)
+{
+  switch (rx->mode)
+  {
+    case SERIAL_FRAME_DELIMITER:
+      if (c == rx->param)
+      {
+	if (!rx->skip)
+	  rx->function (rx->buf, rx->have, rx->userdata) ;
+	rx->have = rx->skip = 0 ;
+      }
+      else if (rx->have < SERIAL_RX_MAX)
+	rx->buf [rx->have++] = c ;
+      else if (!rx->skip)
+      {
+	rx->skip = TRUE ;
+	++rx->dropped ;
+      }
+      break ;
+
+    case SERIAL_FRAME_LENGTH:
+      if (rx->prefix)
+      {
+	rx->have = (rx->have << 8) | c ;
+	if (--rx->need > 0)
+	  break ;
+
+	rx->prefix = FALSE ;
+	rx->need   = rx->have ;
+	rx->have   = 0 ;
+	if ((rx->skip = (rx->need > SERIAL_RX_MAX)))
+	  ++rx->dropped ;
+      }
+      else
+      {
+	if (!rx->skip)
+	  rx->buf [rx->have++] = c ;
+	--rx->need ;
+      }
+
+      if (rx->need == 0)
+      {
+	if (!rx->skip)
+	  rx->function (rx->buf, rx->have, rx->userdata) ;
+	rx->prefix = TRUE ;
+	rx->need   = rx->param ;
+	rx->have   = rx->skip = 0 ;
+      }
+      break ;
+
+    case SERIAL_FRAME_GAP:
+      if (rx->have < SERIAL_RX_MAX)
+	rx->buf [rx->have++] = c ;
+      else if (!rx->skip)
+      {
+	rx->skip = TRUE ;
+	++rx->dropped ;
+      }
+      break ;
+  }
+}
+
+
+/*
+ * rxReady: rxGap:
+ *	Event thread handlers for the UART and, in gap mode, its timer.
+ *********************************************************************************
+ */
+
+static void rxReady (int fd, uint32_t events, void *userdata)
+{
+  struct serialRx *rx = (struct serialRx *)userdata ;
+  struct itimerspec gap ;
+  unsigned char buf [256] ;
+  ssize_t n, i ;
+  int got = FALSE ;
+
+  for (;;)
+  {
+    if ((n = read (fd, buf, sizeof (buf))) < 0)
+    {
+      if (errno == EINTR)
+	continue ;
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+	events |= EPOLLERR ;		// A real error
+      break ;
+    }
+
+// A tty with VMIN = VTIME = 0 says it is drained with 0, not EAGAIN.
+//	A real hangup comes from epoll as EPOLLHUP.
+
+    if (n == 0)
+      break ;
+
+    for (i = 0 ; i < n ; ++i)
+      rxByte (rx, buf [i]) ;
+    got = TRUE ;
+  }
+
+// Stop watching a dead UART, or the event thread would spin on it
+
+  if ((events & (EPOLLHUP | EPOLLERR)) != 0)
+  {
+    (void)wiringPiEventDelFd (fd) ;
+    if (rx->timerFd != -1)
+      (void)wiringPiEventDelFd (rx->timerFd) ;
+    rx->dead = TRUE ;
+    rx->have = rx->skip = 0 ;
+    rx->function (NULL, 0, rx->userdata) ;
+    return ;
+  }
+
+// Every byte restarts the silence that ends the frame
+
+  if (got && (rx->mode == SERIAL_FRAME_GAP))
+  {
+    memset (&gap, 0, sizeof (gap)) ;
+    gap.it_value.tv_sec  =  rx->param / 1000000 ;
+    gap.it_value.tv_nsec = (rx->param % 1000000) * 1000 ;
+    (void)timerfd_settime (rx->timerFd, 0, &gap, NULL) ;
+  }
+}
+
+static void rxGap (int fd, uint32_t events, void *userdata)
+{
+  struct serialRx *rx = (struct serialRx *)userdata ;
+  uint64_t expired ;
+
+  (void)events ;
+
+  if (read (fd, &expired, sizeof (expired)) < 0)
+    return ;
+
+  if ((rx->have > 0) && !rx->skip)
+    rx->function (rx->buf, rx->have, rx->userdata) ;
+  rx->have = rx->skip = 0 ;
+}
+
+
+/*
+ * serialRxStart:
+ *	Start delivering the frames arriving on fd to function, which runs on
+ *	the wiringPi event thread and must not block. fd is made non-blocking
+ *	and should only be written to from now on.
+ *********************************************************************************
+ */
+
+struct serialRx *serialRxStart (const int fd, const int mode, const int param,
+	void (*function)(const unsigned char *frame, int len, void *userdata), void *userdata)
+{
+  struct serialRx *rx ;
+
+  switch (mode)
+  {
+    case SERIAL_FRAME_DELIMITER: if ((param < 0) || (param > 255)) return NULL ; break ;
+    case SERIAL_FRAME_LENGTH:    if ((param < 1) || (param > 2))   return NULL ; break ;
+    case SERIAL_FRAME_GAP:       if (param < 1)                    return NULL ; break ;
+    default:
+      return NULL ;
+  }
+
+  if ((rx = calloc (1, sizeof (*rx))) == NULL)
+    return NULL ;
+
+  rx->fd       = fd ;
+  rx->timerFd  = -1 ;
+  rx->mode     = mode ;
+  rx->param    = param ;
+  rx->function = function ;
+  rx->userdata = userdata ;
+  rx->prefix   = TRUE ;
+  rx->need     = param ;
+
+  if (mode == SERIAL_FRAME_GAP)
+  {
+    if ((rx->timerFd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+      goto fail ;
+
+    if (wiringPiEventAddFd (rx->timerFd, EPOLLIN, rxGap, rx) < 0)
+      goto fail ;
+  }
+
+  fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK) ;
+
+  if (wiringPiEventAddFd (fd, EPOLLIN, rxReady, rx) < 0)
+  {
+    if (rx->timerFd != -1)
+      (void)wiringPiEventDelFd (rx->timerFd) ;
+    goto fail ;
+  }
+
+  return rx ;
+
+fail:
+  if (rx->timerFd != -1)
+    close (rx->timerFd) ;
+  free (rx) ;
+  return NULL ;
+}
+
+
+/*
+ * serialRxStop:
+ *	Stop the engine on a UART. Any part frame is lost. Not from inside
+ *	the callback.
+ *********************************************************************************
+ */
+
+void serialRxStop (struct serialRx *rx)
+{
+  if (!rx->dead)
+    (void)wiringPiEventDelFd (rx->fd) ;
+
+  if (rx->timerFd != -1)
+  {
+    if (!rx->dead)
+      (void)wiringPiEventDelFd (rx->timerFd) ;
+    close (rx->timerFd) ;
+  }
+
+  free (rx) ;
+}
+
+
+/*
+ * serialRxDropped:
+ *	The number of frames thrown away for being over SERIAL_RX_MAX bytes.
+ *********************************************************************************
+ */
+
+unsigned int serialRxDropped (struct serialRx *rx)
+{
+  return rx->dropped ;
+}
@@ -33,6 +33,40 @@ extern void  serialPrintf    (const int fd, const char *message, ...) ;
 extern int   serialDataAvail (const int fd) ;
 extern int   serialGetchar   (const int fd) ;
 
+extern int   serialSetTiming     (const int fd, const int vmin, const int vtime) ;
+extern int   serialSetLowLatency (const int fd, const int enable) ;
+
+// Buffered channels
+
+struct serialChannel ;
+
+extern struct serialChannel *serialChannelOpen   (const char *device, const int baud) ;
+extern struct serialChannel *serialChannelAttach (const int fd) ;
+extern void  serialChannelClose (struct serialChannel *ch) ;
+extern int   serialChannelFd    (struct serialChannel *ch) ;
+
+extern int   serialRead       (struct serialChannel *ch, void *buf, int len) ;
+extern int   serialReadFrame  (struct serialChannel *ch, void *buf, int max, int delimiter) ;
+extern int   serialReadLine   (struct serialChannel *ch, char *buf, int max) ;
+extern int   serialWrite      (struct serialChannel *ch, const void *buf, int len) ;
+extern int   serialWritef     (struct serialChannel *ch, const char *message, ...) ;
+extern int   serialWriteFlush (struct serialChannel *ch) ;
+
+// Receive engine framing modes, see serialRxStart
+
+#define	SERIAL_FRAME_DELIMITER	0
+#define	SERIAL_FRAME_LENGTH	1
+#define	SERIAL_FRAME_GAP	2
+
+#define	SERIAL_RX_MAX		1024
+
+struct serialRx ;
+
+extern struct serialRx *serialRxStart (const int fd, const int mode, const int param,
+	void (*function)(const unsigned char *frame, int len, void *userdata), void *userdata) ;
+extern void  serialRxStop    (struct serialRx *rx) ;
+extern unsigned int serialRxDropped (struct serialRx *rx) ;
+
 #ifdef __cplusplus
 }
 #endif
@@ -23,6 +23,7 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
 
 #include "wiringPi.h"
 #include "wiringShift.h"
@@ -35,22 +36,26 @@
 
 uint8_t shiftIn (uint8_t dPin, uint8_t cPin, uint8_t order)
 {
+  struct wiringPiPinHandle data, clock ;
   uint8_t value = 0 ;
   int8_t  i ;
+
+  (void)wiringPiPinHandle (dPin, &data) ;
+  (void)wiringPiPinHandle (cPin, &clock) ;
  
   if (order == MSBFIRST)
     for (i = 7 ; i >= 0 ; --i)
     {
-      digitalWrite (cPin, HIGH) ;
-      value |= digitalRead (dPin) << i ;
-      digitalWrite (cPin, LOW) ;
+      digitalWriteFast (&clock, HIGH) ;
+      value |= digitalReadFast (&data) << i ;
+      digitalWriteFast (&clock, LOW) ;
     }
   else
     for (i = 0 ; i < 8 ; ++i)
     {
-      digitalWrite (cPin, HIGH) ;
-      value |= digitalRead (dPin) << i ;
-      digitalWrite (cPin, LOW) ;
+      digitalWriteFast (&clock, HIGH) ;
+      value |= digitalReadFast (&data) << i ;
+      digitalWriteFast (&clock, LOW) ;
     }
 
   return value;
@@ -64,20 +69,225 @@ uint8_t shiftIn (uint8_t dPin, uint8_t cPin, uint8_t order)
 
 void shiftOut (uint8_t dPin, uint8_t cPin, uint8_t order, uint8_t val)
 {
+  struct wiringPiPinHandle data, clock ;
   int8_t i;
 
+  (void)wiringPiPinHandle (dPin, &data) ;
+  (void)wiringPiPinHandle (cPin, &clock) ;
+
   if (order == MSBFIRST)
     for (i = 7 ; i >= 0 ; --i)
     {
-      digitalWrite (dPin, val & (1 << i)) ;
-      digitalWrite (cPin, HIGH) ;
-      digitalWrite (cPin, LOW) ;
+      digitalWriteFast (&data, val & (1 << i)) ;
+      digitalWriteFast (&clock, HIGH) ;
+      digitalWriteFast (&clock, LOW) ;
     }
   else
     for (i = 0 ; i < 8 ; ++i)
     {
-      digitalWrite (dPin, val & (1 << i)) ;
-      digitalWrite (cPin, HIGH) ;
-      digitalWrite (cPin, LOW) ;
+      digitalWriteFast (&data, val & (1 << i)) ;
+      digitalWriteFast (&clock, HIGH) ;
+      digitalWriteFast (&clock, LOW) ;
     }
 }
+
+
+/*
+ * Shift engine:
+ *	The clock and data pins are resolved into a port group once, clock
+ *	as pin 0 and data pin n as pin n+1. Each bit is then one write of all
+ *	the data pins together with the clock going low, the setup time, the
+ *	clock going high and the hold time. Pins sharing a register change in
+ *	one store.
+ *
+ *	Words are bits wide (1 to 32) and held in uint8_t, uint16_t or
+ *	uint32_t according to their size. With several data pins the words
+ *	are interleaved: words [i * numData + n] goes out on data pin n.
+ *********************************************************************************
+ */
+
+struct wiringShift
+{
+  struct wiringPiPortGroup group ;
+  int numData ;
+  int order ;
+  int bits ;
+  unsigned int setupNs ;
+  unsigned int holdNs ;
+} ;
+
+
+/*
+ * shiftDelay:
+ *	Spin until ns have passed since start. The clock edges are far too
+ *	close together to sleep between them.
+ *********************************************************************************
+ */
+
+static inline void shiftDelay (uint64_t start, unsigned int ns)
+{
+  if (ns != 0)
+    while ((nanos64 () - start) < ns)
+      ;
+}
+
+static inline uint32_t getWord (const void *words, int bits, int i)
+{
+  if (bits <= 8)
+    return ((const uint8_t  *)words) [i] ;
+  if (bits <= 16)
+    return ((const uint16_t *)words) [i] ;
+  return ((const uint32_t *)words) [i] ;
+}
+
+static inline void putWord (void *words, int bits, int i, uint32_t value)
+{
+  if (bits <= 8)
+    ((uint8_t  *)words) [i] = value ;
+  else if (bits <= 16)
+    ((uint16_t *)words) [i] = value ;
+  else
+    ((uint32_t *)words) [i] = value ;
+}
+
+
+/*
+ * shiftSetup:
+ *	Create a shift engine for numData data pins clocked by clockPin. The
+ *	pins must already be in the right mode. setupNs is the time data is
+ *	held before the rising edge of the clock (or, for shiftRead, from the
+ *	rising edge until the data is sampled), holdNs the time the clock
+ *	stays high.
+ *********************************************************************************
+ */
+
+struct wiringShift *shiftSetup (const int *dataPins, int numData, int clockPin,
+	int order, int bits, unsigned int setupNs, unsigned int holdNs)
+{
+  struct wiringShift *sh ;
+  int pins [SHIFT_MAX_DATA + 1] ;
+  int i ;
+
+  if ((numData < 1) || (numData > SHIFT_MAX_DATA) || (bits < 1) || (bits > 32))
+    return NULL ;
+
+  if ((sh = calloc (1, sizeof (*sh))) == NULL)
+    return NULL ;
+
+  pins [0] = clockPin ;
+  for (i = 0 ; i < numData ; ++i)
+    pins [i + 1] = dataPins [i] ;
+
+  if (wiringPiPortGroupInit (&sh->group, pins, numData + 1) < 0)
+  {
+    free (sh) ;
+    return NULL ;
+  }
+
+  sh->numData = numData ;
+  sh->order   = order ;
+  sh->bits    = bits ;
+  sh->setupNs = setupNs ;
+  sh->holdNs  = holdNs ;
+
+  return sh ;
+}
+
+
+/*
+ * shiftWrite:
+ *	Clock out count words on every data pin, leaving the clock low.
+ *********************************************************************************
+ */
+
+void shiftWrite (struct wiringShift *sh, const void *words, int count)
+{
+  const struct wiringPiPinHandle *clock = &sh->group.handles [0] ;
+  uint32_t word [SHIFT_MAX_DATA] ;
+  uint32_t values, mask = (2U << sh->numData) - 1 ;
+  uint64_t edge ;
+  int i, n, b, bit ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    for (n = 0 ; n < sh->numData ; ++n)
+      word [n] = getWord (words, sh->bits, i * sh->numData + n) ;
+
+    for (b = 0 ; b < sh->bits ; ++b)
+    {
+      bit = (sh->order == MSBFIRST) ? (sh->bits - 1 - b) : b ;
+
+// Data and the falling clock together, bit 0 (the clock) stays clear
+
+      values = 0 ;
+      for (n = 0 ; n < sh->numData ; ++n)
+	if (word [n] & (1U << bit))
+	  values |= 2U << n ;
+
+      digitalWritePortMasked (&sh->group, values, mask) ;
+      edge = nanos64 () ;
+      shiftDelay (edge, sh->setupNs) ;
+
+      digitalWriteFast (clock, HIGH) ;
+      edge = nanos64 () ;
+      shiftDelay (edge, sh->holdNs) ;
+    }
+  }
+
+  digitalWriteFast (clock, LOW) ;
+}
+
+
+/*
+ * shiftRead:
+ *	Clock in count words from every data pin.
+ *********************************************************************************
+ */
+
+void shiftRead (struct wiringShift *sh, void *words, int count)
+{
+  const struct wiringPiPinHandle *clock = &sh->group.handles [0] ;
+  uint32_t word [SHIFT_MAX_DATA] ;
+  uint32_t values ;
+  uint64_t edge ;
+  int i, n, b, bit ;
+
+  for (i = 0 ; i < count ; ++i)
+  {
+    for (n = 0 ; n < sh->numData ; ++n)
+      word [n] = 0 ;
+
+    for (b = 0 ; b < sh->bits ; ++b)
+    {
+      bit = (sh->order == MSBFIRST) ? (sh->bits - 1 - b) : b ;
+
+      digitalWriteFast (clock, HIGH) ;
+      edge = nanos64 () ;
+      shiftDelay (edge, sh->setupNs) ;
+
+      values = digitalReadPort (&sh->group) ;
+
+      digitalWriteFast (clock, LOW) ;
+      edge = nanos64 () ;
+      shiftDelay (edge, sh->holdNs) ;
+
+      for (n = 0 ; n < sh->numData ; ++n)
+	if (values & (2U << n))
+	  word [n] |= 1U << bit ;
+    }
+
+    for (n = 0 ; n < sh->numData ; ++n)
+      putWord (words, sh->bits, i * sh->numData + n, word [n]) ;
+  }
+}
+
+
+/*
+ * shiftFree:
+ *********************************************************************************
+ */
+
+void shiftFree (struct wiringShift *sh)
+{
+  free (sh) ;
+}
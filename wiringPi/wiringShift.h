@@ -36,6 +36,18 @@ extern "C" {
 extern uint8_t shiftIn      (uint8_t dPin, uint8_t cPin, uint8_t order) ;
 extern void    shiftOut     (uint8_t dPin, uint8_t cPin, uint8_t order, uint8_t val) ;
 
+// Shift engine: up to SHIFT_MAX_DATA data pins sharing one clock
+
+#define	SHIFT_MAX_DATA	31
+
+struct wiringShift ;
+
+extern struct wiringShift *shiftSetup (const int *dataPins, int numData, int clockPin,
+	int order, int bits, unsigned int setupNs, unsigned int holdNs) ;
+extern void    shiftWrite   (struct wiringShift *sh, const void *words, int count) ;
+extern void    shiftRead    (struct wiringShift *sh, void *words, int count) ;
+extern void    shiftFree    (struct wiringShift *sh) ;
+
 #ifdef __cplusplus
 }
 #endif
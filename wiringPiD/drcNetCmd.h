@@ -34,6 +34,30 @@
 #define	DRCN_DIGITAL_READ8	8
 #define	DRCN_ANALOG_READ	9
 
+// Protocol revisions. The server offers its revision in a "200 Protocol n"
+//	greeting line, and a client that understands it answers the password
+//	with DRCN_PROTOCOL, data = revision wanted; the reply carries the one
+//	agreed on. Revision 1 acknowledges every command. From revision 2 only
+//	reads (and DRCN_PROTOCOL) are answered, so writes can be streamed,
+//	many to a packet, and the server applies them in order.
+
+#define	DRCN_PROTOCOL		10
+
+// Protocol 2 and on: DRCN_SUBSCRIBE, data = INT_EDGE_FALLING, _RISING or
+//	_BOTH, or -1 to stop, has the server watch the pin and send every
+//	edge of it as a drcNetEventStruct, whenever it happens. The reply
+//	data is 0, or -1 if the pin can't be watched.
+
+#define	DRCN_SUBSCRIBE		11
+#define	DRCN_EVENT		12
+
+#define	DRCN_VERSION		2
+
+// Most commands the server takes in one go, and so the most worth
+//	a client putting in one packet
+
+#define	DRCN_BATCH_MAX		128
+
 
 extern struct drcNetComStruct
 {
@@ -42,3 +66,15 @@ extern struct drcNetComStruct
   uint32_t data ;
 } comDat ;
 
+// An edge, two command records long and starting like one so the reader
+//	can tell it from a reply. The timestamp is in nS of the server's
+//	CLOCK_MONOTONIC.
+
+struct drcNetEventStruct
+{
+  uint32_t pin ;
+  uint32_t cmd ;		// DRCN_EVENT
+  uint32_t edge ;
+  uint32_t seq ;
+  uint64_t timestamp ;
+} ;
@@ -21,83 +21,58 @@
  ***********************************************************************
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdarg.h>
-#include <malloc.h>
 
 #include <fcntl.h>
 #include <crypt.h>
 
+#include "drcNetCmd.h"
 #include "network.h"
 
 #define	TRUE	(1==1)
 #define	FALSE	(!TRUE)
 
-// Local data
-
-#define	SALT_LEN	16
-
-static char salt [SALT_LEN + 1] ;
-static char *returnedHash = NULL ;
-static int serverFd = -1 ;
-
-// Union for the server Socket Address
+// Socket address, IPv4 or v6
 
-static union
+union sockAddr
 {
   struct sockaddr_in  sin ;
   struct sockaddr_in6 sin6 ;
-} serverSockAddr ; 
-
-// and client address
-
-static union
-{
-  struct sockaddr_in  sin ;
-  struct sockaddr_in6 sin6 ;
-} clientSockAddr ;
+} ;
 
 
 /*
  * getClientIP:
- *	Returns a pointer to a static string containing the clients IP address
+ *	Format the clients IP address into ipAddress
  *********************************************************************************
  */
 
-char *getClientIP (void)
+static void getClientIP (const union sockAddr *clientSockAddr, char *ipAddress, size_t len)
 {
   char buf [INET6_ADDRSTRLEN] ;
-  static char ipAddress [1024] ;
-
-  if (clientSockAddr.sin.sin_family == AF_INET)	// IPv4
-  {
-    if (snprintf (ipAddress, 1024, "IPv4: %s", 
-	inet_ntop (clientSockAddr.sin.sin_family, (void *)&clientSockAddr.sin.sin_addr, buf, sizeof (buf))) == 1024)
-      strcpy (ipAddress, "Too long") ;
-  }
-  else						// IPv6
-  {
-    if (clientSockAddr.sin.sin_family == AF_INET6 && IN6_IS_ADDR_V4MAPPED (&clientSockAddr.sin6.sin6_addr))
-    {
-      if (snprintf (ipAddress, 1024, "IPv4in6: %s", 
-	inet_ntop (clientSockAddr.sin.sin_family, (char *)&clientSockAddr.sin6.sin6_addr, buf, sizeof(buf))) == 1024)
-      strcpy (ipAddress, "Too long") ;
-    }
-    else
-    {
-      if (snprintf (ipAddress, 1024, "IPv6: %s", 
-	inet_ntop (clientSockAddr.sin.sin_family, (char *)&clientSockAddr.sin6.sin6_addr, buf, sizeof(buf))) == 1024)
-      strcpy (ipAddress, "Too long") ;
-    }
-  }
 
-  return ipAddress ;
+  if (clientSockAddr->sin.sin_family == AF_INET)	// IPv4
+    snprintf (ipAddress, len, "IPv4: %s", 
+	inet_ntop (AF_INET, (void *)&clientSockAddr->sin.sin_addr, buf, sizeof (buf))) ;
+  else if (IN6_IS_ADDR_V4MAPPED (&clientSockAddr->sin6.sin6_addr))
+    snprintf (ipAddress, len, "IPv4in6: %s", 
+	inet_ntop (AF_INET6, (char *)&clientSockAddr->sin6.sin6_addr, buf, sizeof(buf))) ;
+  else
+    snprintf (ipAddress, len, "IPv6: %s", 
+	inet_ntop (AF_INET6, (char *)&clientSockAddr->sin6.sin6_addr, buf, sizeof(buf))) ;
 }
 
 
@@ -133,12 +108,15 @@ static int clientPrintf (const int fd, const char *message, ...)
  *********************************************************************************
  */
 
-int sendGreeting (int clientFd)
+int sendGreeting (int clientFd, const char *ipAddress)
 {
   if (clientPrintf (clientFd, "200 Welcome to wiringPiD - http://wiringpi.com/\n") < 0)
     return -1 ;
 
-  return clientPrintf (clientFd, "200 Connecting from: %s\n", getClientIP ()) ;
+  if (clientPrintf (clientFd, "200 Connecting from: %s\n", ipAddress) < 0)
+    return -1 ;
+
+  return clientPrintf (clientFd, "200 Protocol %d\n", DRCN_VERSION) ;
 }
 
 
@@ -161,7 +139,10 @@ static int getSalt (char drySalt [])
     return fd ;
 
   if (read (fd, wetSalt, SALT_LEN) != SALT_LEN)
+  {
+    close (fd) ;
     return -1 ;
+  }
 
   close (fd) ;
 
@@ -180,7 +161,7 @@ static int getSalt (char drySalt [])
  *********************************************************************************
  */
 
-int sendChallenge (int clientFd)
+int sendChallenge (int clientFd, char salt [])
 {
   if (getSalt (salt) < 0)
     return -1 ;
@@ -189,48 +170,14 @@ int sendChallenge (int clientFd)
 }
 
 
-/*
- * getResponse:
- *	Read the encrypted password from the remote device.
- *********************************************************************************
- */
-
-
-int getResponse (int clientFd)
-{
-  char reply [1024] ;
-  int len ;
-
-// Being sort of lazy about this. I'm expecting an SHA-512 hash back and these
-//	are exactly 86 characters long, so no reason not to, I guess...
-
-  len = 86 ;
-
-  if (setsockopt (clientFd, SOL_SOCKET, SO_RCVLOWAT, (void *)&len, sizeof (len)) < 0)
-    return -1 ;
-
-  len = recv (clientFd, reply, 86, 0) ;
-  if (len != 86)
-    return -1 ;
-
-  reply [len] = 0 ;
-
-  if ((returnedHash = malloc (len + 1)) == NULL)
-    return -1 ;
-
-  strcpy (returnedHash, reply) ;
-
-  return 0 ;
-}
-
-
 /*
  * passwordMatch:
- *	See if there's a match. If not, we simply dump them.
+ *	See if there's a match with the response the client sent back. If
+ *	not, we simply dump them.
  *********************************************************************************
  */
 
-int passwordMatch (const char *password)
+int passwordMatch (const char *password, const char *salt, const char *response)
 {
   char *encrypted ;
   char salted [1024] ;
@@ -240,9 +187,9 @@ int passwordMatch (const char *password)
   encrypted = crypt (password, salted) ;
 
 // 20: $6$ then 16 characters of salt, then $
-// 86 is the length of an SHA-512 hash
+// RESPONSE_LEN is the length of an SHA-512 hash
 
-  return strncmp (encrypted + 20, returnedHash, 86) == 0 ;
+  return (encrypted != NULL) && (strncmp (encrypted + 20, response, RESPONSE_LEN) == 0) ;
 }
 
 
@@ -255,22 +202,21 @@ int passwordMatch (const char *password)
 
 int setupServer (int serverPort)
 {
-  socklen_t clientSockAddrSize = sizeof (clientSockAddr) ;
-
+  union sockAddr serverSockAddr ;
+  int serverFd ;
   int on = 1 ;
   int family ;
   socklen_t serverSockAddrSize ;
-  int clientFd ;
 
 // Try to create an IPv6 socket
 
-  serverFd = socket (PF_INET6, SOCK_STREAM, 0) ;
+  serverFd = socket (PF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0) ;
 
 // If it didn't work, then fall-back to IPv4.
 
   if (serverFd < 0)
   {
-    if ((serverFd = socket (PF_INET, SOCK_STREAM, 0)) < 0)
+    if ((serverFd = socket (PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
       return -1 ;
 
     family             = AF_INET ;
@@ -283,7 +229,7 @@ int setupServer (int serverPort)
   }
 
   if (setsockopt (serverFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on)) < 0)
-    return -1 ;
+    goto fail ;
 
 // Setup the servers socket address - cope with IPv4 and v6.
 
@@ -302,29 +248,40 @@ int setupServer (int serverPort)
       serverSockAddr.sin6.sin6_port   = htons (serverPort) ;
   }
 
-// Bind, listen and accept
+// Bind and listen. Clients are taken by acceptClient from here on
 
   if (bind (serverFd, (struct sockaddr *)&serverSockAddr, serverSockAddrSize) < 0)
-    return -1 ;
+    goto fail ;
 
-  if (listen (serverFd, 4) < 0)	// Really only going to talk to one client at a time...
-    return -1 ;
+  if (listen (serverFd, 16) < 0)
+    goto fail ;
 
-  if ((clientFd = accept (serverFd, (struct sockaddr *)&clientSockAddr, &clientSockAddrSize)) < 0)
-    return -1 ;
+  return serverFd ;
 
-  return clientFd ;
+fail:
+  close (serverFd) ;
+  return -1 ;
 }
 
 
 /*
- * closeServer:
+ * acceptClient:
+ *	Take the next waiting connection, non-blocking, and note where
+ *	it came from. Returns -1 when there are none left.
  *********************************************************************************
  */
 
-void closeServer (int clientFd)
+int acceptClient (int serverFd, char *ipAddress, size_t len)
 {
-  if (serverFd != -1) close (serverFd) ;
-  if (clientFd != -1) close (clientFd) ;
-  serverFd = clientFd = -1 ;
+  union sockAddr clientSockAddr ;
+  socklen_t clientSockAddrSize = sizeof (clientSockAddr) ;
+  int clientFd, on = 1 ;
+
+  if ((clientFd = accept4 (serverFd, (struct sockaddr *)&clientSockAddr, &clientSockAddrSize, SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0)
+    return -1 ;
+
+  (void)setsockopt (clientFd, IPPROTO_TCP, TCP_NODELAY, (void *)&on, sizeof (on)) ;
+  getClientIP (&clientSockAddr, ipAddress, len) ;
+
+  return clientFd ;
 }
@@ -21,11 +21,15 @@
  ***********************************************************************
  */
 
-extern char *getClientIP   (void) ;
-extern int   getResponce   (int clientFd) ;
+#define	SALT_LEN	16
+
+// Being sort of lazy about this. I'm expecting an SHA-512 hash back and these
+//	are exactly 86 characters long
+
+#define	RESPONSE_LEN	86
+
 extern int   setupServer   (int serverPort) ;
-extern int   sendGreeting  (int clientFd) ;
-extern int   sendChallenge (int clientFd) ;
-extern int   getResponse   (int clientFd) ;
-extern int   passwordMatch (const char *password) ;
-extern void  closeServer   (int clientFd) ;
+extern int   acceptClient  (int serverFd, char *ipAddress, size_t len) ;
+extern int   sendGreeting  (int clientFd, const char *ipAddress) ;
+extern int   sendChallenge (int clientFd, char salt []) ;
+extern int   passwordMatch (const char *password, const char *salt, const char *response) ;
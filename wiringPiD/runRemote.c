@@ -23,6 +23,10 @@
  */
 
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -39,88 +43,577 @@
 #include "runRemote.h"
 
 
+// Clients are served by one thread in rounds: each gets up to QUANTUM
+//	of the commands it has queued before the next one's turn, so a busy
+//	client can't starve a quiet one.
 
-int noLocalPins = FALSE ;
+#define	QUANTUM		32
+#define	MAX_EVENTS	16
+#define	IN_SIZE		(DRCN_BATCH_MAX * sizeof (struct drcNetComStruct))
+#define	OUT_SIZE	(4 * IN_SIZE)
 
+// Pins tracked for ownership, higher ones are shared
 
-void runRemoteCommands (int fd)
+#define	OWNED_PINS	1024
+
+enum { CLIENT_AUTH, CLIENT_RUN } ;
+
+struct remoteClient
+{
+  int      fd ;
+  int      state ;
+  int      version ;
+  int      dead ;
+  uint32_t events ;		// epoll interest
+  char     ipAddress [128] ;
+  char     salt [SALT_LEN + 1] ;
+  size_t   have, outHave ;
+  uint8_t  in  [IN_SIZE] ;	// queued commands
+  uint8_t  out [OUT_SIZE] ;	// replies not yet sent
+  struct remoteClient *next ;
+} ;
+
+static struct remoteClient *clients = NULL ;
+static struct remoteClient *pinOwner [OWNED_PINS] ;
+
+// Edge subscriptions. Each watched pin is registered once with the
+//	interrupt engine, for both edges, and its edges are handed from the
+//	interrupt thread to the reactor through edgeQueue and edgeFd.
+
+#define	EDGE_QUEUE	256
+
+struct subscription
+{
+  uint32_t pin ;
+  int      mode ;
+  struct remoteClient *client ;
+  struct subscription *next ;
+} ;
+
+static struct subscription *subscriptions = NULL ;
+
+static struct wiringPiEventStruct edgeQueue [EDGE_QUEUE] ;
+static int             edgeCount = 0 ;
+static pthread_mutex_t edgeLock  = PTHREAD_MUTEX_INITIALIZER ;
+static int             edgeFd    = -1 ;
+
+int noLocalPins  = FALSE ;
+int pinOwnership = FALSE ;
+
+
+/*
+ * claimPins:
+ *	With pin ownership on, the first client to change a pin owns it until
+ *	it disconnects and changes from anyone else are dropped.
+ *********************************************************************************
+ */
+
+static int claimPins (struct remoteClient *client, uint32_t pin, int count)
+{
+  uint32_t p ;
+
+  if (!pinOwnership)
+    return TRUE ;
+
+  for (p = pin ; p < pin + count ; ++p)
+    if ((p < OWNED_PINS) && (pinOwner [p] != NULL) && (pinOwner [p] != client))
+      return FALSE ;
+
+  for (p = pin ; p < pin + count ; ++p)
+    if (p < OWNED_PINS)
+      pinOwner [p] = client ;
+
+  return TRUE ;
+}
+
+
+/*
+ * edgeHandler:
+ *	Runs on the interrupt thread, so only queues the edge for the reactor.
+ *	Edges are dropped while the queue is full.
+ *********************************************************************************
+ */
+
+static void edgeHandler (struct wiringPiEventStruct *event, void *userdata)
+{
+  uint64_t one = 1 ;
+
+  (void)userdata ;
+
+  pthread_mutex_lock (&edgeLock) ;
+  if (edgeCount < EDGE_QUEUE)
+    edgeQueue [edgeCount++] = *event ;
+  pthread_mutex_unlock (&edgeLock) ;
+
+  if (write (edgeFd, &one, sizeof (one)) < 0)
+    return ;
+}
+
+
+/*
+ * pinWatched: unsubscribe: subscribe:
+ *	Manage a clients subscription to the edges of pin. The interrupt
+ *	engine only watches a pin while somebody is subscribed to it.
+ *********************************************************************************
+ */
+
+static int pinWatched (uint32_t pin)
+{
+  struct subscription *sub ;
+
+  for (sub = subscriptions ; sub != NULL ; sub = sub->next)
+    if (sub->pin == pin)
+      return TRUE ;
+
+  return FALSE ;
+}
+
+static void unsubscribe (struct remoteClient *client, uint32_t pin, int allPins)
+{
+  struct subscription *sub, **prev ;
+
+  for (prev = &subscriptions ; (sub = *prev) != NULL ; )
+  {
+    if ((sub->client != client) || (!allPins && (sub->pin != pin)))
+    {
+      prev = &sub->next ;
+      continue ;
+    }
+
+    *prev = sub->next ;
+    if (!pinWatched (sub->pin))
+      (void)wiringPiISRCancel (sub->pin) ;
+    free (sub) ;
+  }
+}
+
+static int subscribe (struct remoteClient *client, uint32_t pin, int mode)
+{
+  struct subscription *sub ;
+
+  if (mode == -1)
+  {
+    unsubscribe (client, pin, FALSE) ;
+    return 0 ;
+  }
+
+  if ((client->version < 2) || (mode < INT_EDGE_FALLING) || (mode > INT_EDGE_BOTH))
+    return -1 ;
+
+  for (sub = subscriptions ; sub != NULL ; sub = sub->next)
+    if ((sub->client == client) && (sub->pin == pin))
+    {
+      sub->mode = mode ;
+      return 0 ;
+    }
+
+  if (!pinWatched (pin) && (wiringPiISREvent (pin, INT_EDGE_BOTH, edgeHandler, NULL) < 0))
+    return -1 ;
+
+  if ((sub = malloc (sizeof (*sub))) == NULL)
+  {
+    if (!pinWatched (pin))
+      (void)wiringPiISRCancel (pin) ;
+    return -1 ;
+  }
+
+  sub->pin      = pin ;
+  sub->mode     = mode ;
+  sub->client   = client ;
+  sub->next     = subscriptions ;
+  subscriptions = sub ;
+
+  return 0 ;
+}
+
+
+/*
+ * sendEdges:
+ *	Hand the queued edges to every client subscribed to them. A client
+ *	with no room for an edge loses it.
+ *********************************************************************************
+ */
+
+static void sendEdges (void)
+{
+  struct wiringPiEventStruct edges [EDGE_QUEUE] ;
+  struct drcNetEventStruct msg ;
+  struct subscription *sub ;
+  uint64_t count ;
+  int num, i ;
+
+  if (read (edgeFd, &count, sizeof (count)) < 0)
+    return ;
+
+  pthread_mutex_lock (&edgeLock) ;
+  num = edgeCount ;
+  memcpy (edges, edgeQueue, num * sizeof (edges [0])) ;
+  edgeCount = 0 ;
+  pthread_mutex_unlock (&edgeLock) ;
+
+  for (i = 0 ; i < num ; ++i)
+    for (sub = subscriptions ; sub != NULL ; sub = sub->next)
+    {
+      if ((sub->pin != (uint32_t)edges [i].pin) || ((edges [i].edge & sub->mode) == 0))
+	continue ;
+      if (sub->client->outHave + sizeof (msg) > OUT_SIZE)
+	continue ;
+
+      msg.pin       = sub->pin ;
+      msg.cmd       = DRCN_EVENT ;
+      msg.edge      = edges [i].edge ;
+      msg.seq       = edges [i].seq ;
+      msg.timestamp = edges [i].timestamp ;
+
+      memcpy (sub->client->out + sub->client->outHave, &msg, sizeof (msg)) ;
+      sub->client->outHave += sizeof (msg) ;
+    }
+}
+
+
+/*
+ * runCommand:
+ *	Do what the remote end asked. Returns TRUE if the command is answered
+ *	under protocol 2 (reads), cmd->data then holding the answer.
+ *********************************************************************************
+ */
+
+static int runCommand (struct remoteClient *client, struct drcNetComStruct *cmd)
+{
+  uint32_t pin = cmd->pin ;
+  int isRead, count ;
+
+  isRead = (cmd->cmd == DRCN_DIGITAL_READ)  ||
+	   (cmd->cmd == DRCN_DIGITAL_READ8) ||
+	   (cmd->cmd == DRCN_ANALOG_READ) ;
+
+  if (noLocalPins && ((pin & PI_GPIO_MASK) == 0))
+  {
+    if (cmd->cmd == DRCN_SUBSCRIBE)
+      cmd->data = -1 ;
+    return isRead || (cmd->cmd == DRCN_SUBSCRIBE) ;
+  }
+
+  if (cmd->cmd == DRCN_SUBSCRIBE)
+  {
+    cmd->data = subscribe (client, pin, (int)cmd->data) ;
+    return TRUE ;
+  }
+
+  count = (cmd->cmd == DRCN_DIGITAL_WRITE8) ? 8 : 1 ;
+  if (!isRead && !claimPins (client, pin, count))
+    return FALSE ;
+
+  switch (cmd->cmd)
+  {
+    case DRCN_PIN_MODE:       pinMode         (pin, cmd->data) ;	break ;
+    case DRCN_PULL_UP_DN:     pullUpDnControl (pin, cmd->data) ;	break ;
+    case DRCN_PWM_WRITE:      pwmWrite        (pin, cmd->data) ;	break ;
+    case DRCN_DIGITAL_WRITE:  digitalWrite    (pin, cmd->data) ;	break ;
+    case DRCN_DIGITAL_WRITE8: digitalWrite8   (pin, cmd->data) ;	break ;
+    case DRCN_ANALOG_WRITE:   analogWrite     (pin, cmd->data) ;	break ;
+
+    case DRCN_DIGITAL_READ:   cmd->data = digitalRead  (pin) ;	break ;
+    case DRCN_DIGITAL_READ8:  cmd->data = digitalRead8 (pin) ;	break ;
+    case DRCN_ANALOG_READ:    cmd->data = analogRead   (pin) ;	break ;
+  }
+
+  return isRead ;
+}
+
+
+/*
+ * clientRun:
+ *	Give a client its turn: check the password once it has all arrived,
+ *	then run up to quantum queued commands. Protocol 1 answers everything,
+ *	protocol 2 only reads. Returns -1 if the client is to be dropped.
+ *********************************************************************************
+ */
+
+static int clientRun (struct remoteClient *client, const char *password, int quantum)
 {
-  register uint32_t pin ;
-  int len ;
   struct drcNetComStruct cmd ;
+  size_t off = 0 ;
+
+  if (client->state == CLIENT_AUTH)
+  {
+    if (client->have < RESPONSE_LEN)
+      return 0 ;
+
+    if (!passwordMatch (password, client->salt, (char *)client->in))
+    {
+      logMsg ("Password failure: %s", client->ipAddress) ;
+      return -1 ;
+    }
+
+    logMsg ("Password OK - Starting: %s", client->ipAddress) ;
+    client->state   = CLIENT_RUN ;
+    client->version = 1 ;
+    off             = RESPONSE_LEN ;
+  }
+
+  for ( ; (quantum > 0) && (client->have - off >= sizeof (cmd)) ; off += sizeof (cmd), --quantum)
+  {
+    if (client->outHave + sizeof (cmd) > OUT_SIZE)
+      break ;
+
+    memcpy (&cmd, client->in + off, sizeof (cmd)) ;
+
+    if (cmd.cmd == DRCN_PROTOCOL)
+    {
+      if (cmd.data > DRCN_VERSION)
+	cmd.data = DRCN_VERSION ;
+      client->version = cmd.data ;
+    }
+    else if (!runCommand (client, &cmd) && (client->version >= 2))
+      continue ;
+
+    memcpy (client->out + client->outHave, &cmd, sizeof (cmd)) ;
+    client->outHave += sizeof (cmd) ;
+  }
+
+  memmove (client->in, client->in + off, client->have - off) ;
+  client->have -= off ;
+
+  return 0 ;
+}
+
+
+/*
+ * clientPending:
+ *	The client has commands queued that it is allowed to run.
+ *********************************************************************************
+ */
+
+static int clientPending (struct remoteClient *client)
+{
+  if (client->state == CLIENT_AUTH)
+    return client->have >= RESPONSE_LEN ;
+
+  return (client->have >= sizeof (struct drcNetComStruct)) &&
+	 (client->outHave + QUANTUM * sizeof (struct drcNetComStruct) <= OUT_SIZE) ;
+}
+
+
+/*
+ * clientRead: clientWrite:
+ *	Move what the socket will take without blocking. Return -1 if the
+ *	client has gone.
+ *********************************************************************************
+ */
+
+static int clientRead (struct remoteClient *client)
+{
+  ssize_t len ;
+
+  if (client->have == IN_SIZE)
+    return 0 ;
+
+  len = recv (client->fd, client->in + client->have, IN_SIZE - client->have, 0) ;
+
+  if (len == 0)
+    return -1 ;
+  if (len < 0)
+    return ((errno == EAGAIN) || (errno == EINTR)) ? 0 : -1 ;
+
+  client->have += len ;
+  return 0 ;
+}
+
+static int clientWrite (struct remoteClient *client)
+{
+  ssize_t len ;
+
+  if (client->outHave == 0)
+    return 0 ;
+
+  if ((len = send (client->fd, client->out, client->outHave, MSG_NOSIGNAL)) < 0)
+    return ((errno == EAGAIN) || (errno == EINTR)) ? 0 : -1 ;
+
+  memmove (client->out, client->out + len, client->outHave - len) ;
+  client->outHave -= len ;
+  return 0 ;
+}
+
+
+/*
+ * clientInterest:
+ *	Only read from a client with room to queue, and while its replies
+ *	are being taken. Wait to write while replies are backed up.
+ *********************************************************************************
+ */
+
+static void clientInterest (int epollFd, struct remoteClient *client)
+{
+  struct epoll_event ev ;
+  uint32_t events = 0 ;
+
+  if ((client->have < IN_SIZE) && (client->outHave + QUANTUM * sizeof (struct drcNetComStruct) <= OUT_SIZE))
+    events |= EPOLLIN ;
+  if (client->outHave > 0)
+    events |= EPOLLOUT ;
 
-  len = sizeof (struct drcNetComStruct) ;
+  if (events == client->events)
+    return ;
+
+  ev.events   = events ;
+  ev.data.ptr = client ;
+  (void)epoll_ctl (epollFd, EPOLL_CTL_MOD, client->fd, &ev) ;
+  client->events = events ;
+}
+
+
+/*
+ * clientNew: clientFree:
+ *********************************************************************************
+ */
 
-  if (setsockopt (fd, SOL_SOCKET, SO_RCVLOWAT, (void *)&len, sizeof (len)) < 0)
+static void clientNew (int epollFd, int fd, const char *ipAddress)
+{
+  struct remoteClient *client ;
+  struct epoll_event ev ;
+
+  logMsg ("New connection from: %s.", ipAddress) ;
+
+  if ((client = calloc (1, sizeof (*client))) == NULL)
+  {
+    logMsg ("Out of memory") ;
+    close (fd) ;
     return ;
+  }
+
+  client->fd     = fd ;
+  client->state  = CLIENT_AUTH ;
+  client->events = EPOLLIN ;
+  snprintf (client->ipAddress, sizeof (client->ipAddress), "%s", ipAddress) ;
+
+  if ((sendGreeting (fd, ipAddress) < 0) || (sendChallenge (fd, client->salt) < 0))
+  {
+    logMsg ("Unable to send greeting: %s", strerror (errno)) ;
+    close (fd) ;
+    free  (client) ;
+    return ;
+  }
+
+  ev.events   = client->events ;
+  ev.data.ptr = client ;
+  if (epoll_ctl (epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+  {
+    close (fd) ;
+    free  (client) ;
+    return ;
+  }
+
+  client->next = clients ;
+  clients      = client ;
+}
+
+static void clientFree (int epollFd, struct remoteClient *client)
+{
+  int pin ;
+
+  logMsg ("Connection closed: %s", client->ipAddress) ;
+
+  unsubscribe (client, 0, TRUE) ;
+
+  for (pin = 0 ; pin < OWNED_PINS ; ++pin)
+    if (pinOwner [pin] == client)
+      pinOwner [pin] = NULL ;
+
+  (void)epoll_ctl (epollFd, EPOLL_CTL_DEL, client->fd, NULL) ;
+  close (client->fd) ;
+  free  (client) ;
+}
+
+
+/*
+ * runServer:
+ *	The reactor. Take in new connections and whatever each client has
+ *	sent, then give every client a turn, until something fatal happens.
+ *********************************************************************************
+ */
+
+int runServer (int serverFd, const char *password)
+{
+  struct epoll_event ev, events [MAX_EVENTS] ;
+  struct remoteClient *client, **prev ;
+  char ipAddress [128] ;
+  int epollFd, fd, num, i, pending = FALSE ;
+
+  if ((epollFd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    return -1 ;
+
+  ev.events   = EPOLLIN ;
+  ev.data.ptr = NULL ;
+  if (epoll_ctl (epollFd, EPOLL_CTL_ADD, serverFd, &ev) < 0)
+    return -1 ;
+
+  if ((edgeFd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    return -1 ;
+
+  ev.events   = EPOLLIN ;
+  ev.data.ptr = &edgeFd ;
+  if (epoll_ctl (epollFd, EPOLL_CTL_ADD, edgeFd, &ev) < 0)
+    return -1 ;
 
   for (;;)
   {
-    if (recv (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))	// Probably remote hangup
-      return ;
+    if ((num = epoll_wait (epollFd, events, MAX_EVENTS, pending ? 0 : -1)) < 0)
+    {
+      if (errno == EINTR)
+	continue ;
+      return -1 ;
+    }
 
-    pin = cmd.pin ;
-    if (noLocalPins && ((pin & PI_GPIO_MASK) == 0))
+    for (i = 0 ; i < num ; ++i)
     {
-      if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	return ;
-      continue ;
+      if (events [i].data.ptr == &edgeFd)
+      {
+	sendEdges () ;
+	continue ;
+      }
+
+      if ((client = (struct remoteClient *)events [i].data.ptr) == NULL)
+      {
+	while ((fd = acceptClient (serverFd, ipAddress, sizeof (ipAddress))) >= 0)
+	  clientNew (epollFd, fd, ipAddress) ;
+	continue ;
+      }
+
+      if (events [i].events & EPOLLIN)
+	if (clientRead (client) < 0)
+	  client->dead = TRUE ;
+
+      if (events [i].events & EPOLLOUT)
+	if (clientWrite (client) < 0)
+	  client->dead = TRUE ;
+
+// A hangup with data still to come is seen by clientRead
+
+      if ((events [i].events & EPOLLERR) || (events [i].events & (EPOLLIN | EPOLLHUP)) == EPOLLHUP)
+	client->dead = TRUE ;
     }
 
-    switch (cmd.cmd)
+// One round: every client gets its turn, then its replies go out
+
+    pending = FALSE ;
+    for (prev = &clients ; (client = *prev) != NULL ; )
     {
-      case DRCN_PIN_MODE:
-	pinMode (pin, cmd.data) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
-	break ;
-
-      case DRCN_PULL_UP_DN:
-	pullUpDnControl (pin, cmd.data) ;
-	break ;
-
-      case DRCN_PWM_WRITE:
-	pwmWrite (pin, cmd.data) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
-	break ;
-
-      case DRCN_DIGITAL_WRITE:
-	digitalWrite (pin, cmd.data) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
-	break ;
-
-      case DRCN_DIGITAL_WRITE8:
-	//digitalWrite8 (pin, cmd.data) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
-	break ;
-
-      case DRCN_DIGITAL_READ:
-	cmd.data = digitalRead (pin) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
-	break ;
-
-      case DRCN_DIGITAL_READ8:
-	//cmd.data = digitalRead8 (pin) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
-	break ;
-
-      case DRCN_ANALOG_WRITE:
-	analogWrite (pin, cmd.data) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
-	break ;
-
-      case DRCN_ANALOG_READ:
-	cmd.data = analogRead (pin) ;
-	if (send (fd, &cmd, sizeof (cmd), 0) != sizeof (cmd))
-	  return ;
-	break ;
+      if (!client->dead && (clientRun (client, password, QUANTUM) < 0 || clientWrite (client) < 0))
+	client->dead = TRUE ;
+
+      if (client->dead)
+      {
+	*prev = client->next ;
+	clientFree (epollFd, client) ;
+	continue ;
+      }
+
+      if (clientPending (client))
+	pending = TRUE ;
+
+      clientInterest (epollFd, client) ;
+      prev = &client->next ;
     }
   }
-
 }
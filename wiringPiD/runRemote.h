@@ -25,5 +25,10 @@
 // Globals
 
 extern int noLocalPins ;
+extern int pinOwnership ;
 
-extern void runRemoteCommands (int fd) ;
+extern int  runServer (int serverFd, const char *password) ;
+
+// From wiringpid.c
+
+extern void logMsg (const char *message, ...) ;
@@ -45,12 +45,12 @@
 
 // Globals
 
-static const char *usage = "[-h] [-d] [-g | -1 | -z] [[-x extension:pin:params] ...] password" ;
+static const char *usage = "[-h] [-d] [-g | -1 | -z] [-o] [-p port] [[-x extension:pin:params] ...] password" ;
 static int doDaemon = FALSE ;
 
 //
 
-static void logMsg (const char *message, ...)
+void logMsg (const char *message, ...)
 {
   va_list argp ;
   char buffer [1024] ;
@@ -124,7 +124,7 @@ void setupSigHandler (void)
 
 int main (int argc, char *argv [])
 {
-  int clientFd ;
+  int serverFd ;
   char *p, *password ;
   int i ;
   int port = DEFAULT_SERVER_PORT ;
@@ -221,6 +221,19 @@ int main (int argc, char *argv [])
       continue ;
     }
 
+// -o - a pin belongs to the first client to change it, until it goes
+
+    if (strcasecmp (argv [1], "-o") == 0)
+    {
+      logMsg ("Pin ownership enabled") ;
+
+      for (i = 2 ; i < argc ; ++i)
+	argv [i - 1] = argv [i] ;
+      --argc ;
+      pinOwnership = TRUE ;
+      continue ;
+    }
+
 // -p to select the port
 
     if (strcasecmp (argv [1], "-p") == 0)
@@ -319,63 +332,21 @@ int main (int argc, char *argv [])
 
   setupSigHandler () ;
  
-// Enter our big loop
+// Enter our big loop. All clients are served from here, one thread.
 
-  for (;;)
+  if ((serverFd = setupServer (port)) < 0)
   {
+    logMsg ("Unable to setup server: %s", strerror (errno)) ;
+    exit (EXIT_FAILURE) ;
+  }
 
-    if (!doDaemon)
-      printf ("-=-\nWaiting for a new connection...\n") ;
-
-    if ((clientFd = setupServer (port)) < 0)
-    {
-      logMsg ("Unable to setup server: %s", strerror (errno)) ;
-      exit (EXIT_FAILURE) ;
-    }
-
-    logMsg ("New connection from: %s.", getClientIP ()) ;
-
-    if (!doDaemon)
-      printf ("Sending Greeting.\n") ;
-
-    if (sendGreeting (clientFd) < 0)
-    {
-      logMsg ("Unable to send greeting message: %s", strerror (errno)) ;
-      closeServer (clientFd) ;
-      continue ;
-    }
-
-    if (!doDaemon)
-      printf ("Sending Challenge.\n") ;
-
-    if (sendChallenge (clientFd) < 0)
-    {
-      logMsg ("Unable to send challenge message: %s", strerror (errno)) ;
-      closeServer (clientFd) ;
-      continue ;
-    }
-
-    if (!doDaemon)
-      printf ("Waiting for response.\n") ;
-
-    if (getResponse (clientFd) < 0)
-    {
-      logMsg ("Connection closed waiting for response: %s", strerror (errno)) ;
-      closeServer (clientFd) ;
-      continue ;
-    }
-
-    if (!passwordMatch (password))
-    {
-      logMsg ("Password failure") ;
-      closeServer (clientFd) ;
-      continue ;
-    }
-
-    logMsg ("Password OK - Starting") ;
+  logMsg ("Waiting for connections on port %d", port) ;
 
-    runRemoteCommands (clientFd) ;
-    closeServer       (clientFd) ;
+  if (runServer (serverFd, password) < 0)
+  {
+    logMsg ("Server failed: %s", strerror (errno)) ;
+    (void)unlink (PIDFILE) ;
+    exit (EXIT_FAILURE) ;
   }
 
   return 0 ;